@@ -0,0 +1,138 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+
+#pragma once
+
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+
+// Set of vm addresses, memory then registers, kept as a bitmap so that a lookup is a shift
+// and a mask whatever the number of addresses in it
+struct address_set_t final {
+	static size_t const SIZE = 32768 + 8;
+
+	struct const_iterator {
+		using iterator_category = std::forward_iterator_tag;
+		using value_type = uint16_t;
+		using difference_type = std::ptrdiff_t;
+		using pointer = uint16_t const *;
+		using reference = uint16_t;
+
+		const_iterator( address_set_t const * Set, size_t Address ): set( Set ), address( Address ) { }
+
+		uint16_t operator*( ) const {
+			return static_cast<uint16_t>(address);
+		}
+		const_iterator & operator++( ) {
+			address = set->next( address + 1 );
+			return *this;
+		}
+		bool operator==( const_iterator const & rhs ) const {
+			return address == rhs.address;
+		}
+		bool operator!=( const_iterator const & rhs ) const {
+			return address != rhs.address;
+		}
+
+		address_set_t const * set;
+		size_t address;
+	};	// struct const_iterator
+
+	address_set_t( ): m_bits( ), m_size( 0 ) { }
+
+	size_t count( uint16_t address ) const {
+		return address < SIZE ? (m_bits[address >> 6] >> (address & 63)) & 1 : 0;
+	}
+
+	// true if any of the addresses in [first, last) is in the set
+	bool intersects( uint16_t const * first, uint16_t const * last ) const {
+		for( ; first != last; ++first ) {
+			if( count( *first ) != 0 ) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	bool insert( uint16_t address ) {
+		assert( address < SIZE );
+		if( address >= SIZE || count( address ) != 0 ) {
+			return false;
+		}
+		m_bits[address >> 6] |= uint64_t( 1 ) << (address & 63);
+		++m_size;
+		return true;
+	}
+
+	size_t erase( uint16_t address ) {
+		if( count( address ) == 0 ) {
+			return 0;
+		}
+		m_bits[address >> 6] &= ~(uint64_t( 1 ) << (address & 63));
+		--m_size;
+		return 1;
+	}
+
+	void clear( ) {
+		m_bits.fill( 0 );
+		m_size = 0;
+	}
+
+	size_t size( ) const {
+		return m_size;
+	}
+
+	bool empty( ) const {
+		return m_size == 0;
+	}
+
+	const_iterator begin( ) const {
+		return const_iterator( this, next( 0 ) );
+	}
+
+	const_iterator end( ) const {
+		return const_iterator( this, SIZE );
+	}
+private:
+	// First address from address on that is in the set, SIZE if none
+	size_t next( size_t address ) const {
+		while( address < SIZE ) {
+			auto bits = m_bits[address >> 6] >> (address & 63);
+			if( bits != 0 ) {
+				for( ; (bits & 1) == 0; bits >>= 1 ) {
+					++address;
+				}
+				return address;
+			}
+			address = (address | 63) + 1;
+		}
+		return SIZE;
+	}
+
+	std::array<uint64_t, (SIZE + 63) / 64> m_bits;
+	size_t m_size;
+};	// struct address_set_t
@@ -0,0 +1,108 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include "aot_runtime.h"
+
+aot_runtime_t::aot_runtime_t( aot_image_t const & image ):
+	vm( ),
+	m_code( image.code ),
+	m_blocks( image.blocks, image.blocks + image.block_count ),
+	m_block_at( virtual_machine_t::MODULO, -1 ),
+	m_ready( std::numeric_limits<uint16_t>::max( ) + 1, 0 ),
+	m_generation( 0 ),
+	m_instrumented( false ) {
+
+	std::copy( image.memory, image.memory + vm.memory.size( ), vm.memory.begin( ) );
+	std::copy( image.registers, image.registers + vm.registers.size( ), vm.registers.begin( ) );
+	vm.instruction_ptr = image.instruction_ptr;
+	for( size_t n = 0; n < image.program_stack_size; ++n ) {
+		vm.program_stack.push_back( image.program_stack[n] );
+	}
+	for( size_t n = 0; n < m_blocks.size( ); ++n ) {
+		m_block_at[m_blocks[n].start] = static_cast<int32_t>(n);
+	}
+	m_generation = vm.decode_cache.generation( );
+	m_instrumented = vm.is_instrumented( );
+}
+
+bool aot_runtime_t::verify( uint16_t address ) {
+	if( m_instrumented || address >= m_block_at.size( ) || m_block_at[address] < 0 ) {
+		return false;
+	}
+	auto const & block = m_blocks[static_cast<size_t>(m_block_at[address])];
+	if( !std::equal( vm.memory.begin( ) + block.start, vm.memory.begin( ) + block.end, m_code + block.code ) ) {
+		return false;
+	}
+	// Watch every instruction so that overwriting one retires the block
+	for( uint32_t ip = block.start; ip < block.end; ) {
+		auto const * entry = vm.decode_cache.fetch( vm.memory, static_cast<uint16_t>(ip) );
+		assert( entry != nullptr );
+		vm.decode_cache.watch( static_cast<uint16_t>(ip) );
+		ip += entry->length;
+	}
+	m_ready[address] = 1;
+	return true;
+}
+
+bool aot_runtime_t::sync( ) {
+	bool retired = false;
+	if( vm.decode_cache.generation( ) != m_generation ) {
+		// A new state was loaded from the console, check everything again before use
+		m_generation = vm.decode_cache.generation( );
+		std::fill( m_ready.begin( ), m_ready.end( ), 0 );
+		retired = true;
+	} else if( vm.decode_cache.has_modified( ) ) {
+		for( auto const address : vm.decode_cache.take_modified( ) ) {
+			for( auto const & block : m_blocks ) {
+				if( block.start <= address && address < block.end && m_ready[block.start] != 0 ) {
+					m_ready[block.start] = 0;
+					retired = true;
+				}
+			}
+		}
+	}
+	auto const instrumented = vm.is_instrumented( );
+	if( instrumented && !m_instrumented ) {
+		// Breakpoints and tracing need every instruction to go through the interpreter
+		std::fill( m_ready.begin( ), m_ready.end( ), 0 );
+		retired = true;
+	}
+	m_instrumented = instrumented;
+	return retired;
+}
+
+int aot_main( aot_image_t const & image, aot_run_t run ) {
+	std::unique_ptr<aot_runtime_t> runtime( new aot_runtime_t( image ) );
+	try {
+		run( *runtime );
+	} catch( vm_exit_t const & e ) {
+		runtime->vm.output.flush( );
+		return e.report( );
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,102 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "vm.h"
+
+// Runtime for programs generated by to_cpp.  The generated aot_run( ) keeps the vm registers 
+// in locals and runs straight-line C++ for every block found statically, handing anything
+// else(indirect jumps to unknown code, IN, HALT, errors) to virtual_machine_t::tick( ) one
+// instruction at a time.  A block is only entered while memory holds the words it was 
+// translated from, so code that is decrypted or overwritten at run time stays correct
+
+// Words [start, end) of memory translated into one straight-line block.  The words the block
+// was translated from are at aot_image_t::code + code
+struct aot_block_t {
+	uint16_t start;
+	uint16_t end;
+	uint32_t code;
+};	// struct aot_block_t
+
+// The state the generated program starts from and the blocks it was translated into
+struct aot_image_t {
+	uint16_t const * memory;	// 32768 words
+	uint16_t const * registers;	// 8 words
+	uint16_t instruction_ptr;
+	uint16_t const * program_stack;
+	size_t program_stack_size;
+	aot_block_t const * blocks;
+	size_t block_count;
+	uint16_t const * code;
+};	// struct aot_image_t
+
+struct aot_runtime_t {
+	virtual_machine_t vm;
+
+	explicit aot_runtime_t( aot_image_t const & image );
+
+	// Can compiled code jump straight to the block at address.  Used for every transfer 
+	// between blocks that does not go through dispatch
+	bool is_ready( uint16_t address ) const {
+		return m_ready[address] != 0;
+	}
+
+	// Dispatch to address, checking a block that is not ready against memory first
+	bool enter( uint16_t address ) {
+		return is_ready( address ) || verify( address );
+	}
+
+	// Memory write from compiled code.  Returns true if it overwrote a compiled block, in 
+	// which case the caller must go back to dispatch before running anything else
+	bool write( uint16_t address, uint16_t value ) {
+		vm.set_memory( address, value );
+		return vm.decode_cache.has_modified( ) && sync( );
+	}
+
+	// Run one instruction with the interpreter
+	void interpret( ) {
+		vm.tick( );
+		sync( );
+	}
+private:
+	bool verify( uint16_t address );
+	// Retire blocks made stale by memory writes and pick up instrumentation changes.  Returns
+	// true if a ready block was retired
+	bool sync( );
+
+	uint16_t const * m_code;
+	std::vector<aot_block_t> m_blocks;
+	std::vector<int32_t> m_block_at;	// index of the block starting at an address or -1
+	std::vector<uint8_t> m_ready;		// one per uint16_t so any ip can be tested.  All 0 while instrumented
+	uint64_t m_generation;
+	bool m_instrumented;
+};	// struct aot_runtime_t
+
+using aot_run_t = void( * )( aot_runtime_t & );
+
+// Entry point for generated programs
+int aot_main( aot_image_t const & image, aot_run_t run );
@@ -0,0 +1,93 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <exception>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include "batch.h"
+
+batch_session_t::batch_session_t( std::string VmFile, std::string ScriptFile ):
+	vm_file( std::move( VmFile ) ),
+	script_file( std::move( ScriptFile ) ),
+	output( ),
+	vm( ),
+	exit_code( EXIT_SUCCESS ),
+	error( ) { }
+
+void run_session( batch_session_t & session, engine_t engine, uint64_t max_instructions ) {
+	try {
+		std::ifstream script( session.script_file, std::ios::binary );
+		if( !script ) {
+			throw vm_exit_t( EXIT_FAILURE, "Could not open input file '" + session.script_file + "'" );
+		}
+		std::ostringstream text;
+		text << script.rdbuf( );
+
+		// Sessions started from the same file share its pages until they write to them
+		session.vm.reset( new virtual_machine_t( session.vm_file, image_load_t::map ) );
+		auto & vm = *session.vm;
+		vm.output.set_sink( memory_sink( session.output ) );
+		vm.input.set_readers( { memory_reader( text.str( ) ) } );
+		vm.input.set_exhausted_policy( exhausted_policy_t::halt );
+
+		uint64_t const slice = 1u << 16;
+		uint64_t count = 0;
+		while( count < max_instructions ) {
+			count += run_engine( vm, engine, std::min( slice, max_instructions - count ) );
+		}
+		vm.output.flush( );
+		session.exit_code = EXIT_FAILURE;
+		session.error = "Instruction limit of " + std::to_string( max_instructions ) + " reached";
+	} catch( vm_exit_t const & e ) {
+		if( session.vm ) {
+			session.vm->output.flush( );
+		}
+		session.exit_code = e.exit_code;
+		session.error = e.message;
+	} catch( std::exception const & e ) {
+		session.exit_code = EXIT_FAILURE;
+		session.error = e.what( );
+	}
+}
+
+void run_batch( std::vector<batch_session_t> & sessions, engine_t engine, size_t thread_count, uint64_t max_instructions ) {
+	// Sessions are handed out one at a time as their lengths vary a lot
+	std::atomic<size_t> next_session( 0 );
+	auto const worker = [&]( ) {
+		for( size_t n = next_session++; n < sessions.size( ); n = next_session++ ) {
+			run_session( sessions[n], engine, max_instructions );
+		}
+	};
+	std::vector<std::thread> workers;
+	for( size_t n = 1; n < std::min( thread_count, sessions.size( ) ); ++n ) {
+		workers.emplace_back( worker );
+	}
+	worker( );
+	for( auto & w : workers ) {
+		w.join( );
+	}
+}
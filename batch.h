@@ -0,0 +1,51 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "engine.h"
+#include "vm.h"
+
+// One run of the batch runner, a vm image or saved state fed from an input script.  Once
+// run it holds everything the program wrote and the state the vm stopped in
+struct batch_session_t {
+	std::string vm_file;
+	std::string script_file;
+	std::string output;
+	std::unique_ptr<virtual_machine_t> vm;	// null if the vm file could not be loaded
+	int exit_code;
+	std::string error;	// why the session stopped, empty on a HALT or the end of the script
+
+	batch_session_t( std::string VmFile, std::string ScriptFile );
+};	// struct batch_session_t
+
+// Run session until the program halts, fails, runs out of input or has executed
+// max_instructions.  Never exits the process, the outcome is left in the session
+void run_session( batch_session_t & session, engine_t engine, uint64_t max_instructions );
+
+// Run every session on a pool of thread_count workers
+void run_batch( std::vector<batch_session_t> & sessions, engine_t engine, size_t thread_count, uint64_t max_instructions );
@@ -0,0 +1,138 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include "call_graph.h"
+#include "vm.h"
+
+call_graph_t::call_graph_t( ):
+	m_contexts( 1, context_t{ 0, 0, 0 } ),
+	m_children( ),
+	m_frames( ),
+	m_functions( ),
+	m_context( 0 ),
+	m_instructions( 0 ) { }
+
+void call_graph_t::clear( ) {
+	m_contexts.assign( 1, context_t{ 0, 0, 0 } );
+	m_children.clear( );
+	m_frames.clear( );
+	m_functions.assign( FUNCTION_COUNT, function_t{ 0, 0, 0 } );
+	m_context = 0;
+	m_instructions = 0;
+}
+
+void call_graph_t::pop_frames( size_t stack_size ) {
+	while( !m_frames.empty( ) && m_frames.back( ).stack_size > stack_size ) {
+		auto & function = m_functions[m_frames.back( ).function];
+		if( --function.active == 0 ) {
+			function.inclusive += m_instructions - m_frames.back( ).entered;
+		}
+		m_frames.pop_back( );
+	}
+	m_context = m_frames.empty( ) ? 0 : m_frames.back( ).context;
+}
+
+void call_graph_t::on_call( virtual_machine_t const & vm, uint16_t call_address ) {
+	auto const & stack = vm.program_stack;
+	if( stack.empty( ) || stack.back( ) != static_cast<uint16_t>(call_address + 2) ) {
+		return;
+	}
+	pop_frames( stack.size( ) - 1 );
+	auto const target = static_cast<uint16_t>(vm.instruction_ptr & (FUNCTION_COUNT - 1));
+	auto context = m_context;
+	if( context == 0 || m_contexts[context].function != target ) {
+		auto const key = (static_cast<uint64_t>(m_context) << 16) | target;
+		auto it = m_children.find( key );
+		if( it == m_children.end( ) ) {
+			it = m_children.emplace( key, static_cast<uint32_t>(m_contexts.size( )) ).first;
+			m_contexts.push_back( context_t{ target, m_context, 0 } );
+		}
+		context = it->second;
+	}
+	auto & function = m_functions[target];
+	++function.calls;
+	++function.active;
+	m_frames.push_back( frame_t{ target, call_address, context, stack.size( ), m_instructions } );
+	m_context = context;
+}
+
+void call_graph_t::on_return( virtual_machine_t const & vm ) {
+	pop_frames( vm.program_stack.size( ) );
+}
+
+void call_graph_t::write_collapsed( std::ostream & os ) const {
+	std::vector<uint32_t> path;
+	for( size_t n = 0; n < m_contexts.size( ); ++n ) {
+		if( m_contexts[n].instructions == 0 ) {
+			continue;
+		}
+		path.clear( );
+		for( auto context = static_cast<uint32_t>(n); context != 0; context = m_contexts[context].parent ) {
+			path.push_back( context );
+		}
+		os << "entry";
+		for( auto it = path.rbegin( ); it != path.rend( ); ++it ) {
+			os << ";" << m_contexts[*it].function;
+		}
+		os << " " << m_contexts[n].instructions << "\n";
+	}
+}
+
+void call_graph_t::report( std::ostream & os, size_t top ) const {
+	std::vector<uint64_t> exclusive( FUNCTION_COUNT );
+	for( size_t n = 1; n < m_contexts.size( ); ++n ) {
+		exclusive[m_contexts[n].function] += m_contexts[n].instructions;
+	}
+	// Calls that have not returned yet count up to now from their outermost frame
+	std::vector<uint64_t> inclusive( FUNCTION_COUNT );
+	std::vector<bool> is_counted( FUNCTION_COUNT );
+	std::vector<uint16_t> functions;
+	for( size_t n = 0; n < m_functions.size( ); ++n ) {
+		inclusive[n] = m_functions[n].inclusive;
+		if( m_functions[n].calls != 0 ) {
+			functions.push_back( static_cast<uint16_t>(n) );
+		}
+	}
+	for( auto const & frame : m_frames ) {
+		if( !is_counted[frame.function] ) {
+			is_counted[frame.function] = true;
+			inclusive[frame.function] += m_instructions - frame.entered;
+		}
+	}
+	auto const by_inclusive = [&inclusive]( uint16_t lhs, uint16_t rhs ) {
+		return inclusive[lhs] != inclusive[rhs] ? inclusive[lhs] > inclusive[rhs] : lhs < rhs;
+	};
+	top = std::min( top, functions.size( ) );
+	std::partial_sort( functions.begin( ), functions.begin( ) + static_cast<ptrdiff_t>(top), functions.end( ), by_inclusive );
+	functions.resize( top );
+
+	os << "Hottest functions\n";
+	os << std::setw( 12 ) << "inclusive" << std::setw( 12 ) << "exclusive" << std::setw( 12 ) << "calls" << "  function\n";
+	for( auto function : functions ) {
+		os << std::setw( 12 ) << inclusive[function] << std::setw( 12 ) << exclusive[function] << std::setw( 12 ) << m_functions[function].calls << "  " << function << "\n";
+	}
+}
@@ -0,0 +1,98 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <unordered_map>
+#include <vector>
+
+struct virtual_machine_t;
+
+// A shadow call stack kept beside program_stack, which CALL and RET share with PUSH and
+// POP, so that the profiler can attribute instructions to functions.  A function is
+// known by its entry address, the code running before the first call seen is the entry.
+//
+// Instructions are counted per calling context, the path of calls from the entry, with
+// direct recursion folded into one frame so that deeply recursive functions stay one
+// frame wide.  Frames are matched to program_stack by its size, so code that drops its
+// return address and jumps away loses the frame at the next call or return that sees it
+struct call_graph_t final {
+	static size_t const FUNCTION_COUNT = 32768;
+
+	struct frame_t {
+		uint16_t function;
+		uint16_t call_address;	// of the CALL in the caller
+		uint32_t context;
+		size_t stack_size;	// of program_stack with the return address pushed
+		uint64_t entered;	// instructions counted before the call
+	};	// struct frame_t
+
+	call_graph_t( );
+
+	// Needed before the first on_call, the per function counts are only allocated here
+	void clear( );
+
+	void count( ) {
+		++m_contexts[m_context].instructions;
+		++m_instructions;
+	}
+
+	// After a CALL at call_address has executed, a native override leaves program_stack
+	// as it was and is not a call
+	void on_call( virtual_machine_t const & vm, uint16_t call_address );
+	// After a RET has executed
+	void on_return( virtual_machine_t const & vm );
+
+	std::vector<frame_t> const & frames( ) const {
+		return m_frames;
+	}
+
+	// Callers first, functions named by their decimal entry address
+	void write_collapsed( std::ostream & os ) const;
+	// The top functions with the most instructions executed while they were on the stack
+	void report( std::ostream & os, size_t top ) const;
+private:
+	struct context_t {
+		uint16_t function;
+		uint32_t parent;
+		uint64_t instructions;
+	};	// struct context_t
+
+	struct function_t {
+		uint64_t calls;
+		uint64_t inclusive;	// instructions of finished outermost calls
+		uint32_t active;	// frames on the stack
+	};	// struct function_t
+
+	void pop_frames( size_t stack_size );
+
+	std::vector<context_t> m_contexts;	// the entry is 0
+	std::unordered_map<uint64_t, uint32_t> m_children;	// parent << 16 | function -> context
+	std::vector<frame_t> m_frames;
+	std::vector<function_t> m_functions;	// empty until the first clear
+	uint32_t m_context;
+	uint64_t m_instructions;
+};	// struct call_graph_t
@@ -0,0 +1,343 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+
+#include <array>
+#include <cctype>
+#include <cstdlib>
+#include <limits>
+#include "condition.h"
+#include "vm.h"
+
+namespace {
+	struct compiler_t {
+		using code_t = condition_t::code_t;
+
+		std::string const & text;
+		size_t pos;
+		std::vector<condition_t::instruction_t> code;
+		size_t depth;
+		size_t max_depth;
+		std::string error;
+
+		explicit compiler_t( std::string const & Text ): text( Text ), pos( 0 ), code( ), depth( 0 ), max_depth( 0 ), error( ) { }
+
+		void skip_space( ) {
+			while( pos < text.size( ) && std::isspace( static_cast<unsigned char>(text[pos]) ) ) {
+				++pos;
+			}
+		}
+
+		// Consumes op if it is next, and is not the start of a longer operator in others
+		bool accept( char const * op, char const * others = "" ) {
+			skip_space( );
+			auto const length = std::char_traits<char>::length( op );
+			if( text.compare( pos, length, op ) != 0 ) {
+				return false;
+			}
+			for( auto other = others; *other != 0; ++other ) {
+				if( pos + length < text.size( ) && text[pos + length] == *other ) {
+					return false;
+				}
+			}
+			pos += length;
+			return true;
+		}
+
+		bool fail( std::string message ) {
+			if( error.empty( ) ) {
+				error = message + " at position " + std::to_string( pos );
+			}
+			return false;
+		}
+
+		void emit( code_t c, int64_t value = 0 ) {
+			code.push_back( condition_t::instruction_t{ c, value } );
+			switch( c ) {
+			case code_t::constant:
+			case code_t::reg:
+			case code_t::depth:
+			case code_t::hits:
+				if( ++depth > max_depth ) {
+					max_depth = depth;
+				}
+				break;
+			case code_t::mem:
+			case code_t::negate:
+			case code_t::logical_not:
+			case code_t::bit_not:
+				break;
+			default:
+				--depth;
+				break;
+			}
+		}
+
+		bool primary( ) {
+			skip_space( );
+			if( accept( "(" ) ) {
+				if( !expression( ) ) {
+					return false;
+				}
+				return accept( ")" ) || fail( "Expected )" );
+			}
+			if( pos < text.size( ) && std::isdigit( static_cast<unsigned char>(text[pos]) ) ) {
+				auto const is_hex = text.compare( pos, 2, "0x" ) == 0;
+				char * last = nullptr;
+				auto const value = std::strtoll( text.c_str( ) + pos, &last, is_hex ? 16 : 10 );
+				pos = static_cast<size_t>(last - text.c_str( ));
+				emit( code_t::constant, value );
+				return true;
+			}
+			auto const first = pos;
+			while( pos < text.size( ) && std::isalnum( static_cast<unsigned char>(text[pos]) ) ) {
+				++pos;
+			}
+			auto const name = text.substr( first, pos - first );
+			if( name.size( ) == 2 && name[0] == 'r' && name[1] >= '0' && name[1] <= '7' ) {
+				emit( code_t::reg, name[1] - '0' );
+				return true;
+			} else if( name == "depth" ) {
+				emit( code_t::depth );
+				return true;
+			} else if( name == "hits" ) {
+				emit( code_t::hits );
+				return true;
+			} else if( name == "mem" ) {
+				if( !accept( "[" ) ) {
+					return fail( "Expected [" );
+				}
+				if( !expression( ) ) {
+					return false;
+				}
+				emit( code_t::mem );
+				return accept( "]" ) || fail( "Expected ]" );
+			}
+			pos = first;
+			return fail( name.empty( ) ? "Expected an operand" : "Unknown name '" + name + "'" );
+		}
+
+		bool unary( ) {
+			if( accept( "-" ) ) {
+				return unary( ) && (emit( code_t::negate ), true);
+			} else if( accept( "!", "=" ) ) {
+				return unary( ) && (emit( code_t::logical_not ), true);
+			} else if( accept( "~" ) ) {
+				return unary( ) && (emit( code_t::bit_not ), true);
+			}
+			return primary( );
+		}
+
+		struct binary_op_t {
+			char const * op;
+			char const * others;
+			code_t code;
+		};	// struct binary_op_t
+
+		// Left associative operators of one level, operands parsed by next
+		template<size_t N>
+		bool binary( binary_op_t const ( &ops )[N], bool( compiler_t::*next )( ) ) {
+			if( !(this->*next)( ) ) {
+				return false;
+			}
+			while( true ) {
+				auto found = false;
+				for( auto const & op : ops ) {
+					if( accept( op.op, op.others ) ) {
+						if( !(this->*next)( ) ) {
+							return false;
+						}
+						emit( op.code );
+						found = true;
+						break;
+					}
+				}
+				if( !found ) {
+					return true;
+				}
+			}
+		}
+
+		bool multiplicative( ) {
+			static binary_op_t const ops[] = { { "*", "", code_t::multiply }, { "/", "", code_t::divide }, { "%", "", code_t::modulo } };
+			return binary( ops, &compiler_t::unary );
+		}
+
+		bool additive( ) {
+			static binary_op_t const ops[] = { { "+", "", code_t::add }, { "-", "", code_t::subtract } };
+			return binary( ops, &compiler_t::multiplicative );
+		}
+
+		bool relational( ) {
+			static binary_op_t const ops[] = { { "<=", "", code_t::less_equal }, { ">=", "", code_t::greater_equal }, { "<", "", code_t::less }, { ">", "", code_t::greater } };
+			return binary( ops, &compiler_t::additive );
+		}
+
+		bool equality( ) {
+			static binary_op_t const ops[] = { { "==", "", code_t::equal }, { "!=", "", code_t::not_equal } };
+			return binary( ops, &compiler_t::relational );
+		}
+
+		bool bit_and( ) {
+			static binary_op_t const ops[] = { { "&", "&", code_t::bit_and } };
+			return binary( ops, &compiler_t::equality );
+		}
+
+		bool bit_xor( ) {
+			static binary_op_t const ops[] = { { "^", "", code_t::bit_xor } };
+			return binary( ops, &compiler_t::bit_and );
+		}
+
+		bool bit_or( ) {
+			static binary_op_t const ops[] = { { "|", "|", code_t::bit_or } };
+			return binary( ops, &compiler_t::bit_xor );
+		}
+
+		bool logical_and( ) {
+			static binary_op_t const ops[] = { { "&&", "", code_t::logical_and } };
+			return binary( ops, &compiler_t::bit_or );
+		}
+
+		bool expression( ) {
+			static binary_op_t const ops[] = { { "||", "", code_t::logical_or } };
+			return binary( ops, &compiler_t::logical_and );
+		}
+	};	// struct compiler_t
+
+	// Dividing by zero, or INT64_MIN by -1, is undefined so both evaluate to 0
+	bool is_undefined_division( int64_t a, int64_t b ) {
+		return b == 0 || (b == -1 && a == std::numeric_limits<int64_t>::min( ));
+	}
+
+	// Signed overflow is undefined, so negation, + - and * wrap around in uint64_t instead
+	int64_t wrapped( uint64_t value ) {
+		return static_cast<int64_t>(value);
+	}
+}	// namespace anonymous
+
+bool condition_t::compile( std::string const & text, condition_t & result, std::string & error ) {
+	compiler_t compiler( text );
+	if( !compiler.expression( ) ) {
+		error = compiler.error;
+		return false;
+	}
+	compiler.skip_space( );
+	if( compiler.pos != text.size( ) ) {
+		compiler.fail( "Unexpected '" + text.substr( compiler.pos, 1 ) + "'" );
+		error = compiler.error;
+		return false;
+	}
+	if( compiler.max_depth > MAX_DEPTH ) {
+		error = "Expression too deep";
+		return false;
+	}
+	result.m_code = std::move( compiler.code );
+	result.m_text = text;
+	return true;
+}
+
+int64_t condition_t::evaluate( virtual_machine_t const & vm, uint64_t hits ) const {
+	std::array<int64_t, MAX_DEPTH> stack;
+	size_t top = 0;
+	auto const binary = [&]( auto f ) {
+		--top;
+		stack[top - 1] = f( stack[top - 1], stack[top] );
+	};
+	for( auto const & inst : m_code ) {
+		switch( inst.code ) {
+		case code_t::constant:
+			stack[top++] = inst.value;
+			break;
+		case code_t::reg:
+			stack[top++] = vm.registers[static_cast<size_t>(inst.value)];
+			break;
+		case code_t::mem:
+			stack[top - 1] = vm.memory[static_cast<size_t>(stack[top - 1]) % vm.memory.size( )];
+			break;
+		case code_t::depth:
+			stack[top++] = static_cast<int64_t>(vm.program_stack.size( ));
+			break;
+		case code_t::hits:
+			stack[top++] = static_cast<int64_t>(hits);
+			break;
+		case code_t::negate:
+			stack[top - 1] = wrapped( 0u - static_cast<uint64_t>(stack[top - 1]) );
+			break;
+		case code_t::logical_not:
+			stack[top - 1] = stack[top - 1] == 0;
+			break;
+		case code_t::bit_not:
+			stack[top - 1] = ~stack[top - 1];
+			break;
+		case code_t::add:
+			binary( []( int64_t a, int64_t b ) { return wrapped( static_cast<uint64_t>(a) + static_cast<uint64_t>(b) ); } );
+			break;
+		case code_t::subtract:
+			binary( []( int64_t a, int64_t b ) { return wrapped( static_cast<uint64_t>(a) - static_cast<uint64_t>(b) ); } );
+			break;
+		case code_t::multiply:
+			binary( []( int64_t a, int64_t b ) { return wrapped( static_cast<uint64_t>(a) * static_cast<uint64_t>(b) ); } );
+			break;
+		case code_t::divide:
+			binary( []( int64_t a, int64_t b ) { return is_undefined_division( a, b ) ? 0 : a / b; } );
+			break;
+		case code_t::modulo:
+			binary( []( int64_t a, int64_t b ) { return is_undefined_division( a, b ) ? 0 : a % b; } );
+			break;
+		case code_t::bit_and:
+			binary( []( int64_t a, int64_t b ) { return a & b; } );
+			break;
+		case code_t::bit_or:
+			binary( []( int64_t a, int64_t b ) { return a | b; } );
+			break;
+		case code_t::bit_xor:
+			binary( []( int64_t a, int64_t b ) { return a ^ b; } );
+			break;
+		case code_t::equal:
+			binary( []( int64_t a, int64_t b ) -> int64_t { return a == b; } );
+			break;
+		case code_t::not_equal:
+			binary( []( int64_t a, int64_t b ) -> int64_t { return a != b; } );
+			break;
+		case code_t::less:
+			binary( []( int64_t a, int64_t b ) -> int64_t { return a < b; } );
+			break;
+		case code_t::less_equal:
+			binary( []( int64_t a, int64_t b ) -> int64_t { return a <= b; } );
+			break;
+		case code_t::greater:
+			binary( []( int64_t a, int64_t b ) -> int64_t { return a > b; } );
+			break;
+		case code_t::greater_equal:
+			binary( []( int64_t a, int64_t b ) -> int64_t { return a >= b; } );
+			break;
+		case code_t::logical_and:
+			binary( []( int64_t a, int64_t b ) -> int64_t { return a != 0 && b != 0; } );
+			break;
+		case code_t::logical_or:
+			binary( []( int64_t a, int64_t b ) -> int64_t { return a != 0 || b != 0; } );
+			break;
+		}
+	}
+	return stack[0];
+}
@@ -0,0 +1,67 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct virtual_machine_t;
+
+// Expression over the state of a vm, compiled once to postfix code so that checking it is a
+// loop over a few instructions with a fixed size stack.
+// Operators, lowest precedence first: ||  &&  |  ^  &  == !=  < <= > >=  + -  * / %  unary - ! ~
+// Operands: numbers, decimal or 0x hex, r0-r7, mem[expr], depth (of the program stack),
+// hits (times the breakpoint was reached, this one included) and ( expr )
+struct condition_t final {
+	static size_t const MAX_DEPTH = 32;
+
+	// false with a message in error when text is not a valid expression
+	static bool compile( std::string const & text, condition_t & result, std::string & error );
+
+	int64_t evaluate( virtual_machine_t const & vm, uint64_t hits ) const;
+
+	std::string const & text( ) const {
+		return m_text;
+	}
+
+	enum class code_t : uint8_t {
+		constant, reg, mem, depth, hits,
+		negate, logical_not, bit_not,
+		add, subtract, multiply, divide, modulo,
+		bit_and, bit_or, bit_xor,
+		equal, not_equal, less, less_equal, greater, greater_equal,
+		logical_and, logical_or
+	};
+
+	struct instruction_t {
+		code_t code;
+		int64_t value;	// for constant and reg
+	};	// struct instruction_t
+private:
+	std::vector<instruction_t> m_code;
+	std::string m_text;
+};	// struct condition_t
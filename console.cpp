@@ -41,10 +41,10 @@ std::vector<uint16_t> calc_range( virtual_machine_t const & vm, std::string line
 	return result;
 }
 
-template<typename...T>
 
 
 void console( virtual_machine_t & vm ) {
+	vm.output.flush( );
 
 	parse_action_t const parse_action( { 
 		make_action( 
@@ -123,7 +123,7 @@ void console( virtual_machine_t & vm ) {
 		make_action(
 			"setbp",
 			true,
-			"<address> -> set breakpoint at <address>",
+			"<address> [if <condition>] -> set breakpoint at <address>, breaking only when <condition> over r0-r7, mem[address], depth and hits is not 0 if specified",
 			[&vm]( auto tokens ) { vm_control::set_bp( vm, tokens ); return true; } ),
 		make_action(
 			"clearbp",
@@ -167,11 +167,80 @@ void console( virtual_machine_t & vm ) {
 				}
 				return true;
 			} ),
+		make_action(
+			"savecstate",
+			true,
+			"[filename] -> save the state of program compressed to [filename] or sc_<time since epoch>_state.sc if not specified",
+			[&vm]( auto tokens ) {
+				if( tokens.empty( ) || tokens[0].empty( ) ) {
+					vm_control::save_compressed_state( vm, generate_unique_file_name( "sc_", "_state", "sc" ) );
+				} else {
+					vm_control::save_compressed_state( vm, tokens[0] );
+				}
+				return true;
+			} ),
+		make_action(
+			"savedelta",
+			true,
+			"[filename] -> save the pages changed since the last saved or loaded state to [filename] or sc_<time since epoch>_delta.bin if not specified",
+			[&vm]( auto tokens ) {
+				if( tokens.empty( ) || tokens[0].empty( ) ) {
+					vm_control::save_delta( vm, generate_unique_file_name( "sc_", "_delta", "bin" ) );
+				} else {
+					vm_control::save_delta( vm, tokens[0] );
+				}
+				return true;
+			} ),
+		make_action(
+			"compactstate",
+			true,
+			"<from> <to> -> write the state a chain of deltas ending in <from> builds as a full state to <to>",
+			[]( auto tokens ) { vm_control::compact_state( tokens ); return true; } ),
 		make_action(
 			"loadstate",
 			false,
 			"<filename> -> load the state of program from <filename>",
 			[&vm]( auto tokens ) { vm_control::load_state( vm, tokens[0] ); return true; } ),
+		make_action(
+			"snapshot",
+			true,
+			"<name> -> keep the state of program in memory as <name>",
+			[&vm]( auto tokens ) { vm_control::take_snapshot( vm, tokens ); return true; } ),
+		make_action(
+			"restore",
+			true,
+			"<name> -> restore the state of program kept as <name>",
+			[&vm]( auto tokens ) { vm_control::restore_snapshot( vm, tokens ); return true; } ),
+		make_action(
+			"dropsnapshot",
+			true,
+			"<name> -> forget the state of program kept as <name>",
+			[&vm]( auto tokens ) { vm_control::drop_snapshot( vm, tokens ); return true; } ),
+		make_action(
+			"snapshots",
+			true,
+			"display the names of all kept states",
+			[&vm]( auto ) { vm_control::show_snapshots( vm ); return true; } ),
+		make_action(
+			"setwatch",
+			true,
+			"<address> [kinds] -> break after an instruction reads (r), writes (w) or changes (c) memory or register (32768-32775) <address>, any of [kinds] or w if not specified",
+			[&vm]( auto tokens ) { vm_control::set_watch( vm, tokens ); return true; } ),
+		make_action(
+			"clearwatch",
+			true,
+			"<address> -> clear watchpoint on <address>",
+			[&vm]( auto tokens ) { vm_control::clear_watch( vm, tokens ); return true; } ),
+		make_action(
+			"getwatches",
+			true,
+			"display all watchpoints",
+			[&vm]( auto ) { vm_control::get_watches( vm ); return true; } ),
+		make_action(
+			"clearwatches",
+			true,
+			"clear all watchpoints",
+			[&vm]( auto ) { vm_control::clear_watches( vm ); return true; } ),
 		make_action(
 			"showargstack",
 			true,
@@ -195,15 +264,80 @@ void console( virtual_machine_t & vm ) {
 		make_action(
 			"savetrace",
 			true,
-			"[filename] -> save previous trace to [filename]/[filenaem].state or sc_<time since epoch>_trace.json/sc_<time since epoch>_trace.json.state if not specified",
+			"[filename] -> save previous trace as json to [filename] with its starting state in [filename].state and records in [filename].trace, or sc_<time since epoch>_trace.json if not specified",
 			[&vm]( auto tokens ) { 
 				if( tokens.empty( ) ) {
 					vm_control::save_trace( vm, generate_unique_file_name( "sc_", "_trace", "json" ) );
 				} else {
-					vm_control::save_trace( vm, tokens[0].substr( 10 ) );
+					vm_control::save_trace( vm, tokens[0] );
 				}			
 				return true; 
 			} ),			
+		make_action(
+			"indextrace",
+			true,
+			"<filename> -> index the trace saved by savetrace as <filename> into <filename>.idx",
+			[]( auto tokens ) { vm_control::index_trace( tokens ); return true; } ),
+		make_action(
+			"opentrace",
+			true,
+			"<filename> -> open the trace saved as <filename> and its index for queries",
+			[&vm]( auto tokens ) { vm_control::open_trace( vm, tokens ); return true; } ),
+		make_action(
+			"lastwrite",
+			true,
+			"<address> <step> -> display the last step of the open trace before <step> writing to <address>",
+			[&vm]( auto tokens ) { vm_control::last_write( vm, tokens ); return true; } ),
+		make_action(
+			"executions",
+			true,
+			"<ip> [step] -> display the steps of the open trace executing <ip>, from [step] or 0 if not specified",
+			[&vm]( auto tokens ) { vm_control::show_executions( vm, tokens ); return true; } ),
+		make_action(
+			"stateat",
+			true,
+			"<step> [filename] -> restore the state before <step> of the open trace, or save it to [filename] if specified",
+			[&vm]( auto tokens ) { vm_control::state_at( vm, tokens ); return true; } ),
+		make_action(
+			"starthistory",
+			true,
+			"start keeping the steps executed from here on so that they can be stepped back through",
+			[&vm]( auto ) { vm_control::start_history( vm ); return true; } ),
+		make_action(
+			"stophistory",
+			true,
+			"stop keeping executed steps and forget those kept",
+			[&vm]( auto ) { vm_control::stop_history( vm ); return true; } ),
+		make_action(
+			"showhistory",
+			true,
+			"display the current step and the range of kept steps",
+			[&vm]( auto ) { vm_control::show_history( vm ); return true; } ),
+		make_action(
+			"rstep",
+			true,
+			"[count] -> undo the last [count] steps or 1 if not specified",
+			[&vm]( auto tokens ) { vm_control::step_back( vm, tokens ); return true; } ),
+		make_action(
+			"rcontinue",
+			true,
+			"step back to the previous breakpoint, memory trap or watched write, or the first kept step",
+			[&vm]( auto ) { vm_control::reverse_continue( vm ); return true; } ),
+		make_action(
+			"goto",
+			true,
+			"<step> -> move backwards or forwards to the state before kept <step>",
+			[&vm]( auto tokens ) { vm_control::go_to( vm, tokens ); return true; } ),
+		make_action(
+			"profile",
+			true,
+			"start|stop|report [count]|flame <filename> -> count executions per address, opcode, opcode pair and function, display the [count] hottest of them or 20 if not specified, or write the calls as collapsed stacks for flame graphs to <filename>",
+			[&vm]( auto tokens ) { vm_control::profile( vm, tokens ); return true; } ),
+		make_action(
+			"backtrace",
+			true,
+			"[count] -> display the innermost [count] calls, or 20 if not specified, followed while profiling",
+			[&vm]( auto tokens ) { vm_control::backtrace( vm, tokens ); return true; } ),
 		make_action(
 			"go",
 			true,
@@ -0,0 +1,195 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include "decode_cache.h"
+#include "vm.h"
+
+namespace {
+	decode_cache_t::entry_t const empty_entry = { decode_cache_t::EMPTY, 0, { 0, 0, 0 } };
+}
+
+decode_cache_t::decode_cache_t( ):
+	m_entries( std::numeric_limits<uint16_t>::max( ) + 1, empty_entry ),
+	m_dispatch_ops( std::numeric_limits<uint16_t>::max( ) + 1, EMPTY ),
+	m_fused_lengths( std::numeric_limits<uint16_t>::max( ) + 1, 0 ),
+	m_fused_words( virtual_machine_t::MODULO, false ),
+	m_watched( virtual_machine_t::MODULO, false ),
+	m_modified( ),
+	m_generation( 0 ),
+	m_guarded( virtual_machine_t::MODULO, false ),
+	m_guard_generation( 0 ),
+	m_dirty_pages( 0 ) { }
+
+decode_cache_t::entry_t const * decode_cache_t::decode( mapped_memory_t const & memory, uint16_t address ) {
+	auto const * entry = decode_instruction( memory, address );
+	if( entry != nullptr ) {
+		fuse( memory, address );
+	}
+	return entry;
+}
+
+decode_cache_t::entry_t const * decode_cache_t::decode_instruction( mapped_memory_t const & memory, uint16_t address ) {
+	if( address >= memory.size( ) ) {
+		return nullptr;
+	}
+	auto & entry = m_entries[address];
+	auto const op_code = memory[address];
+	if( !instructions::is_instruction( op_code ) ) {
+		return nullptr;
+	}
+	auto const arg_count = instructions::decoder( )[op_code].arg_count;
+	if( address + arg_count >= memory.size( ) ) {
+		return nullptr;
+	}
+	entry_t result = empty_entry;
+	for( size_t n = 0; n < arg_count; ++n ) {
+		auto const arg = memory[address + 1 + n];
+		if( arg >= virtual_machine_t::REGISTER0 + 8 ) {
+			return nullptr;
+		}
+		result.args[n] = arg;
+	}
+	result.length = static_cast<uint8_t>(1 + arg_count);
+	result.op_code = static_cast<uint8_t>(op_code);
+	entry = result;
+	m_dispatch_ops[address] = result.op_code;
+	return &entry;
+}
+
+namespace {
+	uint8_t fused_pair( uint8_t first, uint8_t second ) {
+#define SC_FUSED_CASE( a, b ) \
+		if( first == decode_cache_t::op_##a && second == decode_cache_t::op_##b ) { \
+			return decode_cache_t::super_##a##_##b; \
+		}
+		SC_FUSED_PAIRS( SC_FUSED_CASE )
+#undef SC_FUSED_CASE
+		return decode_cache_t::EMPTY;
+	}
+}
+
+void decode_cache_t::fuse( mapped_memory_t const & memory, uint16_t address ) {
+	auto const & head = m_entries[address];
+	size_t next = address + head.length;
+	uint8_t super_op = EMPTY;
+	if( head.op_code == op_out && head.args[0] < virtual_machine_t::REGISTER0 ) {
+		// The characters are read straight from memory when the run is executed
+		size_t count = 1;
+		while( count < MAX_OUT_RUN && next + 1 < memory.size( ) && memory[next] == op_out && memory[next + 1] < virtual_machine_t::REGISTER0 ) {
+			++count;
+			next += 2;
+		}
+		if( count > 1 ) {
+			super_op = super_out_run;
+		}
+	} else if( next < memory.size( ) ) {
+		// Only look ahead one instruction, the second is not fused with what follows it here
+		auto const * second = m_entries[next].op_code != EMPTY ? &m_entries[next] : decode_instruction( memory, static_cast<uint16_t>(next) );
+		if( second != nullptr ) {
+			super_op = fused_pair( head.op_code, second->op_code );
+			next += second->length;
+		}
+	}
+	if( super_op == EMPTY ) {
+		return;
+	}
+	m_dispatch_ops[address] = super_op;
+	m_fused_lengths[address] = static_cast<uint8_t>(next - address);
+	for( size_t n = address; n < next; ++n ) {
+		m_fused_words[n] = true;
+	}
+}
+
+void decode_cache_t::unfuse( uint16_t address ) {
+	// Fall back to the first instruction of any superinstruction covering address
+	size_t const max_length = 2 * MAX_OUT_RUN;
+	auto const first = address >= max_length - 1 ? address - (max_length - 1) : 0;
+	for( size_t n = first; n <= address; ++n ) {
+		if( m_dispatch_ops[n] >= op_code_count && m_dispatch_ops[n] != EMPTY && n + m_fused_lengths[n] > address ) {
+			m_dispatch_ops[n] = m_entries[n].op_code;
+		}
+	}
+}
+
+void decode_cache_t::invalidate( uint16_t address ) {
+	assert( address < virtual_machine_t::MODULO );
+	m_dirty_pages |= uint64_t( 1 ) << (address >> PAGE_SHIFT);
+	// An instruction is at most 4 words so only the 4 slots ending at address can cover it
+	auto const first = address >= 3 ? address - 3 : 0;
+	for( size_t n = first; n <= address; ++n ) {
+		auto & entry = m_entries[n];
+		if( entry.op_code != EMPTY && n + entry.length > address ) {
+			entry.op_code = EMPTY;
+			m_dispatch_ops[n] = EMPTY;
+			if( m_watched[n] ) {
+				m_watched[n] = false;
+				m_modified.push_back( static_cast<uint16_t>(n) );
+			}
+		}
+	}
+	if( m_fused_words[address] ) {
+		unfuse( address );
+	}
+	if( m_guarded[address] ) {
+		++m_guard_generation;
+	}
+}
+
+void decode_cache_t::clear( ) {
+	std::fill( m_entries.begin( ), m_entries.end( ), empty_entry );
+	std::fill( m_dispatch_ops.begin( ), m_dispatch_ops.end( ), EMPTY );
+	std::fill( m_fused_words.begin( ), m_fused_words.end( ), false );
+	std::fill( m_watched.begin( ), m_watched.end( ), false );
+	m_modified.clear( );
+	++m_generation;
+}
+
+void decode_cache_t::watch( uint16_t address ) {
+	assert( address < m_watched.size( ) && m_entries[address].op_code != EMPTY );
+	m_watched[address] = true;
+}
+
+uint64_t decode_cache_t::take_dirty_pages( ) {
+	auto const result = m_dirty_pages;
+	m_dirty_pages = 0;
+	return result;
+}
+
+void decode_cache_t::guard( uint16_t address ) {
+	assert( address < m_guarded.size( ) );
+	m_guarded[address] = true;
+}
+
+void decode_cache_t::clear_guards( ) {
+	std::fill( m_guarded.begin( ), m_guarded.end( ), false );
+	++m_guard_generation;
+}
+
+std::vector<uint16_t> decode_cache_t::take_modified( ) {
+	std::vector<uint16_t> result;
+	result.swap( m_modified );
+	return result;
+}
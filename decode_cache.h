@@ -0,0 +1,177 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <vector>
+#include "mapped_memory.h"
+#include "memory_helper.h"
+
+// Adjacent instruction pairs the threaded engine runs as one superinstruction.  Picked from 
+// the opcode pair histograms of replaying actions.txt(adventure) and of the teleporter 
+// confirmation with R7 set(ackermann), each is at least 2.5% of the instructions run by one
+// of them.  EQ/GT followed by JT/JF are fused as a family
+#define SC_FUSED_PAIRS( X ) \
+	X( push, push )	/* 6.4% adventure */ \
+	X( pop, pop )	/* 6.4% adventure */ \
+	X( pop, ret )	/* 6.3% adventure */ \
+	X( not, or )	/* 5.7% adventure */ \
+	X( or, and )	/* 5.7% adventure */ \
+	X( and, not )	/* 5.7% adventure */ \
+	X( and, pop )	/* 5.7% adventure */ \
+	X( push, and )	/* 5.7% adventure */ \
+	X( set, call )	/* 3.1% adventure */ \
+	X( wmem, add )	/* 2.8% adventure */ \
+	X( rmem, push )	/* 2.7% adventure */ \
+	X( pop, wmem )	/* 2.7% adventure */ \
+	X( mult, call )	/* 2.7% adventure */ \
+	X( add, eq )	/* 2.7% adventure */ \
+	X( push, mult )	/* 2.7% adventure */ \
+	X( add, call )	/* 15.4% ackermann */ \
+	X( jt, add )	/* 7.7% ackermann */ \
+	X( push, add )	/* 7.7% ackermann */ \
+	X( set, pop )	/* 7.7% ackermann */ \
+	X( add, ret )	/* 7.7% ackermann */ \
+	X( pop, add )	/* 7.7% ackermann */ \
+	X( eq, jf )	/* 2.9% adventure */ \
+	X( eq, jt ) \
+	X( gt, jt ) \
+	X( gt, jf )
+
+// Side table of pre-decoded instructions with one slot per memory address.  Slots are filled 
+// lazily the first time an address is executed and invalidated when any word they were 
+// decoded from is written, so self modifying code is always re-decoded
+struct decode_cache_t final {
+	static uint8_t const EMPTY = std::numeric_limits<uint8_t>::max( );
+
+	enum op_code_t : uint8_t {
+		op_halt, op_set, op_push, op_pop, op_eq, op_gt, op_jmp, op_jt, op_jf, op_add, op_mult, 
+		op_mod, op_and, op_or, op_not, op_rmem, op_wmem, op_call, op_ret, op_out, op_in, op_noop, 
+		op_code_count
+	};
+
+	// What the threaded engine dispatches on in place of an op_code_t.  The entry of a
+	// superinstruction is that of its first instruction, so every other consumer still sees
+	// plain instructions
+	enum super_op_t : uint8_t {
+		super_out_run = op_code_count,	// 2 to MAX_OUT_RUN consecutive OUTs of literals
+#define SC_FUSED_ENUM( a, b ) super_##a##_##b,
+		SC_FUSED_PAIRS( SC_FUSED_ENUM )
+#undef SC_FUSED_ENUM
+		super_op_end
+	};
+	static size_t const MAX_OUT_RUN = 64;
+
+	static constexpr uint8_t length( op_code_t op_code ) {
+		return op_code == op_halt || op_code == op_ret || op_code == op_noop ? 1
+			: op_code == op_push || op_code == op_pop || op_code == op_jmp || op_code == op_call || op_code == op_out || op_code == op_in ? 2
+			: op_code == op_set || op_code == op_jt || op_code == op_jf || op_code == op_not || op_code == op_rmem || op_code == op_wmem ? 3
+			: 4;
+	}
+
+	// Packed into 8 bytes so that a slot is found with a shift
+	struct entry_t {
+		uint8_t op_code;	// index into instructions::decoder( ) or EMPTY
+		uint8_t length;		// words including the opcode, next ip is address + length
+		uint16_t args[3];	// validated raw operands.  Literal below 32768, register otherwise
+	};	// struct entry_t
+
+	decode_cache_t( );
+
+	// Decoded instruction at address or nullptr if memory there is not a valid instruction
+	entry_t const * fetch( mapped_memory_t const & memory, uint16_t address ) {
+		if( m_entries[address].op_code != EMPTY ) {
+			return &m_entries[address];
+		}
+		return decode( memory, address );
+	}
+
+	void invalidate( uint16_t address );
+	void clear( );
+
+	// Consumers that translate decoded instructions further(e.g. the jit) watch the slots 
+	// they used.  Invalidating a watched slot records its address until taken, clear( ) 
+	// bumps generation( ) instead as every slot is gone
+	void watch( uint16_t address );
+	bool has_modified( ) const {
+		return !m_modified.empty( );
+	}
+	std::vector<uint16_t> take_modified( );
+	uint64_t generation( ) const {
+		return m_generation;
+	}
+
+	// Memory is tracked for snapshots in pages of PAGE_WORDS, one bit of the dirty page mask
+	// each.  Every write sets the bit of its page until the mask is taken
+	static unsigned const PAGE_SHIFT = 9;
+	static size_t const PAGE_WORDS = size_t( 1 ) << PAGE_SHIFT;
+	static size_t const PAGE_COUNT = 32768u >> PAGE_SHIFT;
+	uint64_t dirty_pages( ) const {
+		return m_dirty_pages;
+	}
+	uint64_t take_dirty_pages( );
+
+	// Words a consumer depends on without decoding them through the cache(e.g. memoized 
+	// subroutines).  Writing a guarded word bumps guard_generation( ), clear( ) leaves the
+	// guards as they are
+	void guard( uint16_t address );
+	void clear_guards( );
+	uint64_t guard_generation( ) const {
+		return m_guard_generation;
+	}
+
+	// Unchecked slot access for engines that test op_code != EMPTY themselves.  There is a
+	// slot for every uint16_t, those past the end of memory are always EMPTY
+	entry_t const * data( ) const {
+		return m_entries.data( );
+	}
+
+	// op_code_t or super_op_t of each slot, EMPTY where the entry is
+	uint8_t const * dispatch_ops( ) const {
+		return m_dispatch_ops.data( );
+	}
+
+	// Words covered by the superinstruction at address
+	uint8_t fused_length( uint16_t address ) const {
+		return m_fused_lengths[address];
+	}
+private:
+	entry_t const * decode( mapped_memory_t const & memory, uint16_t address );
+	entry_t const * decode_instruction( mapped_memory_t const & memory, uint16_t address );
+	void fuse( mapped_memory_t const & memory, uint16_t address );
+	void unfuse( uint16_t address );
+
+	std::vector<entry_t> m_entries;
+	std::vector<uint8_t> m_dispatch_ops;
+	std::vector<uint8_t> m_fused_lengths;
+	std::vector<bool> m_fused_words;	// covered by some superinstruction, maybe no longer
+	std::vector<bool> m_watched;
+	std::vector<uint16_t> m_modified;
+	uint64_t m_generation;
+	std::vector<bool> m_guarded;
+	uint64_t m_guard_generation;
+	uint64_t m_dirty_pages;
+	static_assert( PAGE_COUNT <= 64, "The dirty page mask has a bit per page" );
+};	// struct decode_cache_t
@@ -0,0 +1,67 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include <boost/utility/string_ref.hpp>
+#include <cstdint>
+#include <iostream>
+#include "engine.h"
+#include "jit_engine.h"
+#include "threaded_engine.h"
+
+engine_t engine_from_string( boost::string_ref name ) {
+	if( name == "tick" ) {
+		return engine_t::tick;
+	} else if( name == "threaded" ) {
+		return engine_t::threaded;
+	} else if( name == "jit" ) {
+		return engine_t::jit;
+	}
+	std::cerr << "Unknown engine '" << name << "'.  Valid engines are tick, threaded and jit" << std::endl;
+	exit( EXIT_FAILURE );
+}
+
+std::string to_string( engine_t engine ) {
+	switch( engine ) {
+	case engine_t::tick: return "tick";
+	case engine_t::threaded: return "threaded";
+	case engine_t::jit: return "jit";
+	}
+	return "unknown";
+}
+
+uint64_t run_engine( virtual_machine_t & vm, engine_t engine, uint64_t max_instructions ) {
+	uint64_t count = 0;
+	while( count < max_instructions ) {
+		if( engine == engine_t::tick || vm.is_instrumented( ) ) {
+			vm.tick( );
+			++count;
+			continue;
+		}
+		if( engine == engine_t::jit ) {
+			count += run_jit( vm, max_instructions - count );
+		} else {
+			count += run_threaded( vm, max_instructions - count );
+		}
+	}
+	return count;
+}
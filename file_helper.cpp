@@ -30,9 +30,9 @@ namespace {
 		using boost::posix_time::ptime;
 		using boost::posix_time::time_from_string;
 		static ptime const epoch = time_from_string( "1970-01-01 00:00:00.000" );
-		ptime other = time_from_string( "2011-08-09 17:27:00.000" );
+		ptime const now = boost::posix_time::microsec_clock::universal_time( );
 
-		return std::to_string( (other - epoch).total_milliseconds( ) );
+		return std::to_string( (now - epoch).total_milliseconds( ) );
 	}
 }
 
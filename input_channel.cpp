@@ -0,0 +1,121 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include "input_channel.h"
+
+input_reader_t stdin_reader( ) {
+	return []( std::string & line ) {
+		if( !std::getline( std::cin, line ) ) {
+			return false;
+		}
+		if( !std::cin.eof( ) ) {
+			line.push_back( '\n' );
+		}
+		return true;
+	};
+}
+
+input_reader_t memory_reader( std::string text ) {
+	auto const state = std::make_shared<std::pair<std::string, size_t>>( std::move( text ), 0 );
+	return [state]( std::string & line ) {
+		auto const & text = state->first;
+		auto & position = state->second;
+		if( position >= text.size( ) ) {
+			return false;
+		}
+		auto end = text.find( '\n', position );
+		end = end == std::string::npos ? text.size( ) : end + 1;
+		line.assign( text, position, end - position );
+		position = end;
+		return true;
+	};
+}
+
+input_reader_t file_reader( std::string const & filename ) {
+	std::ifstream in_file( filename, std::ios::binary );
+	if( !in_file ) {
+		std::cerr << "Could not open input file '" << filename << "'" << std::endl;
+		exit( EXIT_FAILURE );
+	}
+	std::ostringstream text;
+	text << in_file.rdbuf( );
+	return memory_reader( text.str( ) );
+}
+
+input_reader_t command_reader( std::vector<std::string> commands ) {
+	auto const state = std::make_shared<std::pair<std::vector<std::string>, size_t>>( std::move( commands ), 0 );
+	return [state]( std::string & line ) {
+		if( state->second >= state->first.size( ) ) {
+			return false;
+		}
+		line = state->first[state->second++] + '\n';
+		return true;
+	};
+}
+
+input_channel_t::input_channel_t( ):
+	m_readers( ),
+	m_line( ),
+	m_position( 0 ),
+	m_exhausted_policy( exhausted_policy_t::console ) {
+
+	m_readers.push_back( stdin_reader( ) );
+}
+
+int input_channel_t::next_line( ) {
+	m_position = 0;
+	while( !m_readers.empty( ) ) {
+		m_line.clear( );
+		if( !m_readers.front( )( m_line ) ) {
+			m_readers.pop_front( );
+		} else if( !m_line.empty( ) ) {
+			m_position = 1;
+			return static_cast<unsigned char>(m_line[0]);
+		}
+	}
+	m_line.clear( );
+	return -1;
+}
+
+void input_channel_t::set_readers( std::vector<input_reader_t> readers ) {
+	m_readers.assign( readers.begin( ), readers.end( ) );
+	m_line.clear( );
+	m_position = 0;
+}
+
+void input_channel_t::push( input_reader_t reader ) {
+	m_readers.push_back( std::move( reader ) );
+}
+
+void input_channel_t::set_exhausted_policy( exhausted_policy_t policy ) {
+	m_exhausted_policy = policy;
+}
+
+exhausted_policy_t input_channel_t::exhausted_policy( ) const {
+	return m_exhausted_policy;
+}
@@ -0,0 +1,68 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Produces the characters read by IN a line at a time.  Returns false once exhausted
+using input_reader_t = std::function<bool( std::string & line )>;
+
+input_reader_t stdin_reader( );
+input_reader_t memory_reader( std::string text );
+input_reader_t file_reader( std::string const & filename );
+input_reader_t command_reader( std::vector<std::string> commands );
+
+// What IN does once every reader is exhausted
+enum class exhausted_policy_t { console, halt };
+
+// Feeds IN from a queue of readers, moving to the next reader when one runs out.  The
+// default is stdin followed by the debug console, as with a plain getchar( )
+struct input_channel_t final {
+	input_channel_t( );
+
+	// Next character or -1 when every reader is exhausted
+	int get( ) {
+		if( m_position < m_line.size( ) ) {
+			return static_cast<unsigned char>(m_line[m_position++]);
+		}
+		return next_line( );
+	}
+
+	void set_readers( std::vector<input_reader_t> readers );
+	void push( input_reader_t reader );
+
+	void set_exhausted_policy( exhausted_policy_t policy );
+	exhausted_policy_t exhausted_policy( ) const;
+private:
+	int next_line( );
+
+	std::deque<input_reader_t> m_readers;
+	std::string m_line;
+	size_t m_position;
+	exhausted_policy_t m_exhausted_policy;
+};	// struct input_channel_t
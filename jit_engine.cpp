@@ -0,0 +1,921 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <unordered_map>
+#include <vector>
+#include "jit_engine.h"
+#include "threaded_engine.h"
+
+#if defined( __x86_64__ ) && (defined( __linux__ ) || defined( __APPLE__ ))
+#define SC_HAS_JIT
+#include <sys/mman.h>
+#endif
+
+#ifdef SC_HAS_JIT
+namespace {
+	// Register use inside generated code
+	//	r8d-r15d	vm registers 0-7, zero extended to 32 bits
+	//	rbx		vm memory
+	//	rbp		jit_context_t
+	//	rdi		top of the program stack
+	//	rax, rcx, rdx, rsi are scratch
+	enum reg_t : uint8_t { RAX = 0, RCX = 1, RDX = 2, RBX = 3, RSP = 4, RBP = 5, RSI = 6, RDI = 7, R8 = 8, R9, R10, R11, R12, R13, R14, R15 };
+
+	// Condition codes for jcc/setcc
+	enum cc_t : uint8_t { CC_B = 0x2, CC_AE = 0x3, CC_E = 0x4, CC_NE = 0x5, CC_A = 0x7 };
+
+	// Group 1 /digit for the 0x81 immediate forms and matching r/m, reg opcodes
+	enum alu_t : uint8_t { ALU_ADD = 0, ALU_OR = 1, ALU_AND = 4, ALU_SUB = 5, ALU_XOR = 6, ALU_CMP = 7 };
+	uint8_t const alu_rr_opcode[] = { 0x01, 0x09, 0, 0, 0x21, 0x29, 0x31, 0x39 };
+
+	uint16_t const REGISTER0 = virtual_machine_t::REGISTER0;
+	uint16_t const MODULO = virtual_machine_t::MODULO;
+	uint32_t const VALUE_MASK = virtual_machine_t::MODULO - 1;
+
+	bool is_register( uint16_t raw ) {
+		return raw >= REGISTER0;
+	}
+
+	uint8_t host_reg( uint16_t raw ) {
+		assert( virtual_machine_t::is_register( raw ) );
+		return static_cast<uint8_t>(R8 + (raw - REGISTER0));
+	}
+
+	// State shared by run_jit and generated code, which addresses it off rbp
+	struct jit_context_t {
+		uint64_t remaining;	// instruction budget
+		uint16_t * stack_base;
+		uint16_t * stack_top;
+		uint16_t * stack_limit;
+		uint16_t * registers;
+		uint16_t * memory;
+		void * const * natives;	// native entry point for each address or nullptr
+		virtual_machine_t * vm;
+	};	// struct jit_context_t
+
+#define SC_CTX( member ) static_cast<int8_t>(offsetof( jit_context_t, member ))
+
+	using enter_t = uint32_t( * )( jit_context_t *, void * );
+
+	// Called from generated code for WMEM.  Returns non-zero when the write modified
+	// compiled code so the block must exit
+	uint32_t jit_write_memory( jit_context_t * context, uint32_t address, uint32_t value ) {
+		context->vm->set_memory( static_cast<uint16_t>(address), static_cast<uint16_t>(value) );
+		return context->vm->decode_cache.has_modified( ) ? 1 : 0;
+	}
+
+	// Just enough of an x86-64 assembler for the code below.  All 32 bit operations zero
+	// the upper half of the destination, which the vm register mapping relies on
+	class emitter_t {
+		uint8_t * m_code;
+		size_t m_pos;
+	public:
+		emitter_t( uint8_t * code ): m_code( code ), m_pos( 0 ) { }
+
+		size_t position( ) const {
+			return m_pos;
+		}
+
+		void set_position( size_t pos ) {
+			m_pos = pos;
+		}
+
+		void byte( uint32_t b ) {
+			m_code[m_pos++] = static_cast<uint8_t>(b);
+		}
+
+		void dword( uint32_t d ) {
+			std::memcpy( m_code + m_pos, &d, sizeof( d ) );
+			m_pos += sizeof( d );
+		}
+
+		void qword( uint64_t q ) {
+			std::memcpy( m_code + m_pos, &q, sizeof( q ) );
+			m_pos += sizeof( q );
+		}
+
+		void rex( bool w, uint8_t reg, uint8_t index, uint8_t rm ) {
+			uint8_t const prefix = static_cast<uint8_t>(0x40 | (w ? 8 : 0) | ((reg & 8) ? 4 : 0) | ((index & 8) ? 2 : 0) | ((rm & 8) ? 1 : 0));
+			if( prefix != 0x40 ) {
+				byte( prefix );
+			}
+		}
+
+		void modrm( uint8_t mod, uint8_t reg, uint8_t rm ) {
+			byte( (mod << 6) | ((reg & 7) << 3) | (rm & 7) );
+		}
+
+		void sib( uint8_t scale, uint8_t index, uint8_t base ) {
+			byte( (scale << 6) | ((index & 7) << 3) | (base & 7) );
+		}
+
+		// op rm, reg
+		void rr( uint8_t opcode, uint8_t rm, uint8_t reg, bool w = false ) {
+			rex( w, reg, 0, rm );
+			byte( opcode );
+			modrm( 3, reg, rm );
+		}
+
+		// op reg, [base + disp8] or op [base + disp8], reg.  base cannot be rsp or r12
+		void rm_disp8( uint8_t opcode, uint8_t reg, uint8_t base, int8_t disp, bool w ) {
+			rex( w, reg, 0, base );
+			byte( opcode );
+			modrm( 1, reg, base );
+			byte( static_cast<uint8_t>(disp) );
+		}
+
+		void mov_ri( uint8_t dst, uint32_t imm ) {
+			rex( false, 0, 0, dst );
+			byte( 0xB8 + (dst & 7) );
+			dword( imm );
+		}
+
+		void mov_rr( uint8_t dst, uint8_t src ) {
+			rr( 0x89, dst, src );
+		}
+
+		void alu_rr( alu_t op, uint8_t dst, uint8_t src ) {
+			rr( alu_rr_opcode[op], dst, src );
+		}
+
+		void alu_ri( alu_t op, uint8_t dst, uint32_t imm ) {
+			rex( false, 0, 0, dst );
+			byte( 0x81 );
+			modrm( 3, op, dst );
+			dword( imm );
+		}
+
+		void test_rr( uint8_t a, uint8_t b ) {
+			rr( 0x85, a, b );
+		}
+
+		void imul_rr( uint8_t dst, uint8_t src ) {
+			rex( false, dst, 0, src );
+			byte( 0x0F );
+			byte( 0xAF );
+			modrm( 3, dst, src );
+		}
+
+		void div_r( uint8_t src ) {
+			rex( false, 0, 0, src );
+			byte( 0xF7 );
+			modrm( 3, 6, src );
+		}
+
+		// eax = cc ? 1 : 0
+		void setcc_eax( cc_t cc ) {
+			byte( 0x0F );
+			byte( 0x90 | cc );
+			modrm( 3, 0, RAX );
+			byte( 0x0F );
+			byte( 0xB6 );
+			modrm( 3, RAX, RAX );
+		}
+
+		// movzx dst, word [base + disp8]
+		void load16( uint8_t dst, uint8_t base, int8_t disp ) {
+			rex( false, dst, 0, base );
+			byte( 0x0F );
+			byte( 0xB7 );
+			modrm( 1, dst, base );
+			byte( static_cast<uint8_t>(disp) );
+		}
+
+		// movzx dst, word [base + disp32]
+		void load16_disp32( uint8_t dst, uint8_t base, uint32_t disp ) {
+			rex( false, dst, 0, base );
+			byte( 0x0F );
+			byte( 0xB7 );
+			modrm( 2, dst, base );
+			dword( disp );
+		}
+
+		// movzx dst, word [base + index*2].  base cannot be rbp or r13
+		void load16_indexed( uint8_t dst, uint8_t base, uint8_t index ) {
+			rex( false, dst, index, base );
+			byte( 0x0F );
+			byte( 0xB7 );
+			modrm( 0, dst, RSP );
+			sib( 1, index, base );
+		}
+
+		// mov word [base + disp8], src
+		void store16( uint8_t base, int8_t disp, uint8_t src ) {
+			byte( 0x66 );
+			rm_disp8( 0x89, src, base, disp, false );
+		}
+
+		// mov dst, qword [base + index*8].  base cannot be rbp or r13
+		void load64_indexed( uint8_t dst, uint8_t base, uint8_t index ) {
+			rex( true, dst, index, base );
+			byte( 0x8B );
+			modrm( 0, dst, RSP );
+			sib( 3, index, base );
+		}
+
+		void load64( uint8_t dst, uint8_t base, int8_t disp ) {
+			rm_disp8( 0x8B, dst, base, disp, true );
+		}
+
+		void store64( uint8_t base, int8_t disp, uint8_t src ) {
+			rm_disp8( 0x89, src, base, disp, true );
+		}
+
+		// cmp reg, qword [base + disp8]
+		void cmp64( uint8_t reg, uint8_t base, int8_t disp ) {
+			rm_disp8( 0x3B, reg, base, disp, true );
+		}
+
+		// op qword [base + disp8], imm32
+		void alu64_mi( alu_t op, uint8_t base, int8_t disp, uint32_t imm ) {
+			rex( true, 0, 0, base );
+			byte( 0x81 );
+			modrm( 1, op, base );
+			byte( static_cast<uint8_t>(disp) );
+			dword( imm );
+		}
+
+		// op reg64, imm8
+		void alu64_ri8( alu_t op, uint8_t dst, int8_t imm ) {
+			rex( true, 0, 0, dst );
+			byte( 0x83 );
+			modrm( 3, op, dst );
+			byte( static_cast<uint8_t>(imm) );
+		}
+
+		void mov64_rr( uint8_t dst, uint8_t src ) {
+			rr( 0x89, dst, src, true );
+		}
+
+		void mov64_ri( uint8_t dst, uint64_t imm ) {
+			rex( true, 0, 0, dst );
+			byte( 0xB8 + (dst & 7) );
+			qword( imm );
+		}
+
+		void push( uint8_t reg ) {
+			rex( false, 0, 0, reg );
+			byte( 0x50 + (reg & 7) );
+		}
+
+		void pop( uint8_t reg ) {
+			rex( false, 0, 0, reg );
+			byte( 0x58 + (reg & 7) );
+		}
+
+		void call_r( uint8_t reg ) {
+			rex( false, 0, 0, reg );
+			byte( 0xFF );
+			modrm( 3, 2, reg );
+		}
+
+		void jmp_r( uint8_t reg ) {
+			rex( false, 0, 0, reg );
+			byte( 0xFF );
+			modrm( 3, 4, reg );
+		}
+
+		void ret( ) {
+			byte( 0xC3 );
+		}
+
+		// Branches return the position of their rel32 for patch( )
+		size_t jmp( ) {
+			byte( 0xE9 );
+			dword( 0 );
+			return m_pos - 4;
+		}
+
+		size_t jcc( cc_t cc ) {
+			byte( 0x0F );
+			byte( 0x80 | cc );
+			dword( 0 );
+			return m_pos - 4;
+		}
+
+		void patch( size_t rel32, size_t target ) {
+			auto const rel = static_cast<int32_t>(static_cast<int64_t>(target) - static_cast<int64_t>(rel32 + 4));
+			std::memcpy( m_code + rel32, &rel, sizeof( rel ) );
+		}
+	};	// class emitter_t
+}	// namespace
+
+struct jit_cache_t {
+	// A patchable jump into a block and the exit stub it reverts to if the block goes away
+	struct site_t {
+		size_t rel32;
+		size_t stub;
+	};	// struct site_t
+
+	struct block_t {
+		uint16_t start;
+		uint16_t end;
+		uint16_t length;	// instructions
+		size_t body;
+		bool valid;
+		std::vector<site_t> incoming;
+	};	// struct block_t
+
+	static size_t const CODE_SIZE = 16 * 1024 * 1024;
+	static uint16_t const MAX_BLOCK_LENGTH = 64;
+	static size_t const MAX_BYTES_PER_INSTRUCTION = 128;
+	static uint8_t const HOT = 16;
+	static uint8_t const NEVER = std::numeric_limits<uint8_t>::max( );
+
+	uint8_t * code;
+	emitter_t emit;
+	size_t enter_pos;
+	size_t exit_pos;
+	size_t dynamic_pos;
+	size_t first_block_pos;
+	std::vector<void *> natives;
+	std::vector<int32_t> block_at;
+	std::vector<uint8_t> heat;
+	std::vector<block_t> blocks;
+	uint64_t compiled;	// blocks ever compiled, blocks is emptied by a flush
+	std::unordered_map<uint16_t, std::vector<site_t>> pending;
+	uint64_t generation;
+	jit_context_t context;
+
+	jit_cache_t( ):
+		code( static_cast<uint8_t *>(mmap( nullptr, CODE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 )) ),
+		emit( code ),
+		enter_pos( 0 ),
+		exit_pos( 0 ),
+		dynamic_pos( 0 ),
+		first_block_pos( 0 ),
+		natives( MODULO, nullptr ),
+		block_at( MODULO, -1 ),
+		heat( MODULO, 0 ),
+		blocks( ),
+		compiled( 0 ),
+		pending( ),
+		generation( 0 ),
+		context( ) {
+
+		if( !available( ) ) {
+			code = nullptr;
+			return;
+		}
+		emit_fixed_routines( );
+	}
+
+	~jit_cache_t( ) {
+		if( available( ) ) {
+			munmap( code, CODE_SIZE );
+		}
+	}
+
+	jit_cache_t( jit_cache_t const & ) = delete;
+	jit_cache_t & operator=( jit_cache_t const & ) = delete;
+
+	bool available( ) const {
+		return code != nullptr && code != MAP_FAILED;
+	}
+
+	void emit_fixed_routines( ) {
+		// enter( context, body ).  Save callee saved registers, load the vm registers and
+		// jump to the block
+		enter_pos = emit.position( );
+		for( auto reg : { RBX, RBP, R12, R13, R14, R15 } ) {
+			emit.push( reg );
+		}
+		emit.alu64_ri8( ALU_SUB, RSP, 8 );	// keep rsp 16 byte aligned for helper calls
+		emit.mov64_rr( RBP, RDI );
+		emit.load64( RBX, RBP, SC_CTX( memory ) );
+		emit.load64( RAX, RBP, SC_CTX( registers ) );
+		for( uint8_t n = 0; n < 8; ++n ) {
+			emit.load16( static_cast<uint8_t>(R8 + n), RAX, static_cast<int8_t>(n * 2) );
+		}
+		emit.load64( RDI, RBP, SC_CTX( stack_top ) );
+		emit.jmp_r( RSI );
+
+		// exit with eax = next instruction ptr
+		exit_pos = emit.position( );
+		emit.load64( RCX, RBP, SC_CTX( registers ) );
+		for( uint8_t n = 0; n < 8; ++n ) {
+			emit.store16( RCX, static_cast<int8_t>(n * 2), static_cast<uint8_t>(R8 + n) );
+		}
+		emit.store64( RBP, SC_CTX( stack_top ), RDI );
+		emit.alu64_ri8( ALU_ADD, RSP, 8 );
+		for( auto reg : { R15, R14, R13, R12, RBP, RBX } ) {
+			emit.pop( reg );
+		}
+		emit.ret( );
+
+		// Jump to the instruction ptr in eax, staying native if it has been compiled
+		dynamic_pos = emit.position( );
+		emit.alu_ri( ALU_CMP, RAX, VALUE_MASK );
+		emit.patch( emit.jcc( CC_A ), exit_pos );
+		emit.load64( RCX, RBP, SC_CTX( natives ) );
+		emit.load64_indexed( RCX, RCX, RAX );
+		emit.test_rr( RCX, RCX );
+		emit.patch( emit.jcc( CC_E ), exit_pos );
+		emit.jmp_r( RCX );
+
+		first_block_pos = emit.position( );
+	}
+
+	void flush( ) {
+		std::fill( natives.begin( ), natives.end( ), nullptr );
+		std::fill( block_at.begin( ), block_at.end( ), -1 );
+		blocks.clear( );
+		pending.clear( );
+		emit.set_position( first_block_pos );
+	}
+
+	void invalidate( block_t & block ) {
+		block.valid = false;
+		natives[block.start] = nullptr;
+		block_at[block.start] = -1;
+		auto & waiting = pending[block.start];
+		for( auto const & site : block.incoming ) {
+			emit.patch( site.rel32, site.stub );
+			waiting.push_back( site );
+		}
+		block.incoming.clear( );
+	}
+
+	// Throw away native code made stale by writes to memory
+	void sync( virtual_machine_t & vm ) {
+		if( vm.decode_cache.generation( ) != generation ) {
+			generation = vm.decode_cache.generation( );
+			flush( );
+			std::fill( heat.begin( ), heat.end( ), 0 );
+		}
+		if( !vm.decode_cache.has_modified( ) ) {
+			return;
+		}
+		for( auto const address : vm.decode_cache.take_modified( ) ) {
+			heat[address] = 0;
+			for( auto & block : blocks ) {
+				if( block.valid && block.start <= address && address < block.end ) {
+					invalidate( block );
+				}
+			}
+		}
+	}
+
+	block_t const * find_or_compile( virtual_machine_t & vm, uint16_t ip ) {
+		if( ip >= MODULO ) {
+			return nullptr;
+		}
+		if( block_at[ip] >= 0 ) {
+			return &blocks[static_cast<size_t>(block_at[ip])];
+		}
+		if( heat[ip] == NEVER || ++heat[ip] < HOT ) {
+			return nullptr;
+		}
+		heat[ip] = 0;
+		return compile( vm, ip );
+	}
+
+	static bool is_compilable( decode_cache_t::entry_t const & entry ) {
+		switch( entry.op_code ) {
+		case 0:	// HALT
+		case 19:	// OUT
+		case 20:	// IN
+			return false;
+		case 1:	// SET
+		case 3:	// POP
+		case 4:	// EQ
+		case 5:	// GT
+		case 9:	// ADD
+		case 10:	// MULT
+		case 11:	// MOD
+		case 12:	// AND
+		case 13:	// OR
+		case 14:	// NOT
+		case 15:	// RMEM
+			// Writing to memory through the destination is left to the interpreter
+			return is_register( entry.args[0] );
+		default:
+			return true;
+		}
+	}
+
+	// Calls that may reach a native override are left to the interpreter
+	static bool is_overridden_call( virtual_machine_t const & vm, decode_cache_t::entry_t const & entry ) {
+		if( entry.op_code != 17 || vm.overrides.empty( ) ) {	// CALL
+			return false;
+		}
+		return is_register( entry.args[0] ) || vm.overrides.is_overridden( entry.args[0] );
+	}
+
+	static bool is_terminator( decode_cache_t::entry_t const & entry ) {
+		switch( entry.op_code ) {
+		case 6:	// JMP
+		case 7:	// JT
+		case 8:	// JF
+		case 17:	// CALL
+		case 18:	// RET
+			return true;
+		default:
+			return false;
+		}
+	}
+
+	struct exit_t {
+		size_t rel32;
+		uint16_t ip;
+		uint32_t refund;
+	};	// struct exit_t
+
+	struct compiler_t {
+		jit_cache_t & jit;
+		emitter_t & emit;
+		size_t block_index;
+		uint16_t length;
+		std::vector<exit_t> side_exits;
+		std::vector<exit_t> chains;
+
+		// eax/ecx/edx/esi = operand
+		void load( uint8_t dst, uint16_t raw ) {
+			if( is_register( raw ) ) {
+				emit.mov_rr( dst, host_reg( raw ) );
+			} else {
+				emit.mov_ri( dst, raw );
+			}
+		}
+
+		void alu( alu_t op, uint8_t dst, uint16_t raw ) {
+			if( is_register( raw ) ) {
+				emit.alu_rr( op, dst, host_reg( raw ) );
+			} else {
+				emit.alu_ri( op, dst, raw );
+			}
+		}
+
+		// Leave before instruction k(at ip) has run so the interpreter can handle it
+		void side_exit( cc_t cc, uint16_t k, uint16_t ip ) {
+			side_exits.push_back( exit_t { emit.jcc( cc ), ip, static_cast<uint32_t>(length - k) } );
+		}
+
+		// Jump to a known address, directly into its block once compiled
+		void chain( uint16_t target ) {
+			chains.push_back( exit_t { emit.jmp( ), target, 0 } );
+		}
+
+		// Jump to the address in eax
+		void dynamic( ) {
+			emit.patch( emit.jmp( ), jit.dynamic_pos );
+		}
+
+		void jump_to( uint16_t raw ) {
+			if( is_register( raw ) ) {
+				emit.mov_rr( RAX, host_reg( raw ) );
+				dynamic( );
+			} else {
+				chain( raw );
+			}
+		}
+
+		void push_eax( uint16_t k, uint16_t ip ) {
+			emit.cmp64( RDI, RBP, SC_CTX( stack_limit ) );
+			side_exit( CC_AE, k, ip );
+			emit.store16( RDI, 0, RAX );
+			emit.alu64_ri8( ALU_ADD, RDI, 2 );
+		}
+
+		void store_result( uint16_t raw, uint8_t src ) {
+			emit.mov_rr( host_reg( raw ), src );
+		}
+
+		// Returns false if the block ends here
+		bool instruction( uint16_t k, uint16_t ip, decode_cache_t::entry_t const & e ) {
+			auto const a = e.args[0];
+			auto const b = e.args[1];
+			auto const c = e.args[2];
+			auto const next_ip = static_cast<uint16_t>(ip + e.length);
+			switch( e.op_code ) {
+			case 1:	// SET
+				load( host_reg( a ), b );
+				return true;
+			case 2:	// PUSH
+				load( RAX, a );
+				push_eax( k, ip );
+				return true;
+			case 3:	// POP.  Popped values are validated by the interpreter if they are not literals
+				emit.cmp64( RDI, RBP, SC_CTX( stack_base ) );
+				side_exit( CC_E, k, ip );
+				emit.load16( RAX, RDI, -2 );
+				emit.alu_ri( ALU_CMP, RAX, VALUE_MASK );
+				side_exit( CC_A, k, ip );
+				emit.alu64_ri8( ALU_SUB, RDI, 2 );
+				store_result( a, RAX );
+				return true;
+			case 4:	// EQ
+			case 5:	// GT
+				load( RAX, b );
+				alu( ALU_CMP, RAX, c );
+				emit.setcc_eax( e.op_code == 4 ? CC_E : CC_A );
+				store_result( a, RAX );
+				return true;
+			case 6:	// JMP
+				jump_to( a );
+				return false;
+			case 7:	// JT
+			case 8:	// JF
+				if( !is_register( a ) ) {
+					if( (a != 0) == (e.op_code == 7) ) {
+						jump_to( b );
+					} else {
+						chain( next_ip );
+					}
+					return false;
+				} else {
+					emit.test_rr( host_reg( a ), host_reg( a ) );
+					auto const not_taken = emit.jcc( e.op_code == 7 ? CC_E : CC_NE );
+					jump_to( b );
+					emit.patch( not_taken, emit.position( ) );
+					chain( next_ip );
+				}
+				return false;
+			case 9:	// ADD
+				load( RAX, b );
+				alu( ALU_ADD, RAX, c );
+				emit.alu_ri( ALU_AND, RAX, VALUE_MASK );
+				store_result( a, RAX );
+				return true;
+			case 10:	// MULT
+				load( RAX, b );
+				if( is_register( c ) ) {
+					emit.imul_rr( RAX, host_reg( c ) );
+				} else {
+					load( RCX, c );
+					emit.imul_rr( RAX, RCX );
+				}
+				emit.alu_ri( ALU_AND, RAX, VALUE_MASK );
+				store_result( a, RAX );
+				return true;
+			case 11:	// MOD.  Division by zero is left to the interpreter
+				load( RCX, c );
+				emit.test_rr( RCX, RCX );
+				side_exit( CC_E, k, ip );
+				load( RAX, b );
+				emit.alu_rr( ALU_XOR, RDX, RDX );
+				emit.div_r( RCX );
+				store_result( a, RDX );
+				return true;
+			case 12:	// AND
+			case 13:	// OR
+				load( RAX, b );
+				alu( e.op_code == 12 ? ALU_AND : ALU_OR, RAX, c );
+				store_result( a, RAX );
+				return true;
+			case 14:	// NOT.  15 bit inverse, bit 15 is kept as in inst_not
+				load( RAX, b );
+				emit.alu_ri( ALU_XOR, RAX, VALUE_MASK );
+				store_result( a, RAX );
+				return true;
+			case 15:	// RMEM
+				if( is_register( b ) ) {
+					emit.mov_rr( RCX, host_reg( b ) );
+					emit.alu_ri( ALU_CMP, RCX, VALUE_MASK );
+					side_exit( CC_A, k, ip );
+					emit.load16_indexed( RAX, RBX, RCX );
+				} else {
+					emit.load16_disp32( RAX, RBX, static_cast<uint32_t>(b) * 2 );
+				}
+				store_result( a, RAX );
+				return true;
+			case 16:	// WMEM
+				load( RSI, a );
+				load( RDX, b );
+				emit.alu_ri( ALU_CMP, RSI, VALUE_MASK );
+				side_exit( CC_A, k, ip );
+				emit.alu_ri( ALU_CMP, RDX, VALUE_MASK );
+				side_exit( CC_A, k, ip );
+				for( auto reg : { R8, R9, R10, R11, RDI } ) {
+					emit.push( reg );
+				}
+				emit.alu64_ri8( ALU_SUB, RSP, 8 );
+				emit.mov64_rr( RDI, RBP );
+				emit.mov64_ri( RAX, reinterpret_cast<uint64_t>(&jit_write_memory) );
+				emit.call_r( RAX );
+				emit.alu64_ri8( ALU_ADD, RSP, 8 );
+				for( auto reg : { RDI, R11, R10, R9, R8 } ) {
+					emit.pop( reg );
+				}
+				// Compiled code was overwritten, leave before running any of it
+				emit.test_rr( RAX, RAX );
+				side_exit( CC_NE, static_cast<uint16_t>(k + 1), next_ip );
+				return true;
+			case 17:	// CALL
+				emit.mov_ri( RAX, next_ip );
+				push_eax( k, ip );
+				jump_to( a );
+				return false;
+			case 18:	// RET
+				emit.cmp64( RDI, RBP, SC_CTX( stack_base ) );
+				side_exit( CC_E, k, ip );
+				emit.alu64_ri8( ALU_SUB, RDI, 2 );
+				emit.load16( RAX, RDI, 0 );
+				dynamic( );
+				return false;
+			case 21:	// NOOP
+				return true;
+			default:
+				assert( false );
+				return false;
+			}
+		}
+	};	// struct compiler_t
+
+	block_t const * compile( virtual_machine_t & vm, uint16_t start ) {
+		std::vector<std::pair<uint16_t, decode_cache_t::entry_t>> instructions;
+		uint16_t ip = start;
+		while( instructions.size( ) < MAX_BLOCK_LENGTH ) {
+			auto const * entry = vm.decode_cache.fetch( vm.memory, ip );
+			if( entry == nullptr || !is_compilable( *entry ) || is_overridden_call( vm, *entry ) ) {
+				break;
+			}
+			instructions.emplace_back( ip, *entry );
+			ip = static_cast<uint16_t>(ip + entry->length);
+			if( is_terminator( *entry ) ) {
+				break;
+			}
+		}
+		if( instructions.empty( ) ) {
+			if( vm.decode_cache.fetch( vm.memory, start ) != nullptr ) {
+				// Only ever interpreted, until the memory there changes
+				vm.decode_cache.watch( start );
+				heat[start] = NEVER;
+			}
+			return nullptr;
+		}
+		auto const end = ip;
+		auto const length = static_cast<uint16_t>(instructions.size( ));
+		if( CODE_SIZE - emit.position( ) < (length + 1) * MAX_BYTES_PER_INSTRUCTION ) {
+			flush( );
+		}
+
+		auto const block_index = blocks.size( );
+		blocks.push_back( block_t { start, end, length, emit.position( ), true, { } } );
+		++compiled;
+		compiler_t compiler { *this, emit, block_index, length, { }, { } };
+
+		// Only start the block if the whole of it fits in the budget
+		emit.alu64_mi( ALU_CMP, RBP, SC_CTX( remaining ), length );
+		compiler.side_exits.push_back( exit_t { emit.jcc( CC_B ), start, 0 } );
+		emit.alu64_mi( ALU_SUB, RBP, SC_CTX( remaining ), length );
+
+		bool falls_through = true;
+		for( uint16_t k = 0; k < length; ++k ) {
+			vm.decode_cache.watch( instructions[k].first );
+			falls_through = compiler.instruction( k, instructions[k].first, instructions[k].second );
+		}
+		if( falls_through ) {
+			compiler.chain( end );
+		}
+
+		for( auto const & side_exit : compiler.side_exits ) {
+			emit.patch( side_exit.rel32, emit.position( ) );
+			if( side_exit.refund > 0 ) {
+				emit.alu64_mi( ALU_ADD, RBP, SC_CTX( remaining ), side_exit.refund );
+			}
+			emit.mov_ri( RAX, side_exit.ip );
+			emit.patch( emit.jmp( ), exit_pos );
+		}
+
+		// Register before resolving chains so a block can loop to itself
+		block_at[start] = static_cast<int32_t>(block_index);
+		natives[start] = code + blocks[block_index].body;
+		for( auto const & chain : compiler.chains ) {
+			site_t const site { chain.rel32, emit.position( ) };
+			emit.mov_ri( RAX, chain.ip );
+			emit.patch( emit.jmp( ), exit_pos );
+			if( chain.ip >= MODULO ) {
+				emit.patch( site.rel32, site.stub );
+			} else if( block_at[chain.ip] >= 0 ) {
+				auto & target = blocks[static_cast<size_t>(block_at[chain.ip])];
+				emit.patch( site.rel32, target.body );
+				target.incoming.push_back( site );
+			} else {
+				emit.patch( site.rel32, site.stub );
+				pending[chain.ip].push_back( site );
+			}
+		}
+
+		// Earlier blocks that were waiting on this address can now jump straight in
+		auto waiting = pending.find( start );
+		if( waiting != pending.end( ) ) {
+			auto & block = blocks[block_index];
+			for( auto const & site : waiting->second ) {
+				emit.patch( site.rel32, block.body );
+				block.incoming.push_back( site );
+			}
+			pending.erase( waiting );
+		}
+		return &blocks[block_index];
+	}
+
+	uint64_t execute( virtual_machine_t & vm, block_t const & block, uint64_t remaining ) {
+		auto & stack = vm.program_stack;
+		if( stack.capacity( ) - stack.size( ) < 64 ) {
+			stack.reserve( stack.capacity( ) * 2 + 64 );
+		}
+		context.remaining = remaining;
+		context.stack_base = stack.data( );
+		context.stack_top = stack.data( ) + stack.size( );
+		context.stack_limit = stack.data( ) + stack.capacity( );
+		context.registers = &vm.registers[0];
+		context.memory = &vm.memory[0];
+		context.natives = natives.data( );
+		context.vm = &vm;
+
+		auto const enter = reinterpret_cast<enter_t>(code + enter_pos);
+		auto const next_ip = enter( &context, code + block.body );
+
+		stack.set_size( static_cast<size_t>(context.stack_top - context.stack_base) );
+		vm.instruction_ptr = static_cast<uint16_t>(next_ip);
+		return context.remaining;
+	}
+};	// struct jit_cache_t
+
+#undef SC_CTX
+
+uint64_t run_jit( virtual_machine_t & vm, uint64_t max_instructions ) {
+	if( vm.is_instrumented( ) ) {
+		return 0;
+	}
+	if( !vm.jit_cache ) {
+		vm.jit_cache.reset( new jit_cache_t( ) );
+	}
+	auto & jit = *vm.jit_cache;
+	if( !jit.available( ) ) {
+		return run_threaded( vm, max_instructions );
+	}
+	uint64_t remaining = max_instructions;
+	while( remaining > 0 ) {
+		jit.sync( vm );
+		auto const * block = jit.find_or_compile( vm, vm.instruction_ptr );
+		if( block != nullptr && remaining >= block->length ) {
+			remaining = jit.execute( vm, *block, remaining );
+			continue;
+		}
+		// Cold, uncompilable or not enough budget left for the whole block
+		auto const executed = run_threaded( vm, 1 );
+		remaining -= executed;
+		if( executed == 0 || vm.is_instrumented( ) ) {
+			break;
+		}
+	}
+	return max_instructions - remaining;
+}
+
+bool has_jit( ) {
+	return jit_cache_t( ).available( );
+}
+
+uint64_t jit_blocks_compiled( virtual_machine_t const & vm ) {
+	return vm.jit_cache ? vm.jit_cache->compiled : 0;
+}
+
+#else	// SC_HAS_JIT
+
+struct jit_cache_t { };
+
+uint64_t run_jit( virtual_machine_t & vm, uint64_t max_instructions ) {
+	return run_threaded( vm, max_instructions );
+}
+
+bool has_jit( ) {
+	return false;
+}
+
+uint64_t jit_blocks_compiled( virtual_machine_t const & ) {
+	return 0;
+}
+
+#endif	// SC_HAS_JIT
+
+void jit_cache_deleter_t::operator( )( jit_cache_t * cache ) const {
+	delete cache;
+}
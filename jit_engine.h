@@ -0,0 +1,41 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+#include <cstdint>
+#include "vm.h"
+
+// x86-64 basic block compiler.  Blocks that become hot are translated to native code with
+// vm registers held in host registers, chained directly to each other through JMP/JT/JF/CALL 
+// and through a lookup table for RET and register targets.  IN, OUT, HALT and anything that
+// must report an error run in the threaded interpreter.  Writes to memory a block was
+// compiled from discard that block.  On other hosts this is the threaded interpreter.
+// Returns after max_instructions or when the vm becomes instrumented
+uint64_t run_jit( virtual_machine_t & vm, uint64_t max_instructions );
+
+// Whether run_jit compiles anything on this host
+bool has_jit( );
+
+// Blocks run_jit has compiled for vm, including ones since discarded
+uint64_t jit_blocks_compiled( virtual_machine_t const & vm );
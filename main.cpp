@@ -23,20 +23,106 @@
 
 #include <cstdint>
 #include <cstdlib>
+#include <fstream>
 #include <iostream>
 #include <boost/asio.hpp>
 #include <boost/asio/signal_set.hpp>
 #include <boost/thread.hpp>
 #include <boost/bind.hpp>
 #include <atomic>
+#include <string>
+#include <vector>
+#include "engine.h"
+#include "sampler.h"
 #include "vm.h"
 
-int main( int argc, char** argv ) {
-	if( argc <= 1 ) {
+int main( int argc, char** argv ) try {
+	engine_t engine = engine_t::tick;
+	flush_policy_t flush_policy = flush_policy_t::on_input;
+	std::vector<input_reader_t> input_readers;
+	exhausted_policy_t exhausted_policy = exhausted_policy_t::console;
+	std::vector<std::string> plugins;
+	bool is_memoized = false;
+	uint64_t memo_validate_every = 0;
+	bool is_stdin_after_script = true;
+	image_load_t image_load = image_load_t::copy;
+	size_t profile_top = 0;	// 0 does not report
+	std::string flame_graph_file;
+	uint64_t sample_interval = 0;	// microseconds, 0 does not sample
+	size_t sample_range = 64;
+	std::string vm_file;
+	for( int n = 1; n < argc; ++n ) {
+		std::string const arg = argv[n];
+		if( arg.compare( 0, 9, "--engine=" ) == 0 ) {
+			engine = engine_from_string( arg.substr( 9 ) );
+		} else if( arg.compare( 0, 8, "--flush=" ) == 0 ) {
+			flush_policy = flush_policy_from_string( arg.substr( 8 ) );
+		} else if( arg.compare( 0, 9, "--plugin=" ) == 0 ) {
+			plugins.push_back( arg.substr( 9 ) );
+		} else if( arg == "--map_image" ) {
+			image_load = image_load_t::map;
+		} else if( arg == "--memoize" ) {
+			is_memoized = true;
+		} else if( arg.compare( 0, 19, "--memoize_validate=" ) == 0 ) {
+			is_memoized = true;
+			memo_validate_every = std::stoull( arg.substr( 19 ) );
+		} else if( arg == "--profile" ) {
+			profile_top = 20;
+		} else if( arg.compare( 0, 10, "--profile=" ) == 0 ) {
+			profile_top = std::stoull( arg.substr( 10 ) );
+		} else if( arg.compare( 0, 13, "--flamegraph=" ) == 0 ) {
+			flame_graph_file = arg.substr( 13 );
+		} else if( arg == "--sample" ) {
+			sample_interval = 1000;
+		} else if( arg.compare( 0, 9, "--sample=" ) == 0 ) {
+			sample_interval = std::stoull( arg.substr( 9 ) );
+		} else if( arg.compare( 0, 15, "--sample_range=" ) == 0 ) {
+			sample_range = std::stoull( arg.substr( 15 ) );
+		} else if( arg.compare( 0, 9, "--script=" ) == 0 ) {
+			input_readers.push_back( file_reader( arg.substr( 9 ) ) );
+		} else if( arg.compare( 0, 16, "--on_script_end=" ) == 0 ) {
+			auto const action = arg.substr( 16 );
+			if( action == "stdin" ) {
+				is_stdin_after_script = true;
+				exhausted_policy = exhausted_policy_t::console;
+			} else if( action == "console" ) {
+				is_stdin_after_script = false;
+				exhausted_policy = exhausted_policy_t::console;
+			} else if( action == "halt" ) {
+				is_stdin_after_script = false;
+				exhausted_policy = exhausted_policy_t::halt;
+			} else {
+				std::cerr << "Unknown script end action '" << action << "', expected one of stdin, console or halt" << std::endl;
+				exit( EXIT_FAILURE );
+			}
+		} else {
+			vm_file = arg;
+		}
+	}
+	if( vm_file.empty( ) ) {
 		std::cerr << "Must supply a vm file" << std::endl;
+		std::cerr << "Usage: " << argv[0] << " [--engine=tick|threaded|jit] [--flush=input|line|always] [--script=<file>...] [--on_script_end=stdin|console|halt] [--plugin=<shared object>...] [--memoize] [--memoize_validate=<every n hits>] [--map_image] [--profile[=<top n>]] [--flamegraph=<collapsed stacks file>] [--sample[=<interval in microseconds>]] [--sample_range=<words>] <vm file>" << std::endl;
 		exit( EXIT_FAILURE );
 	}
-	virtual_machine_t vm( argv[1] );
+	virtual_machine_t vm( vm_file, image_load );
+	vm.output.set_policy( flush_policy );
+	for( auto const & plugin : plugins ) {
+		vm.load_plugin( plugin );
+	}
+	if( is_memoized ) {
+		vm.memo.enable( vm, memo_validate_every );
+	}
+	if( profile_top != 0 || !flame_graph_file.empty( ) ) {
+		vm.profiler.start( );
+	}
+	if( !input_readers.empty( ) ) {
+		// Scripts run in the order given
+		if( is_stdin_after_script ) {
+			input_readers.push_back( stdin_reader( ) );
+		}
+		vm.input.set_readers( std::move( input_readers ) );
+		vm.input.set_exhausted_policy( exhausted_policy );
+	}
 #ifdef DEBUG
 	std::atomic_flag should_break = ATOMIC_FLAG_INIT;
 	boost::asio::io_service io;
@@ -67,15 +153,43 @@ int main( int argc, char** argv ) {
 	// Start main loop
 	vm.debugging.should_break = true;
 #endif
-	while( true ) {		
-		vm.tick( );
+	sampler_t sampler;
+	if( sample_interval != 0 ) {
+		sampler.start( vm, std::chrono::microseconds( sample_interval ) );
+	}
+	// Engines run in slices so that a SIGINT can still break into the console
+	uint64_t const slice = sampler.is_running( ) ? sampler_t::SLICE : 1u << 16;
+	try {
+		while( true ) {		
+			run_engine( vm, engine, slice );
+			if( sampler.is_running( ) ) {
+				sampler.publish( vm );
+			}
 #ifdef DEBUG
-		if( !should_break.test_and_set( ) ) {
-			vm.debugging.should_break = true;
-		}
+			if( !should_break.test_and_set( ) ) {
+				vm.debugging.should_break = true;
+			}
 #endif		
+		}
+	} catch( vm_exit_t const & e ) {
+		// exit( ) rather than return as the SIGINT handler thread may still be running
+		vm.output.flush( );
+		if( profile_top != 0 ) {
+			vm.profiler.report( std::cerr, vm, profile_top );
+		}
+		if( !flame_graph_file.empty( ) ) {
+			std::ofstream out( flame_graph_file );
+			vm.profiler.calls( ).write_collapsed( out );
+		}
+		if( sampler.is_running( ) ) {
+			sampler.stop( );
+			sampler.report( std::cerr, sample_range, 20 );
+		}
+		exit( e.report( ) );
 	}
 
 	return EXIT_SUCCESS;
+} catch( vm_exit_t const & e ) {
+	return e.report( );
 }
 
@@ -0,0 +1,125 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include "mapped_memory.h"
+#include "memory_helper.h"
+
+namespace {
+	size_t const BYTES = mapped_memory_t::SIZE * sizeof( uint16_t );
+
+#ifndef _WIN32
+	// Fresh zero pages, at data if not null.  The kernel only backs them once written
+	uint16_t * map_anonymous( void * data ) {
+		auto const flags = MAP_PRIVATE | MAP_ANONYMOUS | (data != nullptr ? MAP_FIXED : 0);
+		auto const result = mmap( data, BYTES, PROT_READ | PROT_WRITE, flags, -1, 0 );
+		if( MAP_FAILED == result ) {
+			std::cerr << "Error allocating vm memory\n";
+			std::abort( );
+		}
+		return static_cast<uint16_t *>(result);
+	}
+#endif
+}
+
+#ifndef _WIN32
+mapped_memory_t::mapped_memory_t( ):
+	m_data( map_anonymous( nullptr ) ),
+	m_filename( ) { }
+
+mapped_memory_t::~mapped_memory_t( ) {
+	munmap( m_data, BYTES );
+}
+
+void mapped_memory_t::clear( ) {
+	map_anonymous( m_data );
+	m_filename.clear( );
+}
+
+bool mapped_memory_t::map_file( std::string const & filename ) {
+	clear( );
+	auto const fd = open( filename.c_str( ), O_RDONLY );
+	if( fd < 0 ) {
+		return false;
+	}
+	struct stat info;
+	if( fstat( fd, &info ) != 0 || info.st_size <= 0 ) {
+		close( fd );
+		return false;
+	}
+	// Pages wholly past the end of the file stay anonymous, mapping them would fault
+	auto const bytes = std::min( static_cast<size_t>(info.st_size), BYTES );
+	auto const result = mmap( m_data, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0 );
+	close( fd );
+	if( MAP_FAILED == result ) {
+		clear( );
+		return false;
+	}
+	m_filename = filename;
+	return true;
+}
+
+void mapped_memory_t::detach( ) {
+	if( !is_mapped( ) ) {
+		return;
+	}
+	std::vector<uint16_t> contents( begin( ), end( ) );
+	clear( );
+	std::copy( contents.begin( ), contents.end( ), begin( ) );
+}
+#else
+mapped_memory_t::mapped_memory_t( ):
+	m_data( new uint16_t[SIZE]( ) ),
+	m_filename( ) { }
+
+mapped_memory_t::~mapped_memory_t( ) {
+	delete[] m_data;
+}
+
+void mapped_memory_t::clear( ) {
+	std::fill( begin( ), end( ), 0 );
+}
+
+bool mapped_memory_t::map_file( std::string const & ) {
+	clear( );
+	return false;
+}
+
+void mapped_memory_t::detach( ) { }
+#endif
+
+void mapped_memory_t::check( size_t pos ) {
+	if( pos >= SIZE ) {
+		out_of_range_memory( pos );
+	}
+}
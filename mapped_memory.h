@@ -0,0 +1,95 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// The 32768 words of vm memory.  Besides owning zeroed memory it can be a private mapping of
+// an image or full state file, so that pages are read in as they are first touched and
+// stay shared with every other vm mapping the same file until written.  The address of the
+// memory never changes, engines may keep a pointer to it
+struct mapped_memory_t final {
+	static size_t const SIZE = 32768;
+	using value_type = uint16_t;
+	using iterator = uint16_t *;
+	using const_iterator = uint16_t const *;
+	using reference = uint16_t &;
+	using const_reference = uint16_t const &;
+
+	mapped_memory_t( );
+	~mapped_memory_t( );
+	mapped_memory_t( mapped_memory_t const & ) = delete;
+	mapped_memory_t & operator=( mapped_memory_t const & ) = delete;
+
+	iterator begin( ) {
+		return m_data;
+	}
+
+	const_iterator begin( ) const {
+		return m_data;
+	}
+
+	iterator end( ) {
+		return m_data + SIZE;
+	}
+
+	const_iterator end( ) const {
+		return m_data + SIZE;
+	}
+
+	size_t size( ) const {
+		return SIZE;
+	}
+
+	reference operator[]( size_t pos ) {
+		check( pos );
+		return m_data[pos];
+	}
+
+	const_reference operator[]( size_t pos ) const {
+		check( pos );
+		return m_data[pos];
+	}
+
+	// Zero all of memory, dropping any mapping of a file
+	void clear( );
+	// Replace memory with the first SIZE words of filename, words past the end of the file
+	// are zero.  false if the file could not be mapped, memory is then cleared
+	bool map_file( std::string const & filename );
+	// Copy a mapped file into memory of our own, so the file can be rewritten safely
+	void detach( );
+	bool is_mapped( ) const {
+		return !m_filename.empty( );
+	}
+	std::string const & mapped_filename( ) const {
+		return m_filename;
+	}
+private:
+	static void check( size_t pos );
+
+	uint16_t * m_data;
+	std::string m_filename;	// empty unless memory is a mapping of the file
+};	// struct mapped_memory_t
@@ -0,0 +1,376 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include <cstdlib>
+#include <string>
+#include "memoizer.h"
+#include "vm.h"
+
+size_t memoizer_t::key_hash_t::operator( )( registers_t const & key ) const {
+	size_t result = 0;
+	for( auto const value : key ) {
+		result = result * 0x9E3779B1u + value;
+	}
+	return result;
+}
+
+memoizer_t::memoizer_t( ):
+	m_is_enabled( false ),
+	m_is_analyzed( false ),
+	m_validate_every( 0 ),
+	m_guard_generation( 0 ),
+	m_functions( ),
+	m_indices( ),
+	m_frames( ),
+	m_hits( 0 ),
+	m_misses( 0 ) { }
+
+void memoizer_t::enable( virtual_machine_t & vm, uint64_t validate_every ) {
+	m_is_enabled = true;
+	m_validate_every = validate_every;
+	analyze( vm );
+	// Code is often decrypted or built at start up, look again at the first IN
+	m_is_analyzed = false;
+}
+
+void memoizer_t::disable( virtual_machine_t & vm ) {
+	for( auto & function : m_functions ) {
+		if( function.is_installed ) {
+			vm.overrides.remove( function.address );
+		}
+	}
+	m_functions.clear( );
+	m_indices.clear( );
+	m_frames.clear( );
+	m_is_enabled = false;
+	vm.decode_cache.clear_guards( );
+	vm.decode_cache.clear( );
+}
+
+bool memoizer_t::is_enabled( ) const {
+	return m_is_enabled;
+}
+
+void memoizer_t::stop_recording( ) {
+	m_frames.clear( );
+}
+
+void memoizer_t::on_input( virtual_machine_t & vm ) {
+	if( m_is_enabled && (!m_is_analyzed || vm.decode_cache.guard_generation( ) != m_guard_generation) ) {
+		analyze( vm );
+	}
+}
+
+void memoizer_t::on_pop( virtual_machine_t & vm ) {
+	// Popping the return address, or below it, reads the caller's part of the stack
+	while( !m_frames.empty( ) && vm.program_stack.size( ) <= m_frames.back( ).depth + 1 ) {
+		reject( vm, m_frames.back( ).function );
+		m_frames.pop_back( );
+	}
+}
+
+void memoizer_t::on_return( virtual_machine_t & vm ) {
+	auto const depth = vm.program_stack.size( );
+	while( !m_frames.empty( ) && depth < m_frames.back( ).depth ) {
+		// Returned past the frame, it was not left by its own RET
+		reject( vm, m_frames.back( ).function );
+		m_frames.pop_back( );
+	}
+	if( m_frames.empty( ) || depth != m_frames.back( ).depth || vm.instruction_ptr != m_frames.back( ).return_address ) {
+		return;
+	}
+	if( vm.decode_cache.guard_generation( ) != m_guard_generation ) {
+		// What the results depend on has changed since the calls were made
+		m_frames.clear( );
+		return;
+	}
+	auto const frame = m_frames.back( );
+	m_frames.pop_back( );
+	auto & function = m_functions[frame.function];
+	if( function.is_rejected ) {
+		return;
+	}
+	auto const result = masked( vm, function.outputs );
+	if( frame.is_validation ) {
+		if( result != frame.expected ) {
+			throw vm_exit_t( EXIT_FAILURE, "FATAL ERROR: Memoized result of subroutine @ location " + std::to_string( function.address ) + " differs from its recomputation" );
+		}
+		return;
+	}
+	if( function.results.size( ) >= MAX_RESULTS ) {
+		function.results.clear( );
+	}
+	function.results.emplace( frame.key, result );
+}
+
+uint64_t memoizer_t::hits( ) const {
+	return m_hits;
+}
+
+uint64_t memoizer_t::misses( ) const {
+	return m_misses;
+}
+
+void memoizer_t::analyze( virtual_machine_t & vm ) {
+	std::map<uint16_t, summary_t> summaries;
+	for( size_t n = 0; n + 1 < vm.memory.size( ); ++n ) {
+		if( vm.memory[n] == decode_cache_t::op_call && vm.memory[n + 1] < virtual_machine_t::MODULO ) {
+			summarize( vm, vm.memory[n + 1], summaries );
+		}
+	}
+	// Recursive calls saw partial summaries, settle what flows from callees to callers
+	bool is_changed = true;
+	while( is_changed ) {
+		is_changed = false;
+		for( auto & item : summaries ) {
+			auto & summary = item.second;
+			for( auto const callee_address : summary.callees ) {
+				auto const & callee = summaries[callee_address];
+				auto const is_pure = summary.is_pure && callee.is_pure;
+				auto const inputs = static_cast<uint8_t>(summary.inputs | callee.inputs);
+				auto const outputs = static_cast<uint8_t>(summary.outputs | callee.outputs);
+				if( is_pure != summary.is_pure || inputs != summary.inputs || outputs != summary.outputs ) {
+					summary.is_pure = is_pure;
+					summary.inputs = inputs;
+					summary.outputs = outputs;
+					is_changed = true;
+				}
+			}
+		}
+	}
+
+	bool is_installed = false;
+	vm.decode_cache.clear_guards( );
+	for( auto & function : m_functions ) {
+		function.results.clear( );
+		auto const found = summaries.find( function.address );
+		if( function.is_installed && (found == summaries.end( ) || !found->second.is_pure) ) {
+			vm.overrides.remove( function.address );
+			function.is_installed = false;
+			is_installed = true;
+		}
+	}
+	for( auto const & item : summaries ) {
+		auto const & summary = item.second;
+		if( !summary.is_pure ) {
+			continue;
+		}
+		for( auto const address : summary.words ) {
+			vm.decode_cache.guard( address );
+		}
+		auto index = m_indices.find( item.first );
+		if( index == m_indices.end( ) ) {
+			index = m_indices.emplace( item.first, m_functions.size( ) ).first;
+			m_functions.push_back( function_t { item.first, 0, 0, false, false, { } } );
+		}
+		auto & function = m_functions[index->second];
+		function.inputs = summary.inputs;
+		function.outputs = summary.outputs;
+		if( !function.is_installed && !function.is_rejected && !vm.overrides.is_overridden( function.address ) ) {
+			auto const n = index->second;
+			vm.overrides.add( function.address, [this, n]( virtual_machine_t & target ) { call( target, n ); } );
+			function.is_installed = true;
+			is_installed = true;
+		}
+	}
+	if( is_installed ) {
+		// Compiled code may call the subroutines directly
+		vm.decode_cache.clear( );
+	}
+	m_guard_generation = vm.decode_cache.guard_generation( );
+	m_is_analyzed = true;
+}
+
+memoizer_t::summary_t const & memoizer_t::summarize( virtual_machine_t & vm, uint16_t address, std::map<uint16_t, summary_t> & summaries ) {
+	auto const found = summaries.find( address );
+	if( found != summaries.end( ) ) {
+		return found->second;
+	}
+	// Recursive calls find the summary while it is built and are settled by analyze( )
+	auto & summary = summaries[address];
+	summary.is_pure = true;
+	summary.inputs = 0;
+	summary.outputs = 0;
+
+	auto const read = [&summary]( uint16_t raw ) {
+		if( virtual_machine_t::is_register( raw ) ) {
+			summary.inputs |= static_cast<uint8_t>(1u << (raw - virtual_machine_t::REGISTER0));
+		}
+	};
+	auto const write = [&summary]( uint16_t raw ) {
+		if( virtual_machine_t::is_register( raw ) ) {
+			summary.outputs |= static_cast<uint8_t>(1u << (raw - virtual_machine_t::REGISTER0));
+		} else {
+			summary.is_pure = false;
+		}
+	};
+	auto const jump = [&summary]( uint16_t raw, std::vector<uint16_t> & pending ) {
+		if( virtual_machine_t::is_register( raw ) ) {
+			summary.is_pure = false;
+		} else {
+			pending.push_back( raw );
+		}
+	};
+
+	std::vector<uint16_t> pending { address };
+	std::set<uint16_t> visited;
+	while( !pending.empty( ) && summary.is_pure ) {
+		auto const ip = pending.back( );
+		pending.pop_back( );
+		if( !visited.insert( ip ).second ) {
+			continue;
+		}
+		auto const * e = vm.decode_cache.fetch( vm.memory, ip );
+		if( visited.size( ) > MAX_INSTRUCTIONS || e == nullptr || ip + e->length >= vm.memory.size( ) ) {
+			summary.is_pure = false;
+			break;
+		}
+		for( uint16_t n = 0; n < e->length; ++n ) {
+			summary.words.push_back( static_cast<uint16_t>(ip + n) );
+		}
+		auto const next = static_cast<uint16_t>(ip + e->length);
+		auto const a = e->args[0];
+		auto const b = e->args[1];
+		auto const c = e->args[2];
+		switch( e->op_code ) {
+		case decode_cache_t::op_set:
+		case decode_cache_t::op_not:
+			write( a );
+			read( b );
+			pending.push_back( next );
+			break;
+		case decode_cache_t::op_push:
+			read( a );
+			pending.push_back( next );
+			break;
+		case decode_cache_t::op_pop:
+			write( a );
+			pending.push_back( next );
+			break;
+		case decode_cache_t::op_eq:
+		case decode_cache_t::op_gt:
+		case decode_cache_t::op_add:
+		case decode_cache_t::op_mult:
+		case decode_cache_t::op_mod:
+		case decode_cache_t::op_and:
+		case decode_cache_t::op_or:
+			write( a );
+			read( b );
+			read( c );
+			pending.push_back( next );
+			break;
+		case decode_cache_t::op_rmem:
+			write( a );
+			if( virtual_machine_t::is_register( b ) ) {
+				summary.is_pure = false;
+			} else {
+				summary.words.push_back( b );
+			}
+			pending.push_back( next );
+			break;
+		case decode_cache_t::op_jmp:
+			jump( a, pending );
+			break;
+		case decode_cache_t::op_jt:
+		case decode_cache_t::op_jf:
+			read( a );
+			jump( b, pending );
+			pending.push_back( next );
+			break;
+		case decode_cache_t::op_call:
+			if( virtual_machine_t::is_register( a ) ) {
+				summary.is_pure = false;
+			} else if( a != address ) {
+				summary.callees.insert( a );
+				summarize( vm, a, summaries );
+			}
+			pending.push_back( next );
+			break;
+		case decode_cache_t::op_ret:
+			break;
+		case decode_cache_t::op_noop:
+			pending.push_back( next );
+			break;
+		default:	// HALT, WMEM, OUT and IN
+			summary.is_pure = false;
+			break;
+		}
+	}
+	return summary;
+}
+
+void memoizer_t::call( virtual_machine_t & vm, size_t index ) {
+	auto const & function = m_functions[index];
+	if( function.is_rejected || vm.decode_cache.guard_generation( ) != m_guard_generation ) {
+		// Stale until analyzed again at the next IN, make the real call
+		vm.program_stack.push_back( vm.instruction_ptr );
+		vm.instruction_ptr = function.address;
+		return;
+	}
+	// A register written on only some paths keeps the caller's value on the others, so the
+	// outputs are part of the key as well
+	auto const key = masked( vm, static_cast<uint8_t>(function.inputs | function.outputs) );
+	auto const found = function.results.find( key );
+	if( found == function.results.end( ) ) {
+		++m_misses;
+		record( vm, index, key, nullptr );
+		return;
+	}
+	++m_hits;
+	if( m_validate_every != 0 && m_hits % m_validate_every == 0 ) {
+		record( vm, index, key, &found->second );
+		return;
+	}
+	for( size_t n = 0; n < vm.registers.size( ); ++n ) {
+		if( function.outputs & (1u << n) ) {
+			vm.set_register( static_cast<uint16_t>(virtual_machine_t::REGISTER0 + n), found->second[n] );
+		}
+	}
+}
+
+void memoizer_t::record( virtual_machine_t & vm, size_t index, registers_t const & key, registers_t const * expected ) {
+	m_frames.push_back( frame_t { index, key, vm.instruction_ptr, vm.program_stack.size( ), expected != nullptr, expected != nullptr ? *expected : registers_t { } } );
+	vm.program_stack.push_back( vm.instruction_ptr );
+	vm.instruction_ptr = m_functions[index].address;
+}
+
+void memoizer_t::reject( virtual_machine_t & vm, size_t index ) {
+	auto & function = m_functions[index];
+	function.is_rejected = true;
+	function.results.clear( );
+	if( function.is_installed ) {
+		vm.overrides.remove( function.address );
+		function.is_installed = false;
+		vm.decode_cache.clear( );
+	}
+}
+
+memoizer_t::registers_t memoizer_t::masked( virtual_machine_t const & vm, uint8_t mask ) const {
+	registers_t result { };
+	for( size_t n = 0; n < result.size( ); ++n ) {
+		if( mask & (1u << n) ) {
+			result[n] = vm.registers[n];
+		}
+	}
+	return result;
+}
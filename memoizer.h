@@ -0,0 +1,119 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+struct virtual_machine_t;
+
+// Caches the results of subroutines that only depend on their input registers, so that a
+// CALL with inputs seen before sets the output registers and continues at once.  
+// Candidates are the literal targets of CALL whose code, and that of all they call, does no
+// I/O, writes no memory, does not jump or call through a register and only reads memory 
+// at literal addresses.  Those words are guarded in the decode cache and every result is
+// dropped when one of them is written.
+//
+// Candidates are installed as native overrides.  A miss makes the real call and records
+// the output registers when it returns, for which the vm runs in the reference 
+// implementation until the outermost recording call has returned
+struct memoizer_t final {
+	static size_t const MAX_RESULTS = 1u << 20;	// per subroutine, its table is emptied when full
+	static size_t const MAX_INSTRUCTIONS = 4096;	// largest subroutine analyzed
+
+	using registers_t = std::array<uint16_t, 8>;
+
+	memoizer_t( );
+
+	// Every validate_every'th hit runs the subroutine anyway and fails the vm if the result
+	// differs from the cached one.  0 never validates
+	void enable( virtual_machine_t & vm, uint64_t validate_every = 0 );
+	void disable( virtual_machine_t & vm );
+	bool is_enabled( ) const;
+
+	bool is_recording( ) const {
+		return !m_frames.empty( );
+	}
+	void stop_recording( );
+
+	// Hooks for the reference implementation
+	void on_input( virtual_machine_t & vm );
+	void on_pop( virtual_machine_t & vm );
+	void on_return( virtual_machine_t & vm );
+
+	uint64_t hits( ) const;
+	uint64_t misses( ) const;
+private:
+	struct key_hash_t {
+		size_t operator( )( registers_t const & key ) const;
+	};
+
+	struct function_t {
+		uint16_t address;
+		uint8_t inputs;		// bit n set when register n is read
+		uint8_t outputs;	// bit n set when register n is written
+		bool is_installed;
+		bool is_rejected;	// found not to behave like a subroutine while recording
+		std::unordered_map<registers_t, registers_t, key_hash_t> results;
+	};	// struct function_t
+
+	struct summary_t {
+		bool is_pure;
+		uint8_t inputs;
+		uint8_t outputs;
+		std::vector<uint16_t> words;	// every word the result depends on
+		std::set<uint16_t> callees;
+	};	// struct summary_t
+
+	struct frame_t {
+		size_t function;
+		registers_t key;
+		uint16_t return_address;
+		size_t depth;			// program stack size before the return address was pushed
+		bool is_validation;
+		registers_t expected;
+	};	// struct frame_t
+
+	void analyze( virtual_machine_t & vm );
+	summary_t const & summarize( virtual_machine_t & vm, uint16_t address, std::map<uint16_t, summary_t> & summaries );
+	void call( virtual_machine_t & vm, size_t index );
+	void record( virtual_machine_t & vm, size_t index, registers_t const & key, registers_t const * expected );
+	void reject( virtual_machine_t & vm, size_t index );
+	registers_t masked( virtual_machine_t const & vm, uint8_t mask ) const;
+
+	bool m_is_enabled;
+	bool m_is_analyzed;
+	uint64_t m_validate_every;
+	uint64_t m_guard_generation;
+	std::vector<function_t> m_functions;
+	std::unordered_map<uint16_t, size_t> m_indices;
+	std::vector<frame_t> m_frames;
+	uint64_t m_hits;
+	uint64_t m_misses;
+};	// struct memoizer_t
@@ -28,8 +28,12 @@
 #include <iostream>
 #include <boost/utility/string_ref.hpp>
 #include <sstream>
+#include <vector>
 #include "helpers.h"
 
+// Stop the vm with a vm_exit_t for its host to report.  Defined in vm.cpp
+[[noreturn]] void out_of_range_memory( size_t pos );
+
 template<size_t SIZE, typename T = uint16_t>
 struct virtual_memory_t {
 	using array_t = std::array<T, SIZE>;
@@ -72,21 +76,123 @@ public:
 
 	reference operator[]( size_t pos ) {
 		if( pos >= m_memory.size( ) ) {
-			std::cerr << "OUT OF RANGE MEMORY ATTEMP\n";
-			exit( EXIT_FAILURE );
+			out_of_range_memory( pos );
 		}
 		return m_memory[pos];
 	}
 
 	const_reference operator[]( size_t pos ) const {
 		if( pos >= m_memory.size( ) ) {
-			std::cerr << "OUT OF RANGE MEMORY ATTEMP\n";
-			exit( EXIT_FAILURE );
+			out_of_range_memory( pos );
 		}
 		return m_memory[pos];
 	}
 };	// struct virtual_memory_t
 
+// Unbounded stack over a contiguous buffer.  Engines that generate code push and pop 
+// through data( )/capacity( ) directly and report the new depth back with set_size( )
+template<typename T = uint16_t>
+struct vm_stack_t {
+	using value_type = T;
+	using iterator = T *;
+	using const_iterator = T const *;
+	using reference = T &;
+	using const_reference = T const &;
+private:
+	std::vector<T> m_storage;	// m_storage.size( ) is the capacity of the stack
+	size_t m_size;
+public:
+	vm_stack_t( ): m_storage( ), m_size( 0 ) { }
+	~vm_stack_t( ) = default;
+	vm_stack_t( vm_stack_t const & ) = default;
+	vm_stack_t( vm_stack_t && ) = default;
+	vm_stack_t & operator=( vm_stack_t const & ) = default;
+	vm_stack_t & operator=( vm_stack_t && ) = default;
+
+	void push_back( T const & value ) {
+		if( m_size == m_storage.size( ) ) {
+			reserve( m_storage.empty( ) ? 64 : m_storage.size( ) * 2 );
+		}
+		m_storage[m_size++] = value;
+	}
+
+	void pop_back( ) {
+		assert( m_size > 0 );
+		--m_size;
+	}
+
+	reference back( ) {
+		assert( m_size > 0 );
+		return m_storage[m_size - 1];
+	}
+
+	const_reference back( ) const {
+		assert( m_size > 0 );
+		return m_storage[m_size - 1];
+	}
+
+	bool empty( ) const {
+		return m_size == 0;
+	}
+
+	size_t size( ) const {
+		return m_size;
+	}
+
+	size_t capacity( ) const {
+		return m_storage.size( );
+	}
+
+	void reserve( size_t new_capacity ) {
+		if( new_capacity > m_storage.size( ) ) {
+			m_storage.resize( new_capacity );
+		}
+	}
+
+	void set_size( size_t new_size ) {
+		assert( new_size <= m_storage.size( ) );
+		m_size = new_size;
+	}
+
+	void clear( ) {
+		m_size = 0;
+	}
+
+	T * data( ) {
+		return m_storage.data( );
+	}
+
+	T const * data( ) const {
+		return m_storage.data( );
+	}
+
+	iterator begin( ) {
+		return data( );
+	}
+
+	const_iterator begin( ) const {
+		return data( );
+	}
+
+	iterator end( ) {
+		return data( ) + m_size;
+	}
+
+	const_iterator end( ) const {
+		return data( ) + m_size;
+	}
+
+	reference operator[]( size_t pos ) {
+		assert( pos < m_size );
+		return m_storage[pos];
+	}
+
+	const_reference operator[]( size_t pos ) const {
+		assert( pos < m_size );
+		return m_storage[pos];
+	}
+};	// struct vm_stack_t
+
 template<size_t SIZE, typename T>
 std::string to_json( virtual_memory_t<SIZE, T> const & mem ) {
 	std::stringstream ss;
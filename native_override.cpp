@@ -0,0 +1,56 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include <limits>
+#include "native_override.h"
+
+override_table_t::override_table_t( ):
+	m_flags( std::numeric_limits<uint16_t>::max( ) + 1u, 0 ),
+	m_plugins( ),
+	m_overrides( ) { }
+
+uint8_t const * override_table_t::flags( ) const {
+	return m_flags.data( );
+}
+
+bool override_table_t::empty( ) const {
+	return m_overrides.empty( );
+}
+
+void override_table_t::add( uint16_t address, native_override_t function ) {
+	m_overrides[address] = std::move( function );
+	m_flags[address] = 1;
+}
+
+void override_table_t::remove( uint16_t address ) {
+	m_overrides.erase( address );
+	m_flags[address] = 0;
+}
+
+void override_table_t::call( uint16_t address, virtual_machine_t & vm ) const {
+	m_overrides.find( address )->second( vm );
+}
+
+void override_table_t::retain( std::shared_ptr<void> plugin ) {
+	m_plugins.push_back( std::move( plugin ) );
+}
@@ -0,0 +1,70 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct virtual_machine_t;
+
+// Native replacement for a subroutine of the vm program.  It runs in place of a CALL to the
+// subroutine's address and must leave the registers, memory and program stack as the 
+// subroutine would have on its RET.  The return address is not pushed, the vm continues
+// after the CALL unless the override makes the call itself by pushing it and jumping.
+// Registers and memory must be written through vm.set_register and vm.set_memory, writing
+// vm.memory directly leaves stale decoded or compiled code and skips watchpoints
+using native_override_t = std::function<void( virtual_machine_t & vm )>;
+
+// Entry point a plugin exports to add its overrides with virtual_machine_t::add_override
+extern "C" {
+	typedef void( *register_overrides_t )( virtual_machine_t & vm );
+}
+#define SC_REGISTER_OVERRIDES_SYMBOL "synacor_register_overrides"
+
+// Overrides keyed by the address of the subroutine they replace
+struct override_table_t final {
+	override_table_t( );
+
+	bool is_overridden( uint16_t address ) const {
+		return m_flags[address] != 0;
+	}
+
+	// One byte per address, non-zero where a CALL is overridden.  For engines
+	uint8_t const * flags( ) const;
+	bool empty( ) const;
+	void add( uint16_t address, native_override_t function );
+	void remove( uint16_t address );
+	void call( uint16_t address, virtual_machine_t & vm ) const;
+
+	// Keep a plugin loaded for as long as its overrides may be called
+	void retain( std::shared_ptr<void> plugin );
+private:
+	std::vector<uint8_t> m_flags;
+	std::vector<std::shared_ptr<void>> m_plugins;	// outlives m_overrides, which may hold plugin code
+	std::unordered_map<uint16_t, native_override_t> m_overrides;
+};	// struct override_table_t
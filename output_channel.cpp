@@ -0,0 +1,136 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+#include "output_channel.h"
+
+output_sink_t stream_sink( std::ostream & os ) {
+	return [&os]( char const * data, size_t size ) {
+		os.write( data, static_cast<std::streamsize>(size) );
+		os.flush( );
+	};
+}
+
+output_sink_t fd_sink( int fd ) {
+	return [fd]( char const * data, size_t size ) {
+		while( size > 0 ) {
+#ifdef _WIN32
+			auto const written = _write( fd, data, static_cast<unsigned int>(size) );
+#else
+			auto const written = ::write( fd, data, size );
+#endif
+			if( written <= 0 ) {
+				std::cerr << "FATAL ERROR: Could not write output to file descriptor " << fd << std::endl;
+				exit( EXIT_FAILURE );
+			}
+			data += written;
+			size -= static_cast<size_t>(written);
+		}
+	};
+}
+
+output_sink_t memory_sink( std::string & destination ) {
+	return [&destination]( char const * data, size_t size ) {
+		destination.append( data, size );
+	};
+}
+
+output_sink_t null_sink( ) {
+	return []( char const *, size_t ) { };
+}
+
+flush_policy_t flush_policy_from_string( std::string const & name ) {
+	if( name == "input" ) {
+		return flush_policy_t::on_input;
+	} else if( name == "line" ) {
+		return flush_policy_t::on_newline;
+	} else if( name == "always" ) {
+		return flush_policy_t::always;
+	}
+	std::cerr << "Unknown flush policy '" << name << "', expected one of input, line or always" << std::endl;
+	exit( EXIT_FAILURE );
+}
+
+output_channel_t::output_channel_t( ):
+	m_buffer( ),
+	m_size( 0 ),
+	m_limit( BUFFER_SIZE ),
+	m_flush_char( -1 ),
+	m_policy( flush_policy_t::on_input ),
+	m_sink( stream_sink( std::cout ) ) { }
+
+output_channel_t::~output_channel_t( ) {
+	flush( );
+}
+
+void output_channel_t::write( char const * data, size_t size ) {
+	if( m_flush_char >= 0 || m_limit < BUFFER_SIZE ) {
+		// Keep the per character policy
+		for( size_t n = 0; n < size; ++n ) {
+			put( data[n] );
+		}
+		return;
+	}
+	while( size > 0 ) {
+		auto const count = std::min( size, BUFFER_SIZE - m_size );
+		std::memcpy( m_buffer.data( ) + m_size, data, count );
+		m_size += count;
+		data += count;
+		size -= count;
+		if( m_size == BUFFER_SIZE ) {
+			flush( );
+		}
+	}
+}
+
+void output_channel_t::flush( ) {
+	if( m_size == 0 ) {
+		return;
+	}
+	m_sink( m_buffer.data( ), m_size );
+	m_size = 0;
+}
+
+void output_channel_t::set_sink( output_sink_t sink ) {
+	flush( );
+	m_sink = std::move( sink );
+}
+
+void output_channel_t::set_policy( flush_policy_t policy ) {
+	flush( );
+	m_policy = policy;
+	m_limit = policy == flush_policy_t::always ? 1 : BUFFER_SIZE;
+	m_flush_char = policy == flush_policy_t::on_newline ? '\n' : -1;
+}
+
+flush_policy_t output_channel_t::policy( ) const {
+	return m_policy;
+}
@@ -0,0 +1,75 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <functional>
+#include <iosfwd>
+#include <string>
+
+// Where buffered VM output ends up.  Called with each batch as it is flushed
+using output_sink_t = std::function<void( char const * data, size_t size )>;
+
+output_sink_t stream_sink( std::ostream & os );
+output_sink_t fd_sink( int fd );
+output_sink_t memory_sink( std::string & destination );
+output_sink_t null_sink( );
+
+enum class flush_policy_t { on_input, on_newline, always };
+
+flush_policy_t flush_policy_from_string( std::string const & name );
+
+// Buffers the characters written by OUT so that the sink sees batches instead of single
+// characters.  The buffer is flushed when it is full, when the program asks for input or
+// halts, and additionally on every newline or character if the policy says so
+struct output_channel_t final {
+	static size_t const BUFFER_SIZE = 4096;
+
+	output_channel_t( );
+	output_channel_t( output_channel_t const & ) = delete;
+	output_channel_t & operator=( output_channel_t const & ) = delete;
+	~output_channel_t( );
+
+	void put( char c ) {
+		m_buffer[m_size++] = c;
+		if( m_size >= m_limit || static_cast<unsigned char>(c) == m_flush_char ) {
+			flush( );
+		}
+	}
+
+	void write( char const * data, size_t size );
+	void flush( );
+
+	void set_sink( output_sink_t sink );
+	void set_policy( flush_policy_t policy );
+	flush_policy_t policy( ) const;
+private:
+	std::array<char, BUFFER_SIZE> m_buffer;
+	size_t m_size;
+	size_t m_limit;
+	int m_flush_char;	// -1 when only a full buffer triggers a flush from put/write
+	flush_policy_t m_policy;
+	output_sink_t m_sink;
+};	// struct output_channel_t
@@ -0,0 +1,115 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <sstream>
+#include <boost/algorithm/string/trim.hpp>
+#include "profiler.h"
+#include "vm.h"
+
+profiler_t::profiler_t( ):
+	m_addresses( ),
+	m_pairs( ),
+	m_previous( OPCODE_COUNT ),
+	m_address( 0 ),
+	m_calls( ),
+	m_running( false ) { }
+
+void profiler_t::start( ) {
+	m_addresses.assign( ADDRESS_COUNT, 0 );
+	m_pairs.assign( (OPCODE_COUNT + 1) * OPCODE_COUNT, 0 );
+	m_previous = OPCODE_COUNT;
+	m_calls.clear( );
+	m_running = true;
+}
+
+void profiler_t::stop( ) {
+	m_running = false;
+}
+
+uint64_t profiler_t::total( ) const {
+	return std::accumulate( m_addresses.begin( ), m_addresses.end( ), uint64_t( 0 ) );
+}
+
+namespace {
+	// Indices of the top largest non zero counts, largest first
+	std::vector<size_t> hottest( std::vector<uint64_t> const & counts, size_t top ) {
+		std::vector<size_t> result;
+		for( size_t n = 0; n < counts.size( ); ++n ) {
+			if( counts[n] != 0 ) {
+				result.push_back( n );
+			}
+		}
+		auto const by_count = [&counts]( size_t lhs, size_t rhs ) {
+			return counts[lhs] != counts[rhs] ? counts[lhs] > counts[rhs] : lhs < rhs;
+		};
+		top = std::min( top, result.size( ) );
+		std::partial_sort( result.begin( ), result.begin( ) + static_cast<ptrdiff_t>(top), result.end( ), by_count );
+		result.resize( top );
+		return result;
+	}
+
+	void show_count( std::ostream & os, uint64_t count, uint64_t total ) {
+		std::stringstream percent;
+		percent << std::fixed << std::setprecision( 2 ) << (100.0 * static_cast<double>(count) / static_cast<double>(total)) << "%";
+		os << std::setw( 12 ) << count << std::setw( 9 ) << percent.str( ) << "  ";
+	}
+}
+
+void profiler_t::report( std::ostream & os, virtual_machine_t & vm, size_t top ) const {
+	auto const instructions = total( );
+	os << "Profiled " << instructions << " instructions\n";
+	if( instructions == 0 ) {
+		return;
+	}
+	auto const & decoder = instructions::decoder( );
+
+	os << "Hottest addresses\n";
+	for( auto address : hottest( m_addresses, top ) ) {
+		show_count( os, m_addresses[address], instructions );
+		auto const from = static_cast<uint16_t>(address);
+		os << boost::algorithm::trim_right_copy( dump_memory( vm, from, static_cast<uint16_t>(from + 1) ) ) << "\n";
+	}
+
+	os << "Opcodes\n";
+	std::vector<uint64_t> op_codes( OPCODE_COUNT );
+	for( size_t n = 0; n < m_pairs.size( ); ++n ) {
+		op_codes[n % OPCODE_COUNT] += m_pairs[n];
+	}
+	for( auto op_code : hottest( op_codes, OPCODE_COUNT ) ) {
+		show_count( os, op_codes[op_code], instructions );
+		os << decoder[op_code].name << "\n";
+	}
+
+	os << "Hottest opcode pairs\n";
+	std::vector<uint64_t> pairs( m_pairs.begin( ), m_pairs.begin( ) + OPCODE_COUNT * OPCODE_COUNT );
+	for( auto pair : hottest( pairs, top ) ) {
+		show_count( os, pairs[pair], instructions );
+		os << decoder[pair / OPCODE_COUNT].name << " -> " << decoder[pair % OPCODE_COUNT].name << "\n";
+	}
+
+	m_calls.report( os, top );
+}
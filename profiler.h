@@ -0,0 +1,90 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <vector>
+#include "call_graph.h"
+
+struct virtual_machine_t;
+
+// Counts the instructions executed by tick per address, per opcode and per pair of
+// consecutive opcodes, and per function with call_graph_t.  Counting is a few increments
+// into flat arrays, so a whole run can be profiled.  The faster engines fall back to tick
+// while it is running
+struct profiler_t final {
+	static size_t const OPCODE_COUNT = 22;
+	static size_t const ADDRESS_COUNT = 32768;
+	static uint16_t const CALL = 17;
+	static uint16_t const RET = 18;
+
+	profiler_t( );
+
+	// Starting clears the counts of a previous run
+	void start( );
+	void stop( );
+
+	bool is_running( ) const {
+		return m_running;
+	}
+
+	// Before the instruction at address executes
+	void count( uint16_t address, uint16_t op_code ) {
+		++m_addresses[address & (ADDRESS_COUNT - 1)];
+		++m_pairs[m_previous * OPCODE_COUNT + op_code];
+		m_previous = op_code;
+		m_address = address;
+		m_calls.count( );
+	}
+
+	// After the instruction counted last has executed
+	void on_executed( virtual_machine_t const & vm ) {
+		if( m_previous == CALL ) {
+			m_calls.on_call( vm, m_address );
+		} else if( m_previous == RET ) {
+			m_calls.on_return( vm );
+		}
+	}
+
+	call_graph_t const & calls( ) const {
+		return m_calls;
+	}
+
+	uint64_t total( ) const;
+
+	// The top hottest addresses with their disassembly, every opcode executed, the top
+	// most frequent opcode pairs and the top hottest functions
+	void report( std::ostream & os, virtual_machine_t & vm, size_t top ) const;
+private:
+	std::vector<uint64_t> m_addresses;	// empty until the first start
+	// Row OPCODE_COUNT holds the first instruction counted, that has no predecessor
+	std::vector<uint64_t> m_pairs;
+	uint16_t m_previous;
+	uint16_t m_address;
+	call_graph_t m_calls;
+	bool m_running;
+};	// struct profiler_t
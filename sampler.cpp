@@ -0,0 +1,141 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include "sampler.h"
+#include "vm.h"
+
+sampler_t::sampler_t( ):
+	m_ring( ),
+	m_position( 0 ),
+	m_stopping( false ),
+	m_dropped( 0 ),
+	m_thread( ),
+	m_addresses( virtual_machine_t::MODULO ),
+	m_samples( 0 ),
+	m_depth_total( 0 ),
+	m_depth_max( 0 ) { }
+
+sampler_t::~sampler_t( ) {
+	stop( );
+}
+
+uint64_t sampler_t::position( virtual_machine_t const & vm ) {
+	return vm.instruction_ptr | (static_cast<uint64_t>(vm.program_stack.size( )) << 16);
+}
+
+void sampler_t::start( virtual_machine_t const & vm, std::chrono::microseconds interval ) {
+	stop( );
+	drain( );
+	std::fill( m_addresses.begin( ), m_addresses.end( ), 0 );
+	m_samples = 0;
+	m_depth_total = 0;
+	m_depth_max = 0;
+	m_dropped = 0;
+	m_position = position( vm );
+	m_stopping = false;
+	m_thread = std::thread( [this, interval]( ) { sample( interval ); } );
+}
+
+void sampler_t::stop( ) {
+	if( !m_thread.joinable( ) ) {
+		return;
+	}
+	m_stopping = true;
+	m_thread.join( );
+}
+
+void sampler_t::sample( std::chrono::microseconds interval ) {
+	auto next = std::chrono::steady_clock::now( );
+	while( !m_stopping ) {
+		next += interval;
+		std::this_thread::sleep_until( next );
+		if( !m_ring.try_push( m_position.load( std::memory_order_relaxed ) ) ) {
+			++m_dropped;
+		}
+	}
+}
+
+void sampler_t::drain( ) {
+	uint64_t batch[256];
+	size_t count;
+	while( (count = m_ring.try_pop( batch, 256 )) > 0 ) {
+		for( size_t n = 0; n < count; ++n ) {
+			auto const depth = batch[n] >> 16;
+			++m_addresses[batch[n] & (virtual_machine_t::MODULO - 1)];
+			m_depth_total += depth;
+			m_depth_max = std::max( m_depth_max, depth );
+		}
+		m_samples += count;
+	}
+}
+
+void sampler_t::report( std::ostream & os, size_t range_words, size_t top ) {
+	drain( );
+	os << "Sampled " << m_samples << " times";
+	if( m_dropped != 0 ) {
+		os << ", " << m_dropped << " samples dropped";
+	}
+	os << "\n";
+	if( m_samples == 0 ) {
+		return;
+	}
+	os << "Program stack depth mean " << (m_depth_total / m_samples) << " max " << m_depth_max << "\n";
+
+	range_words = std::max( range_words, size_t( 1 ) );
+	struct range_t {
+		size_t first;
+		uint64_t samples;
+		size_t hottest;	// address with the most samples in the range
+	};	// struct range_t
+	std::vector<range_t> ranges;
+	for( size_t first = 0; first < m_addresses.size( ); first += range_words ) {
+		auto const last = std::min( first + range_words, m_addresses.size( ) );
+		range_t range{ first, 0, first };
+		for( auto address = first; address < last; ++address ) {
+			range.samples += m_addresses[address];
+			if( m_addresses[address] > m_addresses[range.hottest] ) {
+				range.hottest = address;
+			}
+		}
+		if( range.samples != 0 ) {
+			ranges.push_back( range );
+		}
+	}
+	top = std::min( top, ranges.size( ) );
+	std::partial_sort( ranges.begin( ), ranges.begin( ) + static_cast<ptrdiff_t>(top), ranges.end( ), []( range_t const & lhs, range_t const & rhs ) {
+		return lhs.samples != rhs.samples ? lhs.samples > rhs.samples : lhs.first < rhs.first;
+	} );
+	os << "Hottest address ranges\n";
+	for( size_t n = 0; n < top; ++n ) {
+		auto const & range = ranges[n];
+		std::stringstream percent;
+		percent << std::fixed << std::setprecision( 2 ) << (100.0 * static_cast<double>(range.samples) / static_cast<double>(m_samples)) << "%";
+		os << std::setw( 12 ) << range.samples << std::setw( 9 ) << percent.str( ) << "  ";
+		os << range.first << "-" << (std::min( range.first + range_words, m_addresses.size( ) ) - 1);
+		os << ", most at " << range.hottest << "\n";
+	}
+}
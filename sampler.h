@@ -0,0 +1,83 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <thread>
+#include <vector>
+#include "spsc_ring.h"
+
+struct virtual_machine_t;
+
+// Samples where the vm is on a wall clock timer without slowing any engine down.  The
+// engines keep the instruction pointer to themselves while they run, so the vm's thread
+// publishes its position between slices of SLICE instructions and a sampler thread queues
+// the last published position every interval.  A sample is therefore late by less than
+// a slice, and time spent in a slice, such as waiting for input, draws samples to it
+struct sampler_t final {
+	static size_t const RING_SIZE = 1u << 16;
+	static uint64_t const SLICE = 1u << 14;	// instructions to run between calls to publish
+
+	sampler_t( );
+	sampler_t( sampler_t const & ) = delete;
+	sampler_t & operator=( sampler_t const & ) = delete;
+	~sampler_t( );
+
+	// Clears the samples of a previous run
+	void start( virtual_machine_t const & vm, std::chrono::microseconds interval );
+	void stop( );
+	bool is_running( ) const {
+		return m_thread.joinable( );
+	}
+
+	// From the vm's thread between slices, also takes in what has been sampled
+	void publish( virtual_machine_t const & vm ) {
+		m_position.store( position( vm ), std::memory_order_relaxed );
+		if( !m_ring.empty( ) ) {
+			drain( );
+		}
+	}
+
+	// The top address ranges, of range_words words, with the most samples
+	void report( std::ostream & os, size_t range_words, size_t top );
+private:
+	// The instruction pointer in the low 16 bits and the program stack depth above
+	static uint64_t position( virtual_machine_t const & vm );
+	void sample( std::chrono::microseconds interval );
+	void drain( );
+
+	spsc_ring_t<uint64_t, RING_SIZE> m_ring;
+	std::atomic<uint64_t> m_position;
+	std::atomic<bool> m_stopping;
+	std::atomic<uint64_t> m_dropped;	// samples the ring had no room for
+	std::thread m_thread;
+	std::vector<uint64_t> m_addresses;
+	uint64_t m_samples;
+	uint64_t m_depth_total;
+	uint64_t m_depth_max;
+};	// struct sampler_t
@@ -0,0 +1,76 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+// Bounded lock free queue for exactly one producer thread and one consumer thread.  head
+// and tail only ever grow, their difference is the number of items queued
+template<typename T, size_t CAPACITY>
+struct spsc_ring_t final {
+	static_assert( (CAPACITY & (CAPACITY - 1)) == 0, "CAPACITY must be a power of two" );
+
+	spsc_ring_t( ): m_head( 0 ), m_tail_cache( 0 ), m_tail( 0 ), m_items( new T[CAPACITY] ) { }
+	spsc_ring_t( spsc_ring_t const & ) = delete;
+	spsc_ring_t & operator=( spsc_ring_t const & ) = delete;
+
+	// Producer only.  false when full
+	bool try_push( T const & value ) {
+		auto const head = m_head.load( std::memory_order_relaxed );
+		if( head - m_tail_cache == CAPACITY ) {
+			m_tail_cache = m_tail.load( std::memory_order_acquire );
+			if( head - m_tail_cache == CAPACITY ) {
+				return false;
+			}
+		}
+		m_items[head & (CAPACITY - 1)] = value;
+		m_head.store( head + 1, std::memory_order_release );
+		return true;
+	}
+
+	// Consumer only.  Moves up to count items to result and returns how many
+	size_t try_pop( T * result, size_t count ) {
+		auto const tail = m_tail.load( std::memory_order_relaxed );
+		auto const available = std::min( m_head.load( std::memory_order_acquire ) - tail, count );
+		for( size_t n = 0; n < available; ++n ) {
+			result[n] = m_items[(tail + n) & (CAPACITY - 1)];
+		}
+		m_tail.store( tail + available, std::memory_order_release );
+		return available;
+	}
+
+	bool empty( ) const {
+		return m_head.load( std::memory_order_acquire ) == m_tail.load( std::memory_order_acquire );
+	}
+private:
+	// Producer and consumer side are kept on separate cache lines
+	std::atomic<size_t> m_head;
+	size_t m_tail_cache;	// producer's last look at m_tail
+	char m_padding[64];
+	std::atomic<size_t> m_tail;
+	std::unique_ptr<T[]> m_items;
+};	// struct spsc_ring_t
@@ -0,0 +1,320 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <sstream>
+#include "state_container.h"
+#include "vm.h"
+
+namespace state_container {
+	namespace {
+		size_t const MIN_MATCH = 4;
+		size_t const MIN_PACKED = 4;
+		size_t const MAX_LITERALS = 0x3FFF;
+		size_t const MAX_MATCH = 0x7FFF;
+		uint16_t const MATCH_FLAG = 0x8000;
+		uint16_t const PACKED_FLAG = 0x4000;
+		size_t const HASH_BITS = 12;
+
+		template<typename... Args>
+		[[noreturn]] void container_error( Args const & ... args ) {
+			std::stringstream ss;
+			using expander = int[];
+			(void)expander { 0, ((ss << args), 0)... };
+			throw vm_exit_t( EXIT_FAILURE, ss.str( ) );
+		}
+
+		size_t hash( uint16_t const * data ) {
+			uint32_t const value = (static_cast<uint32_t>(data[0]) << 16 | data[1]) ^ (static_cast<uint32_t>(data[2]) * 0x9E3779B1u);
+			return (value * 2654435761u) >> (32 - HASH_BITS);
+		}
+
+		bool is_byte( uint16_t value ) {
+			return value < 0x100;
+		}
+
+		void emit_words( uint16_t const * first, uint16_t const * last, std::vector<uint16_t> & result ) {
+			while( first != last ) {
+				auto const count = std::min( static_cast<size_t>(last - first), MAX_LITERALS );
+				result.push_back( static_cast<uint16_t>(count) );
+				result.insert( result.end( ), first, first + count );
+				first += count;
+			}
+		}
+
+		void emit_bytes( uint16_t const * first, uint16_t const * last, std::vector<uint16_t> & result ) {
+			while( first != last ) {
+				auto const count = std::min( static_cast<size_t>(last - first), MAX_LITERALS );
+				result.push_back( static_cast<uint16_t>(PACKED_FLAG | count) );
+				for( size_t n = 0; n < count; n += 2 ) {
+					result.push_back( static_cast<uint16_t>(first[n] | (n + 1 < count ? first[n + 1] << 8 : 0)) );
+				}
+				first += count;
+			}
+		}
+
+		// Text is stored a character per word, so runs of values below 0x100 are packed two
+		// to a word
+		void emit_literals( uint16_t const * first, uint16_t const * last, std::vector<uint16_t> & result ) {
+			auto words = first;
+			while( first != last ) {
+				auto const bytes = std::find_if_not( first, last, is_byte );
+				if( bytes - first >= static_cast<ptrdiff_t>(MIN_PACKED) ) {
+					emit_words( words, first, result );
+					emit_bytes( first, bytes, result );
+					words = bytes;
+				}
+				first = bytes == last ? last : bytes + 1;
+			}
+			emit_words( words, last, result );
+		}
+
+		void put32( std::vector<uint16_t> & result, size_t pos, uint32_t value ) {
+			result[pos] = static_cast<uint16_t>(value);
+			result[pos + 1] = static_cast<uint16_t>(value >> 16);
+		}
+
+		uint32_t get32( uint16_t const * data ) {
+			return static_cast<uint32_t>(data[0]) | static_cast<uint32_t>(data[1]) << 16;
+		}
+	}	// namespace anonymous
+
+	uint32_t checksum( uint16_t const * data, size_t size ) {
+		// FNV-1a over the words
+		uint32_t result = 2166136261u;
+		for( size_t n = 0; n < size; ++n ) {
+			result = (result ^ data[n]) * 16777619u;
+		}
+		return result;
+	}
+
+	void compress_block( uint16_t const * data, size_t size, std::vector<uint16_t> & result ) {
+		std::array<int32_t, 1u << HASH_BITS> last_seen;
+		last_seen.fill( -1 );
+		size_t literal_start = 0;
+		size_t pos = 0;
+		while( pos + MIN_MATCH <= size ) {
+			auto & candidate = last_seen[hash( data + pos )];
+			auto const match = candidate;
+			candidate = static_cast<int32_t>(pos);
+			if( match < 0 || !std::equal( data + pos, data + pos + MIN_MATCH, data + match ) ) {
+				++pos;
+				continue;
+			}
+			size_t length = MIN_MATCH;
+			while( pos + length < size && length < MAX_MATCH && data[match + length] == data[pos + length] ) {
+				++length;
+			}
+			emit_literals( data + literal_start, data + pos, result );
+			result.push_back( static_cast<uint16_t>(MATCH_FLAG | length) );
+			result.push_back( static_cast<uint16_t>(pos - match) );
+			pos += length;
+			literal_start = pos;
+		}
+		emit_literals( data + literal_start, data + size, result );
+	}
+
+	bool decompress_block( uint16_t const * data, size_t size, uint16_t * result, size_t result_size ) {
+		auto const data_end = data + size;
+		size_t pos = 0;
+		while( data != data_end ) {
+			auto const control = *data++;
+			if( (control & (MATCH_FLAG | PACKED_FLAG)) == 0 ) {
+				if( control > static_cast<size_t>(data_end - data) || control > result_size - pos ) {
+					return false;
+				}
+				std::copy( data, data + control, result + pos );
+				data += control;
+				pos += control;
+				continue;
+			}
+			if( (control & MATCH_FLAG) == 0 ) {
+				size_t const count = control & MAX_LITERALS;
+				if( (count + 1) / 2 > static_cast<size_t>(data_end - data) || count > result_size - pos ) {
+					return false;
+				}
+				for( size_t n = 0; n < count; ++n ) {
+					result[pos++] = static_cast<uint16_t>(data[n / 2] >> (8 * (n % 2)) & 0xFF);
+				}
+				data += (count + 1) / 2;
+				continue;
+			}
+			size_t const length = control & MAX_MATCH;
+			if( data == data_end ) {
+				return false;
+			}
+			size_t const distance = *data++;
+			if( distance == 0 || distance > pos || length > result_size - pos ) {
+				return false;
+			}
+			// Word by word as the match may overlap what it is copying
+			for( size_t n = 0; n < length; ++n, ++pos ) {
+				result[pos] = result[pos - distance];
+			}
+		}
+		return pos == result_size;
+	}
+
+	void write( boost::string_ref filename, std::vector<section_t> const & sections ) {
+		std::vector<uint16_t> header( HEADER_WORDS + sections.size( ) * SECTION_ENTRY_WORDS );
+		std::vector<std::vector<uint16_t>> blocks;
+		std::vector<uint16_t> indices;
+		size_t offset = header.size( );
+		for( auto const & section : sections ) {
+			auto const block_count = (section.data.size( ) + BLOCK_WORDS - 1) / BLOCK_WORDS;
+			for( size_t n = 0; n < block_count; ++n ) {
+				auto const first = n * BLOCK_WORDS;
+				blocks.emplace_back( );
+				compress_block( section.data.data( ) + first, std::min( BLOCK_WORDS, section.data.size( ) - first ), blocks.back( ) );
+			}
+			offset += 3 * block_count;
+		}
+		// Blocks follow all of the block indices, work out where each one lands
+		size_t block = 0;
+		size_t index_offset = header.size( );
+		for( size_t s = 0; s < sections.size( ); ++s ) {
+			auto const & section = sections[s];
+			auto const block_count = (section.data.size( ) + BLOCK_WORDS - 1) / BLOCK_WORDS;
+			auto const entry = HEADER_WORDS + s * SECTION_ENTRY_WORDS;
+			header[entry] = static_cast<uint16_t>(section.id);
+			put32( header, entry + 1, static_cast<uint32_t>(section.data.size( )) );
+			header[entry + 3] = static_cast<uint16_t>(block_count);
+			put32( header, entry + 4, static_cast<uint32_t>(index_offset) );
+			put32( header, entry + 6, checksum( section.data.data( ), section.data.size( ) ) );
+			for( size_t n = 0; n < block_count; ++n, ++block ) {
+				indices.resize( indices.size( ) + 3 );
+				put32( indices, indices.size( ) - 3, static_cast<uint32_t>(offset) );
+				indices.back( ) = static_cast<uint16_t>(blocks[block].size( ));
+				offset += blocks[block].size( );
+			}
+			index_offset += 3 * block_count;
+		}
+		header[0] = CONTAINER_MAGIC;
+		header[1] = CONTAINER_VERSION;
+		header[2] = static_cast<uint16_t>(sections.size( ));
+		put32( header, 3, 0 );
+		put32( header, 3, checksum( header.data( ), header.size( ) ) );
+
+		FileAsContainer<uint16_t> f( filename, offset, 0, true );
+		if( !f ) {
+			container_error( "Error opening file: ", filename );
+		}
+		auto output_position = std::copy( header.begin( ), header.end( ), f.begin( ) );
+		output_position = std::copy( indices.begin( ), indices.end( ), output_position );
+		for( auto const & data : blocks ) {
+			output_position = std::copy( data.begin( ), data.end( ), output_position );
+		}
+		f.close( );
+	}
+
+	reader_t::reader_t( boost::string_ref filename ):
+		m_filename( filename.to_string( ) ),
+		m_file( filename ),
+		m_entries( ) {
+
+		if( !m_file ) {
+			container_error( "Error opening file: ", filename );
+		}
+		auto const data = m_file.begin( );
+		if( !is_container( data, m_file.size( ) ) ) {
+			container_error( "Not a container file: ", filename );
+		}
+		size_t const section_count = data[2];
+		auto const header_size = HEADER_WORDS + section_count * SECTION_ENTRY_WORDS;
+		if( m_file.size( ) < header_size ) {
+			container_error( "Truncated container file: ", filename );
+		}
+		std::vector<uint16_t> header( data, data + header_size );
+		put32( header, 3, 0 );
+		if( checksum( header.data( ), header.size( ) ) != get32( data + 3 ) ) {
+			container_error( "Corrupt section table in container file: ", filename );
+		}
+		for( size_t s = 0; s < section_count; ++s ) {
+			auto const entry = data + HEADER_WORDS + s * SECTION_ENTRY_WORDS;
+			entry_t item{ static_cast<section_id_t>(entry[0]), get32( entry + 1 ), entry[3], get32( entry + 4 ), get32( entry + 6 ) };
+			if( item.block_count != (item.size + BLOCK_WORDS - 1) / BLOCK_WORDS || item.block_index > m_file.size( ) || m_file.size( ) - item.block_index < 3 * item.block_count ) {
+				container_error( "Corrupt section table in container file: ", filename );
+			}
+			m_entries.push_back( item );
+		}
+	}
+
+	bool reader_t::has_section( section_id_t id ) const {
+		return std::any_of( m_entries.begin( ), m_entries.end( ), [id]( auto const & entry ) { return entry.id == id; } );
+	}
+
+	size_t reader_t::section_size( section_id_t id ) const {
+		return find( id ).size;
+	}
+
+	std::vector<uint16_t> reader_t::read( section_id_t id ) const {
+		auto const & entry = find( id );
+		std::vector<uint16_t> result( entry.size );
+		for( size_t n = 0; n < entry.block_count; ++n ) {
+			read_block( entry, n, result.data( ) + n * BLOCK_WORDS );
+		}
+		if( checksum( result.data( ), result.size( ) ) != entry.checksum ) {
+			container_error( "Checksum mismatch in section ", static_cast<uint16_t>(id), " of container file: ", m_filename );
+		}
+		return result;
+	}
+
+	std::vector<uint16_t> reader_t::read( section_id_t id, size_t first, size_t count ) const {
+		auto const & entry = find( id );
+		if( first > entry.size || count > entry.size - first ) {
+			container_error( "Read past the end of section ", static_cast<uint16_t>(id), " of container file: ", m_filename );
+		}
+		std::vector<uint16_t> result;
+		result.reserve( count );
+		std::array<uint16_t, BLOCK_WORDS> block;
+		for( auto n = first / BLOCK_WORDS; result.size( ) < count; ++n ) {
+			read_block( entry, n, block.data( ) );
+			auto const block_first = n * BLOCK_WORDS;
+			auto const from = std::max( first, block_first ) - block_first;
+			auto const to = std::min( first + count - block_first, std::min( BLOCK_WORDS, entry.size - block_first ) );
+			result.insert( result.end( ), block.begin( ) + from, block.begin( ) + to );
+		}
+		return result;
+	}
+
+	reader_t::entry_t const & reader_t::find( section_id_t id ) const {
+		auto it = std::find_if( m_entries.begin( ), m_entries.end( ), [id]( auto const & entry ) { return entry.id == id; } );
+		if( m_entries.end( ) == it ) {
+			container_error( "Missing section ", static_cast<uint16_t>(id), " in container file: ", m_filename );
+		}
+		return *it;
+	}
+
+	void reader_t::read_block( entry_t const & entry, size_t block, uint16_t * result ) const {
+		auto const index = m_file.begin( ) + entry.block_index + 3 * block;
+		size_t const offset = get32( index );
+		size_t const size = index[2];
+		auto const result_size = std::min( BLOCK_WORDS, entry.size - block * BLOCK_WORDS );
+		if( offset > m_file.size( ) || size > m_file.size( ) - offset || !decompress_block( m_file.begin( ) + offset, size, result, result_size ) ) {
+			container_error( "Corrupt block ", block, " in section ", static_cast<uint16_t>(entry.id), " of container file: ", m_filename );
+		}
+	}
+}	// namespace state_container
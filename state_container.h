@@ -0,0 +1,104 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+#include <boost/utility/string_ref.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "file_helper.h"
+
+// A container file holds numbered sections of uint16_t's, each compressed in blocks of
+// BLOCK_WORDS so that part of a section can be read without decompressing the rest.
+// Format of file in uint16_t's, 32bit values are stored low half first
+// 0 -> CONTAINER_MAGIC, an invalid op code so no runnable image starts with it
+// 1 -> CONTAINER_VERSION
+// 2 -> number of sections
+// 3->4 -> checksum of items 0->2 and the section table
+// 5->5+[2]*SECTION_ENTRY_WORDS -> section table, each entry is
+//	id, size (32bit), number of blocks, offset of block index (32bit), checksum of data (32bit)
+// A block index has the offset (32bit) and compressed size of each block in the section
+namespace state_container {
+	uint16_t const CONTAINER_MAGIC = 0xFFFE;
+	uint16_t const CONTAINER_VERSION = 1;
+	size_t const HEADER_WORDS = 5;
+	size_t const SECTION_ENTRY_WORDS = 8;
+	size_t const BLOCK_WORDS = 4096;
+
+	enum class section_id_t: uint16_t { memory = 1, registers = 2, program_stack = 3, argument_stack = 4 };
+
+	struct section_t {
+		section_id_t id;
+		std::vector<uint16_t> data;
+	};	// struct section_t
+
+	inline bool is_container( uint16_t const * data, size_t size ) {
+		return size >= HEADER_WORDS && data[0] == CONTAINER_MAGIC && data[1] == CONTAINER_VERSION;
+	}
+
+	inline bool is_container( ReadOnlyFileAsContainer<uint16_t> const & f ) {
+		return is_container( f.begin( ), f.size( ) );
+	}
+
+	uint32_t checksum( uint16_t const * data, size_t size );
+
+	// A block is a series of runs, each starting with a control word.  Below 0x4000 it is the
+	// number of literal words that follow, below 0x8000 it is 0x4000 + the number of literal
+	// words below 0x100 that follow packed two to a word, low byte first.  Otherwise it is
+	// 0x8000 + the length of a match followed by how far back in the output the match starts.
+	// Matches may overlap the words they copy so a run of one value costs a literal and a match
+	void compress_block( uint16_t const * data, size_t size, std::vector<uint16_t> & result );
+	// false if the block is malformed or does not decompress to exactly size words
+	bool decompress_block( uint16_t const * data, size_t size, uint16_t * result, size_t result_size );
+
+	void write( boost::string_ref filename, std::vector<section_t> const & sections );
+
+	// Reads sections out of a mapped container file.  Errors are thrown as vm_exit_t
+	struct reader_t final {
+		explicit reader_t( boost::string_ref filename );
+
+		bool has_section( section_id_t id ) const;
+		size_t section_size( section_id_t id ) const;
+		// Whole section, verified against its checksum
+		std::vector<uint16_t> read( section_id_t id ) const;
+		// count words from first on, decompressing only the blocks they are in
+		std::vector<uint16_t> read( section_id_t id, size_t first, size_t count ) const;
+	private:
+		struct entry_t {
+			section_id_t id;
+			size_t size;
+			size_t block_count;
+			size_t block_index;
+			uint32_t checksum;
+		};	// struct entry_t
+
+		entry_t const & find( section_id_t id ) const;
+		void read_block( entry_t const & entry, size_t block, uint16_t * result ) const;
+
+		std::string m_filename;
+		ReadOnlyFileAsContainer<uint16_t> m_file;
+		std::vector<entry_t> m_entries;
+	};	// struct reader_t
+}	// namespace state_container
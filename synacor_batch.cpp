@@ -0,0 +1,107 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <thread>
+#include <vector>
+#include "batch.h"
+#include "engine.h"
+
+int main( int argc, char** argv ) {
+	engine_t engine = engine_t::threaded;
+	size_t thread_count = std::max( 1u, std::thread::hardware_concurrency( ) );
+	uint64_t max_instructions = std::numeric_limits<uint64_t>::max( );
+	std::string output_dir;
+	bool compress = false;
+	std::vector<std::string> files;
+	for( int n = 1; n < argc; ++n ) {
+		std::string const arg = argv[n];
+		if( arg.compare( 0, 9, "--engine=" ) == 0 ) {
+			engine = engine_from_string( arg.substr( 9 ) );
+		} else if( arg.compare( 0, 10, "--threads=" ) == 0 ) {
+			thread_count = std::max( static_cast<size_t>(1), static_cast<size_t>(std::stoul( arg.substr( 10 ) )) );
+		} else if( arg.compare( 0, 6, "--max=" ) == 0 ) {
+			max_instructions = std::stoull( arg.substr( 6 ) );
+		} else if( arg.compare( 0, 13, "--output_dir=" ) == 0 ) {
+			output_dir = arg.substr( 13 );
+		} else if( arg == "--compress" ) {
+			compress = true;
+		} else {
+			files.push_back( arg );
+		}
+	}
+	if( files.empty( ) || files.size( ) % 2 != 0 ) {
+		std::cerr << "Must supply pairs of a vm file and an input script" << std::endl;
+		std::cerr << "Usage: " << argv[0] << " [--engine=tick|threaded|jit] [--threads=<count>] [--max=<instructions>] [--output_dir=<directory>] [--compress] <vm file> <script> [<vm file> <script>...]" << std::endl;
+		exit( EXIT_FAILURE );
+	}
+
+	std::vector<batch_session_t> sessions;
+	for( size_t n = 0; n < files.size( ); n += 2 ) {
+		sessions.emplace_back( files[n], files[n + 1] );
+	}
+	run_batch( sessions, engine, thread_count, max_instructions );
+
+	// With an output directory each session n leaves session_<n>.txt with its output and
+	// session_<n>.bin with its final state, as a compressed container with --compress
+	int result = EXIT_SUCCESS;
+	for( size_t n = 0; n < sessions.size( ); ++n ) {
+		auto & session = sessions[n];
+		if( !output_dir.empty( ) ) {
+			auto const name = output_dir + "/session_" + std::to_string( n );
+			std::ofstream output( name + ".txt", std::ios::binary );
+			if( !output ) {
+				std::cerr << "Error opening file: " << name << ".txt" << std::endl;
+				exit( EXIT_FAILURE );
+			}
+			output << session.output;
+			if( session.vm ) {
+				try {
+					if( compress ) {
+						session.vm->save_compressed_state( name + ".bin" );
+					} else {
+						session.vm->save_state( name + ".bin" );
+					}
+				} catch( vm_exit_t const & e ) {
+					e.report( );
+					exit( EXIT_FAILURE );
+				}
+			}
+		}
+		std::cout << "session " << n << ": " << session.vm_file << " " << session.script_file << " exit " << session.exit_code << " output " << session.output.size( ) << " bytes";
+		if( !session.error.empty( ) ) {
+			std::cout << " error: " << session.error;
+		}
+		std::cout << "\n";
+		if( session.exit_code != EXIT_SUCCESS ) {
+			result = EXIT_FAILURE;
+		}
+	}
+	return result;
+}
@@ -0,0 +1,391 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+#include <boost/filesystem.hpp>
+#include "engine.h"
+#include "vm.h"
+
+// Times the vm's engines on single opcodes and on whole sessions, and the formatting and
+// state files around them, and writes the results as JSON.  Each benchmark runs a fixed
+// amount of work --repeat times, the best and median times are reported
+namespace {
+	struct result_t {
+		std::string name;
+		std::string engine;	// empty when no engine is involved
+		std::string unit;	// what count counts
+		uint64_t count;	// per repetition
+		std::vector<double> seconds;
+	};	// struct result_t
+
+	struct options_t {
+		std::vector<engine_t> engines;
+		size_t repeat;
+		std::string filter;
+		std::string data_dir;
+		uint64_t teleporter_instructions;
+		options_t( ): engines( { engine_t::tick, engine_t::threaded, engine_t::jit } ), repeat( 5 ), filter( ), data_dir( "." ), teleporter_instructions( 1u << 26 ) { }
+	};	// struct options_t
+
+	using clock_t = std::chrono::steady_clock;
+
+	double seconds_since( clock_t::time_point start ) {
+		return std::chrono::duration<double>( clock_t::now( ) - start ).count( );
+	}
+
+	std::string data_file( options_t const & options, std::string const & name ) {
+		return (boost::filesystem::path( options.data_dir ) / name).string( );
+	}
+
+	// Names starting with the filter, or groups the filter starts with, are run
+	bool is_selected( options_t const & options, std::string const & name ) {
+		return name.compare( 0, options.filter.size( ), options.filter ) == 0 || options.filter.compare( 0, name.size( ), name ) == 0;
+	}
+
+	// run is timed repeat times after one untimed warm up, each after an untimed prepare
+	result_t measure( options_t const & options, std::string name, std::string engine, std::string unit, uint64_t count, std::function<void( )> const & run, std::function<void( )> const & prepare = [] { } ) {
+		result_t result{ std::move( name ), std::move( engine ), std::move( unit ), count, { } };
+		prepare( );
+		run( );
+		for( size_t n = 0; n < options.repeat; ++n ) {
+			prepare( );
+			auto const start = clock_t::now( );
+			run( );
+			result.seconds.push_back( seconds_since( start ) );
+		}
+		return result;
+	}
+
+	// Runs until the vm exits or max_instructions have run
+	void run_to_exit( virtual_machine_t & vm, engine_t engine, uint64_t max_instructions ) {
+		try {
+			uint64_t count = 0;
+			while( count < max_instructions ) {
+				count += run_engine( vm, engine, std::min( static_cast<uint64_t>(1u << 16), max_instructions - count ) );
+			}
+		} catch( vm_exit_t const & ) { }
+	}
+
+	// The instructions a session runs, counted one tick at a time
+	uint64_t count_instructions( std::function<std::unique_ptr<virtual_machine_t>( )> const & make_vm, uint64_t max_instructions ) {
+		auto vm = make_vm( );
+		uint64_t count = 0;
+		try {
+			while( count < max_instructions ) {
+				vm->tick( );
+				++count;
+			}
+		} catch( vm_exit_t const & ) { }
+		return count;
+	}
+
+	// A loop of LOOP_LENGTH copies of one instruction closed by a JMP.  Operands use R0 as
+	// the destination and R1 and R2, never 0, as sources
+	struct opcode_loop_t {
+		std::string name;
+		std::vector<uint16_t> body;	// one or more instructions repeated to fill the loop
+	};	// struct opcode_loop_t
+
+	size_t const LOOP_LENGTH = 64;
+	uint16_t const R0 = virtual_machine_t::REGISTER0;
+	uint16_t const R1 = virtual_machine_t::REGISTER0 + 1;
+	uint16_t const R2 = virtual_machine_t::REGISTER0 + 2;
+	uint16_t const DATA_ADDRESS = 20000;	// away from the code so writes invalidate nothing
+	uint16_t const SUBROUTINE_ADDRESS = 16000;
+	uint16_t const NEXT = 0xFFFF;	// replaced by the address after the instruction
+
+	std::vector<opcode_loop_t> opcode_loops( ) {
+		return {
+			{ "set", { 1, R0, R1 } },
+			{ "push_pop", { 2, R1, 3, R0 } },
+			{ "eq", { 4, R0, R1, R2 } },
+			{ "gt", { 5, R0, R1, R2 } },
+			{ "jmp", { 6, NEXT } },
+			{ "jt", { 7, R1, NEXT } },
+			{ "jf", { 8, R1, NEXT } },
+			{ "add", { 9, R0, R1, R2 } },
+			{ "mult", { 10, R0, R1, R2 } },
+			{ "mod", { 11, R0, R1, R2 } },
+			{ "and", { 12, R0, R1, R2 } },
+			{ "or", { 13, R0, R1, R2 } },
+			{ "not", { 14, R0, R1 } },
+			{ "rmem", { 15, R0, DATA_ADDRESS } },
+			{ "wmem", { 16, DATA_ADDRESS, R1 } },
+			{ "call_ret", { 17, SUBROUTINE_ADDRESS } },
+			{ "out", { 19, 'x' } },
+			{ "noop", { 21 } }
+		};
+	}
+
+	std::unique_ptr<virtual_machine_t> make_opcode_vm( opcode_loop_t const & loop ) {
+		std::unique_ptr<virtual_machine_t> vm( new virtual_machine_t( ) );
+		vm->output.set_sink( null_sink( ) );
+		uint16_t address = 0;
+		while( address < LOOP_LENGTH ) {
+			auto const first = address;
+			for( auto word : loop.body ) {
+				vm->memory[address++] = word;
+			}
+			for( auto n = first; n < address; ++n ) {
+				if( vm->memory[n] == NEXT ) {
+					vm->memory[n] = address;
+				}
+			}
+		}
+		vm->memory[address++] = 6;	// JMP 0
+		vm->memory[address] = 0;
+		vm->memory[SUBROUTINE_ADDRESS] = 18;	// RET
+		vm->registers[1] = 12345;
+		vm->registers[2] = 7;
+		return vm;
+	}
+
+	void opcode_benchmarks( options_t const & options, std::vector<result_t> & results ) {
+		uint64_t const instructions = 1u << 22;
+		for( auto const & loop : opcode_loops( ) ) {
+			if( !is_selected( options, "opcode/" + loop.name ) ) {
+				continue;
+			}
+			for( auto engine : options.engines ) {
+				auto vm = make_opcode_vm( loop );
+				results.push_back( measure( options, "opcode/" + loop.name, to_string( engine ), "instructions", instructions, [&]( ) {
+					uint64_t count = 0;
+					while( count < instructions ) {
+						count += run_engine( *vm, engine, instructions - count );
+					}
+				} ) );
+			}
+		}
+	}
+
+	std::unique_ptr<virtual_machine_t> make_teleporter_vm( options_t const & options ) {
+		// A non zero eighth register makes the teleporter run its confirmation check
+		std::unique_ptr<virtual_machine_t> vm( new virtual_machine_t( data_file( options, "readytoteleport.bin" ) ) );
+		vm->registers[7] = 1;
+		vm->output.set_sink( null_sink( ) );
+		vm->input.set_readers( { memory_reader( "\nuse teleporter\n" ) } );
+		vm->input.set_exhausted_policy( exhausted_policy_t::halt );
+		return vm;
+	}
+
+	void tick_benchmarks( options_t const & options, std::vector<result_t> & results ) {
+		uint64_t const instructions = 1u << 24;
+		auto vm = make_teleporter_vm( options );
+		results.push_back( measure( options, "tick_dispatch/teleporter", "", "instructions", instructions, [&]( ) {
+			for( uint64_t n = 0; n < instructions; ++n ) {
+				vm->tick( );
+			}
+		} ) );
+	}
+
+	void formatting_benchmarks( options_t const & options, std::vector<result_t> & results ) {
+		virtual_machine_t vm( data_file( options, "challenge.bin" ) );
+		auto const words = static_cast<uint64_t>(vm.memory.size( ));
+		if( is_selected( options, "dump_memory/challenge" ) ) {
+			results.push_back( measure( options, "dump_memory/challenge", "", "words", words, [&]( ) {
+				dump_memory( vm, 0, static_cast<uint16_t>(words) );
+			} ) );
+		}
+		if( !is_selected( options, "to_json/challenge" ) ) {
+			return;
+		}
+
+		auto const & decoder = instructions::decoder( );
+		std::vector<op_t> ops;
+		for( size_t address = 0; address < vm.memory.size( ); ) {
+			auto const op_code = vm.memory[address++];
+			if( !instructions::is_instruction( op_code ) ) {
+				continue;
+			}
+			std::vector<uint16_t> params;
+			for( size_t n = 0; n < decoder[op_code].arg_count && address < vm.memory.size( ); ++n ) {
+				params.push_back( vm.memory[address++] );
+			}
+			ops.emplace_back( op_code, std::move( params ) );
+		}
+		results.push_back( measure( options, "to_json/challenge", "", "ops", ops.size( ), [&]( ) {
+			size_t length = 0;
+			for( auto const & op : ops ) {
+				length += op.to_json( ).size( );
+			}
+			if( length == 0 ) {
+				std::cerr << "No ops formatted\n";
+			}
+		} ) );
+	}
+
+	void state_benchmarks( options_t const & options, std::vector<result_t> & results ) {
+		auto vm = make_teleporter_vm( options );
+		auto const file = (boost::filesystem::temp_directory_path( ) / boost::filesystem::unique_path( "synacor_bench_%%%%%%%%" )).string( );
+		uint64_t const round_trips = 16;
+		results.push_back( measure( options, "state/save_load", "", "round_trips", round_trips, [&]( ) {
+			for( uint64_t n = 0; n < round_trips; ++n ) {
+				vm->save_state( file );
+				vm->load_state( file );
+			}
+		} ) );
+		results.push_back( measure( options, "state/save_load_compressed", "", "round_trips", round_trips, [&]( ) {
+			for( uint64_t n = 0; n < round_trips; ++n ) {
+				vm->save_compressed_state( file );
+				vm->load_state( file );
+			}
+		} ) );
+		boost::system::error_code ec;
+		boost::filesystem::remove( file, ec );
+
+		uint64_t const forks = 256;
+		results.push_back( measure( options, "state/fork", "", "forks", forks, [&]( ) {
+			for( uint64_t n = 0; n < forks; ++n ) {
+				vm->fork( );
+			}
+		} ) );
+	}
+
+	void session_benchmark( options_t const & options, std::vector<result_t> & results, std::string const & name, uint64_t max_instructions, std::function<std::unique_ptr<virtual_machine_t>( )> const & make_vm ) {
+		if( !is_selected( options, name ) ) {
+			return;
+		}
+		auto const instructions = count_instructions( make_vm, max_instructions );
+		for( auto engine : options.engines ) {
+			std::unique_ptr<virtual_machine_t> vm;
+			results.push_back( measure( options, name, to_string( engine ), "instructions", instructions, [&]( ) {
+				run_to_exit( *vm, engine, max_instructions );
+			}, [&]( ) {
+				vm = make_vm( );
+			} ) );
+		}
+	}
+
+	void write_json( std::ostream & os, std::vector<result_t> results ) {
+		bool const is_debug =
+#ifdef DEBUG
+			true;
+#else
+			false;
+#endif
+		os << "{ \"debug\": " << (is_debug ? "true" : "false") << ", \"results\": [";
+		for( size_t n = 0; n < results.size( ); ++n ) {
+			auto & result = results[n];
+			std::sort( result.seconds.begin( ), result.seconds.end( ) );
+			auto const best = result.seconds.empty( ) ? 0.0 : result.seconds.front( );
+			auto const median = result.seconds.empty( ) ? 0.0 : result.seconds[result.seconds.size( ) / 2];
+			os << (n > 0 ? "," : "") << "\n\t{ \"name\": \"" << result.name << "\"";
+			if( !result.engine.empty( ) ) {
+				os << ", \"engine\": \"" << result.engine << "\"";
+			}
+			os << ", \"unit\": \"" << result.unit << "\", \"count\": " << result.count;
+			os << std::setprecision( 6 ) << ", \"best_seconds\": " << best << ", \"median_seconds\": " << median;
+			os << ", \"ns_per_unit\": " << (result.count == 0 ? 0.0 : 1e9 * best / static_cast<double>(result.count)) << " }";
+		}
+		os << "\n] }\n";
+	}
+}
+
+int main( int argc, char** argv ) {
+	options_t options;
+	std::string output_file;
+	for( int n = 1; n < argc; ++n ) {
+		std::string const arg = argv[n];
+		if( arg.compare( 0, 9, "--engine=" ) == 0 ) {
+			options.engines = { engine_from_string( arg.substr( 9 ) ) };
+		} else if( arg.compare( 0, 9, "--repeat=" ) == 0 ) {
+			options.repeat = std::max( static_cast<size_t>(1), static_cast<size_t>(std::stoul( arg.substr( 9 ) )) );
+		} else if( arg.compare( 0, 9, "--filter=" ) == 0 ) {
+			options.filter = arg.substr( 9 );
+		} else if( arg.compare( 0, 13, "--teleporter=" ) == 0 ) {
+			options.teleporter_instructions = std::stoull( arg.substr( 13 ) );
+		} else if( arg.compare( 0, 9, "--output=" ) == 0 ) {
+			output_file = arg.substr( 9 );
+		} else if( arg.compare( 0, 2, "--" ) != 0 ) {
+			options.data_dir = arg;
+		} else {
+			std::cerr << "Unknown option '" << arg << "'" << std::endl;
+			std::cerr << "Usage: " << argv[0] << " [--engine=tick|threaded|jit] [--repeat=<count>] [--filter=<name prefix>] [--teleporter=<instructions>] [--output=<json file>] [<directory with challenge.bin, actions.txt and readytoteleport.bin>]" << std::endl;
+			exit( EXIT_FAILURE );
+		}
+	}
+
+	std::vector<result_t> results;
+	try {
+		if( is_selected( options, "opcode/" ) ) {
+			opcode_benchmarks( options, results );
+		}
+		if( is_selected( options, "tick_dispatch/" ) ) {
+			tick_benchmarks( options, results );
+		}
+		if( is_selected( options, "dump_memory/" ) || is_selected( options, "to_json/" ) ) {
+			formatting_benchmarks( options, results );
+		}
+		if( is_selected( options, "state/" ) ) {
+			state_benchmarks( options, results );
+		}
+		if( is_selected( options, "session/" ) ) {
+			// Up to the first request for input
+			session_benchmark( options, results, "session/self_test", std::numeric_limits<uint64_t>::max( ), [&options]( ) {
+				std::unique_ptr<virtual_machine_t> vm( new virtual_machine_t( data_file( options, "challenge.bin" ) ) );
+				vm->output.set_sink( null_sink( ) );
+				vm->input.set_exhausted_policy( exhausted_policy_t::halt );
+				return vm;
+			} );
+			session_benchmark( options, results, "session/actions", std::numeric_limits<uint64_t>::max( ), [&options]( ) {
+				std::unique_ptr<virtual_machine_t> vm( new virtual_machine_t( data_file( options, "challenge.bin" ) ) );
+				vm->output.set_sink( null_sink( ) );
+				vm->input.set_readers( { file_reader( data_file( options, "actions.txt" ) ) } );
+				vm->input.set_exhausted_policy( exhausted_policy_t::halt );
+				return vm;
+			} );
+			session_benchmark( options, results, "session/teleporter", options.teleporter_instructions, [&options]( ) {
+				return make_teleporter_vm( options );
+			} );
+		}
+	} catch( vm_exit_t const & e ) {
+		exit( e.report( ) );
+	} catch( std::exception const & e ) {
+		std::cerr << e.what( ) << std::endl;
+		exit( EXIT_FAILURE );
+	}
+
+	if( output_file.empty( ) ) {
+		write_json( std::cout, std::move( results ) );
+	} else {
+		std::ofstream out( output_file );
+		if( !out ) {
+			std::cerr << "Error opening file: " << output_file << std::endl;
+			exit( EXIT_FAILURE );
+		}
+		write_json( out, std::move( results ) );
+	}
+	return EXIT_SUCCESS;
+}
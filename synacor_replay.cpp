@@ -0,0 +1,288 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+#include <boost/filesystem.hpp>
+#include "engine.h"
+#include "vm.h"
+
+// Replays input scripts against vm images and checks that every engine produces the
+// same output and final state as recorded in the scenario file, timing each run.  Lines of
+// the scenario file are
+//	<name> <vm file> <script file> <max instructions or 0> <instructions> <output hash> <state hash> [r<n>=<value>...]
+// with files relative to the scenario file and - for goldens not recorded yet.  r<n>=<value>
+// sets register n before the run, as the console would.  --update
+// records them with the tick engine, executing one instruction at a time
+namespace {
+	struct scenario_t {
+		std::string name;
+		std::string vm_file;
+		std::string script_file;
+		uint64_t max_instructions;	// 0 runs until the program halts or input runs out
+		bool has_golden;
+		uint64_t instructions;
+		uint64_t output_hash;
+		uint64_t state_hash;
+		std::vector<std::pair<size_t, uint16_t>> registers;	// set before running
+	};	// struct scenario_t
+
+	struct outcome_t {
+		uint64_t instructions;	// only counted when replaying one instruction at a time
+		uint64_t output_hash;
+		uint64_t state_hash;
+		double seconds;
+	};	// struct outcome_t
+
+	// FNV-1a
+	uint64_t const HASH_START = 14695981039346656037ull;
+
+	template<typename T>
+	void hash_words( uint64_t & hash, T const * words, size_t count ) {
+		auto const * bytes = reinterpret_cast<unsigned char const *>(words);
+		for( size_t n = 0; n < count * sizeof( T ); ++n ) {
+			hash = (hash ^ bytes[n]) * 1099511628211ull;
+		}
+	}
+
+	uint64_t hash_state( virtual_machine_t & vm, int exit_code ) {
+		auto hash = HASH_START;
+		hash_words( hash, &vm.memory[0], vm.memory.size( ) );
+		hash_words( hash, &vm.registers[0], vm.registers.size( ) );
+		hash_words( hash, &vm.instruction_ptr, 1 );
+		auto const stack_size = static_cast<uint64_t>(vm.program_stack.size( ));
+		hash_words( hash, &stack_size, 1 );
+		hash_words( hash, vm.program_stack.data( ), vm.program_stack.size( ) );
+		auto const arguments_size = static_cast<uint64_t>(vm.argument_stack.size( ));
+		hash_words( hash, &arguments_size, 1 );
+		hash_words( hash, vm.argument_stack.data( ), vm.argument_stack.size( ) );
+		hash_words( hash, &exit_code, 1 );
+		return hash;
+	}
+
+	std::string to_hex( uint64_t value ) {
+		std::stringstream ss;
+		ss << std::hex << std::setw( 16 ) << std::setfill( '0' ) << value;
+		return ss.str( );
+	}
+
+	// With is_reference every instruction is ticked and counted
+	outcome_t replay( scenario_t const & scenario, engine_t engine, bool is_reference ) {
+		std::ifstream script( scenario.script_file, std::ios::binary );
+		if( !script ) {
+			throw vm_exit_t( EXIT_FAILURE, "Could not open input file '" + scenario.script_file + "'" );
+		}
+		std::ostringstream text;
+		text << script.rdbuf( );
+
+		outcome_t outcome{ 0, HASH_START, 0, 0.0 };
+		virtual_machine_t vm( scenario.vm_file );
+		for( auto const & reg : scenario.registers ) {
+			vm.registers[reg.first] = reg.second;
+		}
+		vm.output.set_sink( [&outcome]( char const * data, size_t size ) {
+			hash_words( outcome.output_hash, data, size );
+		} );
+		vm.input.set_readers( { memory_reader( text.str( ) ) } );
+		vm.input.set_exhausted_policy( exhausted_policy_t::halt );
+
+		auto const max_instructions = scenario.max_instructions == 0 ? std::numeric_limits<uint64_t>::max( ) : scenario.max_instructions;
+		int exit_code = EXIT_SUCCESS;
+		auto const start = std::chrono::steady_clock::now( );
+		try {
+			uint64_t const slice = 1u << 16;
+			while( outcome.instructions < max_instructions ) {
+				if( is_reference ) {
+					vm.tick( );
+					++outcome.instructions;
+				} else {
+					outcome.instructions += run_engine( vm, engine, std::min( slice, max_instructions - outcome.instructions ) );
+				}
+			}
+		} catch( vm_exit_t const & e ) {
+			exit_code = e.exit_code;
+		}
+		outcome.seconds = std::chrono::duration<double>( std::chrono::steady_clock::now( ) - start ).count( );
+		vm.output.flush( );
+		outcome.state_hash = hash_state( vm, exit_code );
+		return outcome;
+	}
+
+	std::vector<std::string> read_lines( std::string const & filename ) {
+		std::ifstream in( filename );
+		if( !in ) {
+			throw vm_exit_t( EXIT_FAILURE, "Could not open scenario file '" + filename + "'" );
+		}
+		std::vector<std::string> lines;
+		std::string line;
+		while( std::getline( in, line ) ) {
+			lines.push_back( line );
+		}
+		return lines;
+	}
+
+	bool is_scenario( std::string const & line ) {
+		auto const first = line.find_first_not_of( " \t" );
+		return first != std::string::npos && line[first] != '#';
+	}
+
+	scenario_t parse_scenario( std::string const & line, boost::filesystem::path const & directory ) {
+		std::istringstream ss( line );
+		scenario_t scenario{ };
+		std::string instructions, output_hash, state_hash;
+		if( !(ss >> scenario.name >> scenario.vm_file >> scenario.script_file >> scenario.max_instructions >> instructions >> output_hash >> state_hash) ) {
+			throw vm_exit_t( EXIT_FAILURE, "Malformed scenario '" + line + "'" );
+		}
+		scenario.vm_file = (directory / scenario.vm_file).string( );
+		scenario.script_file = (directory / scenario.script_file).string( );
+		scenario.has_golden = instructions != "-";
+		if( scenario.has_golden ) {
+			scenario.instructions = std::stoull( instructions );
+			scenario.output_hash = std::stoull( output_hash, nullptr, 16 );
+			scenario.state_hash = std::stoull( state_hash, nullptr, 16 );
+		}
+		std::string reg;
+		while( ss >> reg ) {
+			if( reg.size( ) < 4 || reg[0] != 'r' || reg[1] < '0' || reg[1] > '7' || reg[2] != '=' ) {
+				throw vm_exit_t( EXIT_FAILURE, "Malformed register '" + reg + "' in scenario '" + line + "'" );
+			}
+			auto const value = std::stoul( reg.substr( 3 ) );
+			if( value >= virtual_machine_t::MODULO ) {
+				throw vm_exit_t( EXIT_FAILURE, "Register value out of range '" + reg + "' in scenario '" + line + "'" );
+			}
+			scenario.registers.emplace_back( static_cast<size_t>(reg[1] - '0'), static_cast<uint16_t>(value) );
+		}
+		return scenario;
+	}
+
+	// The line with its goldens replaced by outcome
+	std::string update_line( std::string const & line, outcome_t const & outcome ) {
+		std::istringstream ss( line );
+		std::string name, vm_file, script_file, max_instructions, instructions, output_hash, state_hash;
+		ss >> name >> vm_file >> script_file >> max_instructions >> instructions >> output_hash >> state_hash;
+		auto result = name + " " + vm_file + " " + script_file + " " + max_instructions + " " + std::to_string( outcome.instructions ) + " " + to_hex( outcome.output_hash ) + " " + to_hex( outcome.state_hash );
+		std::string reg;
+		while( ss >> reg ) {
+			result += " " + reg;
+		}
+		return result;
+	}
+}
+
+int main( int argc, char** argv ) try {
+	std::vector<engine_t> engines;
+	size_t repeat = 1;
+	bool is_update = false;
+	std::string scenario_file;
+	for( int n = 1; n < argc; ++n ) {
+		std::string const arg = argv[n];
+		if( arg.compare( 0, 9, "--engine=" ) == 0 ) {
+			engines.push_back( engine_from_string( arg.substr( 9 ) ) );
+		} else if( arg.compare( 0, 9, "--repeat=" ) == 0 ) {
+			repeat = std::max( static_cast<size_t>(1), static_cast<size_t>(std::stoul( arg.substr( 9 ) )) );
+		} else if( arg == "--update" ) {
+			is_update = true;
+		} else if( arg.compare( 0, 2, "--" ) != 0 && scenario_file.empty( ) ) {
+			scenario_file = arg;
+		} else {
+			scenario_file.clear( );
+			break;
+		}
+	}
+	if( scenario_file.empty( ) ) {
+		std::cerr << "Must supply a scenario file" << std::endl;
+		std::cerr << "Usage: " << argv[0] << " [--engine=tick|threaded|jit...] [--repeat=<count>] [--update] <scenario file>" << std::endl;
+		exit( EXIT_FAILURE );
+	}
+	if( engines.empty( ) ) {
+		engines = { engine_t::tick, engine_t::threaded, engine_t::jit };
+	}
+
+	auto lines = read_lines( scenario_file );
+	auto const directory = boost::filesystem::path( scenario_file ).parent_path( );
+	if( is_update ) {
+		for( auto & line : lines ) {
+			if( is_scenario( line ) ) {
+				auto const scenario = parse_scenario( line, directory );
+				line = update_line( line, replay( scenario, engine_t::tick, true ) );
+				std::cout << "Recorded " << scenario.name << "\n";
+			}
+		}
+		std::ofstream out( scenario_file );
+		for( auto const & line : lines ) {
+			out << line << "\n";
+		}
+		if( !out ) {
+			std::cerr << "Error writing file: " << scenario_file << std::endl;
+			exit( EXIT_FAILURE );
+		}
+	}
+
+	// Instructions per second are of the golden instruction count, which every engine that
+	// matches has executed
+	int result = EXIT_SUCCESS;
+	std::cout << std::left << std::setw( 24 ) << "scenario" << std::setw( 10 ) << "engine" << std::setw( 10 ) << "result" << std::right << std::setw( 14 ) << "instructions" << std::setw( 12 ) << "seconds" << std::setw( 12 ) << "Minst/s" << "\n";
+	for( auto const & line : lines ) {
+		if( !is_scenario( line ) ) {
+			continue;
+		}
+		auto const scenario = parse_scenario( line, directory );
+		if( !scenario.has_golden ) {
+			std::cout << std::left << std::setw( 24 ) << scenario.name << "no golden values, record them with --update\n";
+			result = EXIT_FAILURE;
+			continue;
+		}
+		for( auto engine : engines ) {
+			auto best = std::numeric_limits<double>::max( );
+			bool is_match = true;
+			for( size_t n = 0; n < repeat; ++n ) {
+				auto const outcome = replay( scenario, engine, false );
+				best = std::min( best, outcome.seconds );
+				is_match = is_match && outcome.output_hash == scenario.output_hash && outcome.state_hash == scenario.state_hash;
+			}
+			if( !is_match ) {
+				result = EXIT_FAILURE;
+			}
+			std::cout << std::left << std::setw( 24 ) << scenario.name << std::setw( 10 ) << to_string( engine ) << std::setw( 10 ) << (is_match ? "ok" : "MISMATCH") << std::right;
+			std::cout << std::setw( 14 ) << scenario.instructions << std::setw( 12 ) << std::fixed << std::setprecision( 4 ) << best;
+			std::cout << std::setw( 12 ) << std::setprecision( 1 ) << (static_cast<double>(scenario.instructions) / best / 1e6) << "\n";
+		}
+	}
+	return result;
+} catch( vm_exit_t const & e ) {
+	return e.report( );
+} catch( std::exception const & e ) {
+	std::cerr << e.what( ) << std::endl;
+	return EXIT_FAILURE;
+}
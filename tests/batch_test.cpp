@@ -0,0 +1,66 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include <boost/test/unit_test.hpp>
+#include "../batch.h"
+#include "test_helpers.h"
+
+using namespace test;
+
+// A guest reading past memory or running off its end stops its own session with an
+// error, the sessions around it still run to their HALT
+BOOST_AUTO_TEST_CASE( batch_session_fault_stops_only_that_session ) {
+	temp_dir_t dir;
+	write_image( dir.file( "good.bin" ), {
+		19, 'A',	// 0: OUT 'A'
+		0		// 2: HALT
+	} );
+	write_image( dir.file( "bad_read.bin" ), {
+		15, R0, 1,	// 0: RMEM R0 1, R0 = 32768
+		15, R1, R0,	// 3: RMEM R1 R0
+		0		// 6: HALT
+	} );
+	std::vector<uint16_t> off_end = {
+		6, 32767	// 0: JMP 32767
+	};
+	off_end.resize( virtual_machine_t::MODULO, 0 );
+	off_end.back( ) = 21;	// 32767: NOOP
+	write_image( dir.file( "bad_end.bin" ), off_end );
+	write_image( dir.file( "script.txt" ), { } );
+
+	for( auto engine : ENGINES ) {
+		std::vector<batch_session_t> sessions;
+		for( auto const & name : { "good.bin", "bad_read.bin", "good.bin", "bad_end.bin", "good.bin" } ) {
+			sessions.emplace_back( dir.file( name ), dir.file( "script.txt" ) );
+		}
+		run_batch( sessions, engine, 2, 1u << 20 );
+		for( size_t n = 0; n < sessions.size( ); n += 2 ) {
+			BOOST_CHECK_EQUAL( sessions[n].exit_code, EXIT_SUCCESS );
+			BOOST_CHECK_EQUAL( sessions[n].output, "A" );
+		}
+		for( size_t n = 1; n < sessions.size( ); n += 2 ) {
+			BOOST_CHECK_EQUAL( sessions[n].exit_code, EXIT_FAILURE );
+			BOOST_CHECK( sessions[n].error.find( "OUT OF RANGE MEMORY" ) != std::string::npos );
+		}
+	}
+}
@@ -0,0 +1,116 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include <limits>
+#include <boost/test/unit_test.hpp>
+#include "../condition.h"
+#include "test_helpers.h"
+
+using namespace test;
+
+namespace {
+	int64_t evaluate( std::string const & text, virtual_machine_t const & vm, uint64_t hits = 1 ) {
+		condition_t condition;
+		std::string error;
+		BOOST_REQUIRE_MESSAGE( condition_t::compile( text, condition, error ), text + ": " + error );
+		return condition.evaluate( vm, hits );
+	}
+
+	std::string compile_error( std::string const & text ) {
+		condition_t condition;
+		std::string error;
+		BOOST_CHECK_MESSAGE( !condition_t::compile( text, condition, error ), text + " compiled" );
+		return error;
+	}
+}
+
+BOOST_AUTO_TEST_CASE( condition_precedence ) {
+	auto vm = make_vm( { } );
+	BOOST_CHECK_EQUAL( evaluate( "1 + 2 * 3", *vm ), 7 );
+	BOOST_CHECK_EQUAL( evaluate( "(1 + 2) * 3", *vm ), 9 );
+	BOOST_CHECK_EQUAL( evaluate( "10 - 4 - 3", *vm ), 3 );
+	BOOST_CHECK_EQUAL( evaluate( "-2 * 3", *vm ), -6 );
+	BOOST_CHECK_EQUAL( evaluate( "!0 + 1", *vm ), 2 );
+	BOOST_CHECK_EQUAL( evaluate( "~0", *vm ), -1 );
+	BOOST_CHECK_EQUAL( evaluate( "1 | 2 ^ 3 & 4", *vm ), 3 );
+	BOOST_CHECK_EQUAL( evaluate( "1 < 2 == 1", *vm ), 1 );
+	BOOST_CHECK_EQUAL( evaluate( "0 || 1 && 0", *vm ), 0 );
+	BOOST_CHECK_EQUAL( evaluate( "0x10 + 1", *vm ), 17 );
+	BOOST_CHECK_EQUAL( evaluate( "7 / 0 + 7 % 0", *vm ), 0 );
+}
+
+BOOST_AUTO_TEST_CASE( condition_similar_operators ) {
+	auto vm = make_vm( { } );
+	BOOST_CHECK_EQUAL( evaluate( "1 != 0", *vm ), 1 );
+	BOOST_CHECK_EQUAL( evaluate( "!1 == 0", *vm ), 1 );
+	BOOST_CHECK_EQUAL( evaluate( "!!5", *vm ), 1 );
+	BOOST_CHECK_EQUAL( evaluate( "2 & 1", *vm ), 0 );
+	BOOST_CHECK_EQUAL( evaluate( "2 && 1", *vm ), 1 );
+	BOOST_CHECK_EQUAL( evaluate( "2 | 1", *vm ), 3 );
+	BOOST_CHECK_EQUAL( evaluate( "2 || 1", *vm ), 1 );
+	BOOST_CHECK_EQUAL( evaluate( "2 <= 2", *vm ), 1 );
+	BOOST_CHECK_EQUAL( evaluate( "2 < 2", *vm ), 0 );
+}
+
+BOOST_AUTO_TEST_CASE( condition_operands ) {
+	auto vm = make_vm( { } );
+	vm->memory[10] = 42;
+	vm->registers[1] = 7;
+	vm->program_stack.push_back( 1 );
+	vm->program_stack.push_back( 2 );
+	BOOST_CHECK_EQUAL( evaluate( "mem[10] == 42", *vm ), 1 );
+	BOOST_CHECK_EQUAL( evaluate( "mem[r1 + 3]", *vm ), 42 );
+	BOOST_CHECK_EQUAL( evaluate( "mem[ mem[10] - 32 ] + 1", *vm ), 43 );
+	BOOST_CHECK_EQUAL( evaluate( "r1 * 2", *vm ), 14 );
+	BOOST_CHECK_EQUAL( evaluate( "depth", *vm ), 2 );
+	BOOST_CHECK_EQUAL( evaluate( "hits % 3 == 0", *vm, 3 ), 1 );
+	BOOST_CHECK_EQUAL( evaluate( "hits % 3 == 0", *vm, 4 ), 0 );
+}
+
+// Overflow wraps around as in two's complement rather than being undefined
+BOOST_AUTO_TEST_CASE( condition_overflow_wraps ) {
+	auto vm = make_vm( { } );
+	auto const min = std::numeric_limits<int64_t>::min( );
+	BOOST_CHECK_EQUAL( evaluate( "1 + 9223372036854775807 > 0", *vm ), 0 );
+	BOOST_CHECK_EQUAL( evaluate( "1 + 9223372036854775807", *vm ), min );
+	BOOST_CHECK_EQUAL( evaluate( "0 - 9223372036854775807 - 2", *vm ), std::numeric_limits<int64_t>::max( ) );
+	BOOST_CHECK_EQUAL( evaluate( "9223372036854775807 * 2", *vm ), -2 );
+	BOOST_CHECK_EQUAL( evaluate( "-(0 - 9223372036854775807 - 1)", *vm ), min );
+	BOOST_CHECK_EQUAL( evaluate( "(0 - 9223372036854775807 - 1) / -1", *vm ), 0 );
+}
+
+BOOST_AUTO_TEST_CASE( condition_compile_errors ) {
+	BOOST_CHECK_EQUAL( compile_error( "r8 == 1" ), "Unknown name 'r8' at position 0" );
+	BOOST_CHECK_EQUAL( compile_error( "(1 + 2" ), "Expected ) at position 6" );
+	BOOST_CHECK_EQUAL( compile_error( "1 +" ), "Expected an operand at position 3" );
+	BOOST_CHECK_EQUAL( compile_error( "mem 1" ), "Expected [ at position 4" );
+	BOOST_CHECK_EQUAL( compile_error( "mem[1" ), "Expected ] at position 5" );
+	BOOST_CHECK_EQUAL( compile_error( "1 2" ), "Unexpected '2' at position 2" );
+	BOOST_CHECK_EQUAL( compile_error( "" ), "Expected an operand at position 0" );
+	std::string deep;
+	for( size_t n = 0; n <= condition_t::MAX_DEPTH; ++n ) {
+		deep += "1 + (";
+	}
+	deep += "1" + std::string( condition_t::MAX_DEPTH + 1, ')' );
+	BOOST_CHECK_EQUAL( compile_error( deep ), "Expression too deep" );
+}
@@ -0,0 +1,167 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include <fstream>
+#include <random>
+#include <boost/test/unit_test.hpp>
+#include "../state_container.h"
+#include "test_helpers.h"
+
+using namespace test;
+using namespace state_container;
+
+namespace {
+	std::vector<uint16_t> round_trip( std::vector<uint16_t> const & data ) {
+		std::vector<uint16_t> compressed;
+		compress_block( data.data( ), data.size( ), compressed );
+		std::vector<uint16_t> result( data.size( ) );
+		BOOST_CHECK( decompress_block( compressed.data( ), compressed.size( ), result.data( ), result.size( ) ) );
+		return result;
+	}
+
+	// Words of every kind the codec treats differently: runs, text, repeats and noise
+	std::vector<uint16_t> mixed_data( size_t size ) {
+		std::mt19937 random( 12345 );
+		std::vector<uint16_t> result;
+		std::string const text = "You are standing in a maze of twisty little passages, all alike.";
+		while( result.size( ) < size ) {
+			switch( random( ) % 4 ) {
+			case 0:
+				result.insert( result.end( ), random( ) % 300, static_cast<uint16_t>(random( )) );
+				break;
+			case 1:
+				result.insert( result.end( ), text.begin( ), text.begin( ) + static_cast<ptrdiff_t>(random( ) % text.size( )) );
+				break;
+			case 2:
+				if( result.size( ) > 16 ) {
+					auto const from = random( ) % (result.size( ) - 8);
+					auto const length = std::min( static_cast<size_t>(random( ) % 64), result.size( ) - from );
+					std::vector<uint16_t> const repeat( result.begin( ) + static_cast<ptrdiff_t>(from), result.begin( ) + static_cast<ptrdiff_t>(from + length) );
+					result.insert( result.end( ), repeat.begin( ), repeat.end( ) );
+				}
+				break;
+			default:
+				for( auto n = random( ) % 50; n > 0; --n ) {
+					result.push_back( static_cast<uint16_t>(random( )) );
+				}
+				break;
+			}
+		}
+		result.resize( size );
+		return result;
+	}
+
+	std::vector<uint16_t> read_words( std::string const & filename ) {
+		std::ifstream in( filename, std::ios::binary );
+		std::vector<char> bytes( (std::istreambuf_iterator<char>( in )), std::istreambuf_iterator<char>( ) );
+		std::vector<uint16_t> result( bytes.size( ) / sizeof( uint16_t ) );
+		std::copy( bytes.begin( ), bytes.end( ), reinterpret_cast<char *>(result.data( )) );
+		return result;
+	}
+}
+
+BOOST_AUTO_TEST_CASE( container_block_round_trip ) {
+	std::vector<std::vector<uint16_t>> const blocks = {
+		{ },
+		{ 7 },
+		std::vector<uint16_t>( BLOCK_WORDS, 0 ),
+		std::vector<uint16_t>( 1000, 0xFFFF ),
+		{ 'a', 'b', 'c', 'd', 'a', 'b', 'c', 'd', 'a', 'b', 'c', 'd', 'e' },
+		mixed_data( BLOCK_WORDS ),
+		mixed_data( 1234 )
+	};
+	for( auto const & block : blocks ) {
+		BOOST_CHECK( round_trip( block ) == block );
+	}
+	std::vector<uint16_t> compressed;
+	compress_block( blocks[2].data( ), blocks[2].size( ), compressed );
+	BOOST_CHECK_LT( compressed.size( ), 8u );
+}
+
+BOOST_AUTO_TEST_CASE( container_block_rejects_malformed ) {
+	auto const data = mixed_data( 500 );
+	std::vector<uint16_t> compressed;
+	compress_block( data.data( ), data.size( ), compressed );
+	std::vector<uint16_t> result( data.size( ) + 1 );
+	BOOST_CHECK( !decompress_block( compressed.data( ), compressed.size( ) - 1, result.data( ), data.size( ) ) );
+	BOOST_CHECK( !decompress_block( compressed.data( ), compressed.size( ), result.data( ), data.size( ) - 1 ) );
+	BOOST_CHECK( !decompress_block( compressed.data( ), compressed.size( ), result.data( ), data.size( ) + 1 ) );
+	uint16_t const match_before_start[] = { 1, 5, 0x8000 | 4, 2 };	// a literal then a match 2 back
+	BOOST_CHECK( !decompress_block( match_before_start, 4, result.data( ), 5 ) );
+}
+
+BOOST_AUTO_TEST_CASE( container_read_sections ) {
+	temp_dir_t dir;
+	auto const memory = mixed_data( 3 * BLOCK_WORDS + 17 );
+	std::vector<uint16_t> const registers = { 1, 2, 3, 4, 5, 6, 7, 8 };
+	write( dir.file( "state.sc" ), { { section_id_t::memory, memory }, { section_id_t::registers, registers }, { section_id_t::program_stack, { } } } );
+
+	reader_t reader( dir.file( "state.sc" ) );
+	BOOST_CHECK( reader.has_section( section_id_t::memory ) );
+	BOOST_CHECK( !reader.has_section( section_id_t::argument_stack ) );
+	BOOST_CHECK_EQUAL( reader.section_size( section_id_t::memory ), memory.size( ) );
+	BOOST_CHECK( reader.read( section_id_t::memory ) == memory );
+	BOOST_CHECK( reader.read( section_id_t::registers ) == registers );
+	BOOST_CHECK( reader.read( section_id_t::program_stack ).empty( ) );
+
+	// Partial reads within a block, across one or two block boundaries and up to the end
+	std::pair<size_t, size_t> const ranges[] = {
+		{ 5, 10 }, { BLOCK_WORDS - 10, 20 }, { BLOCK_WORDS - 1, BLOCK_WORDS + 2 }, { 3 * BLOCK_WORDS - 3, 20 }, { 0, memory.size( ) }, { memory.size( ), 0 }
+	};
+	for( auto const & range : ranges ) {
+		auto const first = memory.begin( ) + static_cast<ptrdiff_t>(range.first);
+		BOOST_CHECK( reader.read( section_id_t::memory, range.first, range.second ) == std::vector<uint16_t>( first, first + static_cast<ptrdiff_t>(range.second) ) );
+	}
+	BOOST_CHECK_THROW( reader.read( section_id_t::memory, memory.size( ) - 5, 6 ), vm_exit_t );
+	BOOST_CHECK_THROW( reader.read( section_id_t::argument_stack ), vm_exit_t );
+}
+
+// A section table that passes its checksum but points outside of the file
+BOOST_AUTO_TEST_CASE( container_rejects_block_index_past_end ) {
+	temp_dir_t dir;
+	write( dir.file( "state.sc" ), { { section_id_t::memory, mixed_data( 100 ) } } );
+	auto words = read_words( dir.file( "state.sc" ) );
+	auto const entry = HEADER_WORDS;
+	words[entry + 4] = 0xFFFF;
+	words[entry + 5] = 0x7FFF;
+	words[3] = 0;
+	words[4] = 0;
+	auto const sum = checksum( words.data( ), HEADER_WORDS + SECTION_ENTRY_WORDS );
+	words[3] = static_cast<uint16_t>(sum);
+	words[4] = static_cast<uint16_t>(sum >> 16);
+	write_image( dir.file( "corrupt.sc" ), words );
+	BOOST_CHECK_THROW( reader_t( dir.file( "corrupt.sc" ) ), vm_exit_t );
+}
+
+BOOST_AUTO_TEST_CASE( container_vm_state_round_trip ) {
+	temp_dir_t dir;
+	auto vm = make_vm( mixed_data( 20000 ) );
+	vm->registers[3] = 42;
+	vm->instruction_ptr = 1234;
+	vm->program_stack.push_back( 5 );
+	vm->program_stack.push_back( 6 );
+	vm->save_compressed_state( dir.file( "state.sc" ) );
+	virtual_machine_t loaded;
+	loaded.load_state( dir.file( "state.sc" ) );
+	check_same_state( *vm, loaded );
+}
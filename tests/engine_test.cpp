@@ -0,0 +1,121 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include <boost/test/unit_test.hpp>
+#include "test_helpers.h"
+#include "../jit_engine.h"
+
+using namespace test;
+
+namespace {
+	// Run a vm from factory on every engine and compare each with the tick loop
+	template<typename Factory>
+	void check_engines_match_tick( Factory factory, uint64_t max_instructions = 1u << 24 ) {
+		auto reference = factory( );
+		auto const expected = run( *reference, engine_t::tick, max_instructions );
+		BOOST_REQUIRE( !expected.empty( ) );
+		for( auto engine : ENGINES ) {
+			BOOST_TEST_CHECKPOINT( to_string( engine ) );
+			auto vm = factory( );
+			BOOST_CHECK_EQUAL( run( *vm, engine, max_instructions ), expected );
+			check_same_state( *reference, *vm );
+		}
+	}
+}
+
+// Every opcode and a call in a loop that runs well past the point the JIT compiles it, then
+// input and code that is rewritten after it has run
+BOOST_AUTO_TEST_CASE( engines_match_tick_on_every_opcode ) {
+	std::vector<uint16_t> image = {
+		1, R6, 100,					// 0: SET R6 100
+		9, R0, R6, 5,				// 3: ADD R0 R6 5
+		2, R0,						// 7: PUSH R0
+		3, R1,						// 9: POP R1
+		4, R2, R0, R1,				// 11: EQ R2 R0 R1
+		5, R3, R0, 50,				// 15: GT R3 R0 50
+		9, R4, R0, 32767,			// 19: ADD R4 R0 32767
+		10, R5, R0, R0,				// 23: MULT R5 R0 R0
+		11, R7, R5, 7,				// 27: MOD R7 R5 7
+		12, R7, R7, R5,				// 31: AND R7 R7 R5
+		13, R7, R7, 1,				// 35: OR R7 R7 1
+		14, R3, R3,					// 39: NOT R3 R3
+		9, R1, R6, 1000,			// 42: ADD R1 R6 1000
+		16, R1, R5,					// 46: WMEM R1 R5
+		15, R2, R1,					// 49: RMEM R2 R1
+		17, 100,					// 52: CALL 100
+		9, R6, R6, 32767,			// 54: ADD R6 R6 32767
+		7, R6, 3,					// 58: JT R6 3
+		20, R0,						// 61: IN R0
+		19, R0,						// 63: OUT R0
+		7, R2, 69,					// 65: JT R2 69
+		0,							// 68: HALT
+		8, R2, 68,					// 69: JF R2 68
+		1, R6, 3,					// 72: SET R6 3
+		16, 91, '!',				// 75: WMEM 91 '!'
+		16, 90, 19,					// 78: WMEM 90 19
+		9, R6, R6, 32767,			// 81: ADD R6 R6 32767
+		7, R6, 90,					// 85: JT R6 90
+		0							// 88: HALT
+	};
+	std::vector<uint16_t> const rewritten = {
+		21, 21,						// 90: NOOP NOOP, then OUT '!' and OUT '?'
+		16, 91, '?',				// 92: WMEM 91 '?'
+		6, 81						// 95: JMP 81
+	};
+	std::vector<uint16_t> const function = {
+		19, 'c',					// 100: OUT 'c'
+		18							// 102: RET
+	};
+	image.resize( 100 );
+	std::copy( rewritten.begin( ), rewritten.end( ), image.begin( ) + 90 );
+	image.insert( image.end( ), function.begin( ), function.end( ) );
+
+	auto const factory = [&image]( ) {
+		auto vm = make_vm( image );
+		vm->input.set_readers( { memory_reader( "x\n" ) } );
+		return vm;
+	};
+	check_engines_match_tick( factory );
+	auto vm = factory( );
+	BOOST_CHECK_EQUAL( run( *vm, engine_t::tick ), std::string( 100, 'c' ) + "x!?" );
+
+	// Without a compiled block the jit run above only covered the threaded interpreter
+	if( has_jit( ) ) {
+		auto jit_vm = factory( );
+		run( *jit_vm, engine_t::jit );
+		BOOST_CHECK_GT( jit_blocks_compiled( *jit_vm ), 0u );
+	}
+}
+
+// The challenge decrypts and checks itself before reading input, then plays through it
+BOOST_AUTO_TEST_CASE( engines_match_tick_on_challenge ) {
+	for( auto script : { "", "actions.txt" } ) {
+		BOOST_TEST_CHECKPOINT( script );
+		check_engines_match_tick( [script]( ) {
+			std::unique_ptr<virtual_machine_t> vm( new virtual_machine_t( "challenge.bin" ) );
+			vm->input.set_readers( { *script == 0 ? memory_reader( "" ) : file_reader( script ) } );
+			vm->input.set_exhausted_policy( exhausted_policy_t::halt );
+			return vm;
+		} );
+	}
+}
@@ -0,0 +1,100 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include <boost/test/unit_test.hpp>
+#include "test_helpers.h"
+
+using namespace test;
+
+// History is only recorded by debug builds
+#ifdef DEBUG
+namespace {
+	// Counts in R0 forever, pushing, popping, calling and writing memory on every pass
+	std::vector<uint16_t> counting_image( ) {
+		std::vector<uint16_t> image = {
+			9, R0, R0, 1,		// 0: ADD R0 R0 1
+			2, R0,			// 4: PUSH R0
+			17, 100,		// 6: CALL 100
+			3, R1,			// 8: POP R1
+			12, R2, R0, 255,	// 10: AND R2 R0 255
+			9, R2, R2, 1000,	// 14: ADD R2 R2 1000
+			16, R2, R1,		// 18: WMEM R2 R1
+			6, 0			// 21: JMP 0
+		};
+		std::vector<uint16_t> const function = {
+			10, R3, R0, R0,		// 100: MULT R3 R0 R0
+			2, R3,			// 104: PUSH R3
+			3, R4,			// 106: POP R4
+			18			// 108: RET
+		};
+		image.resize( 100 );
+		image.insert( image.end( ), function.begin( ), function.end( ) );
+		return image;
+	}
+
+	void tick( virtual_machine_t & vm, uint64_t count ) {
+		for( uint64_t n = 0; n < count; ++n ) {
+			vm.tick( );
+		}
+	}
+
+	// Moves vm to position and compares it with a vm that ran straight there
+	void check_go_to( virtual_machine_t & vm, uint64_t position ) {
+		BOOST_TEST_CHECKPOINT( "go_to " << position );
+		vm.debugging.history.go_to( vm, position );
+		BOOST_CHECK_EQUAL( vm.debugging.history.position( ), position );
+		auto straight = make_vm( counting_image( ) );
+		tick( *straight, position );
+		check_same_state( *straight, vm );
+	}
+}
+
+BOOST_AUTO_TEST_CASE( history_go_to_across_checkpoints ) {
+	auto const interval = vm_history_t::CHECKPOINT_INTERVAL;
+	auto vm = make_vm( counting_image( ) );
+	vm->debugging.history.start( *vm );
+	vm->debugging.rearm( );
+	auto const end = 3 * interval + 100;
+	tick( *vm, end );
+	BOOST_REQUIRE_EQUAL( vm->debugging.history.last( ), end );
+
+	for( auto position : { end - 5, interval - 1, interval + 1, 2 * interval + interval / 2, uint64_t( 10 ), uint64_t( 0 ), end } ) {
+		check_go_to( *vm, position );
+	}
+
+	// Running on from an earlier position drops the steps after it, and the checkpoints
+	// taken during them
+	auto const branch = interval + interval / 2;
+	vm->debugging.history.go_to( *vm, branch );
+	tick( *vm, 10 );
+	BOOST_REQUIRE_EQUAL( vm->debugging.history.last( ), branch + 10 );
+	for( auto position : { interval - 3, branch + 10, branch / 2, branch + 5 } ) {
+		check_go_to( *vm, position );
+	}
+	tick( *vm, interval );
+	BOOST_REQUIRE_EQUAL( vm->debugging.history.last( ), branch + 5 + interval );
+	for( auto position : { 2 * interval + 1, uint64_t( 1 ), branch + 5 + interval } ) {
+		check_go_to( *vm, position );
+	}
+}
+#endif
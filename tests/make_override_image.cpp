@@ -0,0 +1,63 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+// Writes the image the override plugin tests run, see override_plugin.cpp.  Without the
+// plugin it prints X, a newline and the empty word at 200; with it, PQ and a newline
+
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+int main( int argc, char** argv ) {
+	if( argc != 2 ) {
+		std::cerr << "Usage: " << argv[0] << " <image file>" << std::endl;
+		return EXIT_FAILURE;
+	}
+	uint16_t const R0 = 32768;
+	uint16_t const R1 = 32769;
+	std::vector<uint16_t> image = {
+		17, 100,		// 0: CALL 100
+		19, R0,			// 2: OUT R0
+		15, R1, 200,		// 4: RMEM R1 200
+		19, R1,			// 7: OUT R1
+		19, '\n',		// 9: OUT '\n'
+		0			// 11: HALT
+	};
+	std::vector<uint16_t> const function = {
+		19, 'X',		// 100: OUT 'X'
+		18			// 102: RET
+	};
+	image.resize( 100 );
+	image.insert( image.end( ), function.begin( ), function.end( ) );
+	image.resize( 201 );	// 200: the word the override stores to
+
+	std::ofstream out( argv[1], std::ios::binary );
+	out.write( reinterpret_cast<char const *>(image.data( )), static_cast<std::streamsize>(image.size( ) * sizeof( uint16_t )) );
+	if( !out ) {
+		std::cerr << "Error writing file: " << argv[1] << std::endl;
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,57 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include <boost/test/unit_test.hpp>
+#include "test_helpers.h"
+
+using namespace test;
+
+// A register written on only some paths keeps the caller's value on the others, so it is
+// as much an input as one that is read
+BOOST_AUTO_TEST_CASE( memoizer_keys_on_registers_written_on_some_paths ) {
+	std::vector<uint16_t> const image = {
+		1, R0, 1,	// 0: SET R0 1
+		1, R2, 'A',	// 3: SET R2 'A'
+		17, 100,	// 6: CALL 100
+		19, R2,		// 8: OUT R2
+		1, R2, 'B',	// 10: SET R2 'B'
+		17, 100,	// 13: CALL 100
+		19, R2,		// 15: OUT R2
+		0		// 17: HALT
+	};
+	std::vector<uint16_t> const function = {
+		7, R0, 106,	// 100: JT R0 106
+		1, R2, 'Z',	// 103: SET R2 'Z'
+		18		// 106: RET
+	};
+	for( auto engine : ENGINES ) {
+		for( bool is_memoized : { false, true } ) {
+			auto vm = make_vm( image );
+			std::copy( function.begin( ), function.end( ), vm->memory.begin( ) + 100 );
+			if( is_memoized ) {
+				vm->memo.enable( *vm );
+			}
+			BOOST_CHECK_EQUAL( run( *vm, engine ), "AB" );
+		}
+	}
+}
@@ -0,0 +1,10 @@
+# Runs PROGRAM on IMAGE, see make_override_image.cpp, with the override plugin and checks the overridden output.
+# Debug builds start in the console, so it is told to go first
+execute_process( COMMAND ${PROGRAM} --engine=${ENGINE} --plugin=${PLUGIN} ${IMAGE}
+	INPUT_FILE tests/override_console.txt
+	OUTPUT_VARIABLE OUTPUT
+	RESULT_VARIABLE RESULT
+	TIMEOUT 10 )
+if( NOT RESULT EQUAL 0 OR NOT OUTPUT MATCHES "PQ\n" )
+	message( FATAL_ERROR "${ENGINE} did not take the override, exit ${RESULT}:\n${OUTPUT}" )
+endif( )
@@ -0,0 +1,119 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include <boost/test/unit_test.hpp>
+#include "test_helpers.h"
+
+using namespace test;
+
+namespace {
+	uint16_t const WRITTEN = 5000;
+	size_t const WRITTEN_PAGE = WRITTEN / decode_cache_t::PAGE_WORDS;
+
+	uint16_t value_in( vm_snapshot_t const & state, uint16_t address ) {
+		return (*state.pages[address / decode_cache_t::PAGE_WORDS])[address % decode_cache_t::PAGE_WORDS];
+	}
+}
+
+// Snapshots share every page no one has written since the last one
+BOOST_AUTO_TEST_CASE( snapshot_shares_unwritten_pages ) {
+	auto vm = make_vm( { 19, 'A', 0 } );
+	auto const first = vm->snapshot( );
+	auto const second = vm->snapshot( );
+	BOOST_CHECK( first->pages == second->pages );
+
+	vm->set_memory( WRITTEN, 42 );
+	auto const third = vm->snapshot( );
+	for( size_t n = 0; n < third->pages.size( ); ++n ) {
+		BOOST_CHECK_EQUAL( third->pages[n] == first->pages[n], n != WRITTEN_PAGE );
+	}
+	BOOST_CHECK_EQUAL( value_in( *first, WRITTEN ), 0 );
+	BOOST_CHECK_EQUAL( value_in( *third, WRITTEN ), 42 );
+}
+
+// A program writing into a shared page, on any engine, leaves earlier snapshots as they were
+BOOST_AUTO_TEST_CASE( snapshot_unchanged_by_later_writes ) {
+	std::vector<uint16_t> const image = {
+		1, R0, 7,		// 0: SET R0 7
+		2, R0,			// 3: PUSH R0
+		16, WRITTEN, 99,	// 5: WMEM 5000 99
+		0			// 8: HALT
+	};
+	for( auto engine : ENGINES ) {
+		BOOST_TEST_CHECKPOINT( to_string( engine ) );
+		auto vm = make_vm( image );
+		auto const before = vm->snapshot( );
+		run( *vm, engine );
+		BOOST_CHECK_EQUAL( vm->memory[WRITTEN], 99 );
+		auto const after = vm->snapshot( );
+		BOOST_CHECK( before->pages[WRITTEN_PAGE] != after->pages[WRITTEN_PAGE] );
+		BOOST_CHECK_EQUAL( value_in( *before, WRITTEN ), 0 );
+		BOOST_CHECK_EQUAL( value_in( *after, WRITTEN ), 99 );
+
+		vm->restore( *before );
+		auto const fresh = make_vm( image );
+		check_same_state( *fresh, *vm );
+		BOOST_CHECK_EQUAL( value_in( *after, WRITTEN ), 99 );
+
+		// Written again after the restore, then restored to the later state
+		vm->set_memory( WRITTEN, 1 );
+		BOOST_CHECK_EQUAL( value_in( *before, WRITTEN ), 0 );
+		vm->restore( *after );
+		BOOST_CHECK_EQUAL( vm->memory[WRITTEN], 99 );
+		BOOST_CHECK_EQUAL( vm->registers[0], 7 );
+		BOOST_REQUIRE_EQUAL( vm->program_stack.size( ), 1u );
+		BOOST_CHECK_EQUAL( value_in( *before, WRITTEN ), 0 );
+
+		// A fork writes to its own memory
+		auto const forked = vm->fork( );
+		check_same_state( *vm, *forked );
+		forked->set_memory( WRITTEN, 5 );
+		BOOST_CHECK_EQUAL( vm->memory[WRITTEN], 99 );
+		BOOST_CHECK_EQUAL( value_in( *after, WRITTEN ), 99 );
+	}
+}
+
+// A fork starts out on its parent's pages and copies only the ones it writes, then runs
+// the same as its parent on every engine
+BOOST_AUTO_TEST_CASE( fork_shares_pages_until_written ) {
+	for( auto engine : ENGINES ) {
+		BOOST_TEST_CHECKPOINT( to_string( engine ) );
+		auto vm = make_vm( { 19, 'A', 16, WRITTEN, 99, 19, 'B', 0 } );
+		vm->registers[3] = 3;
+		auto const forked = vm->fork( );
+		check_same_state( *vm, *forked );
+		auto const parent = vm->snapshot( );
+		auto const child = forked->snapshot( );
+		BOOST_CHECK( parent->pages == child->pages );
+
+		BOOST_CHECK_EQUAL( run( *forked, engine ), "AB" );
+		auto const written = forked->snapshot( );
+		for( size_t n = 0; n < written->pages.size( ); ++n ) {
+			BOOST_CHECK_EQUAL( written->pages[n] == parent->pages[n], n != WRITTEN_PAGE );
+		}
+		BOOST_CHECK_EQUAL( value_in( *written, WRITTEN ), 99 );
+		BOOST_CHECK_EQUAL( vm->memory[WRITTEN], 0 );
+		BOOST_CHECK_EQUAL( run( *vm, engine ), "AB" );
+		check_same_state( *vm, *forked );
+	}
+}
@@ -0,0 +1,43 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include <boost/test/unit_test.hpp>
+#include "test_helpers.h"
+
+using namespace test;
+
+// Periodic checkpoints save to the same file, which must not become its own base
+BOOST_AUTO_TEST_CASE( save_delta_twice_to_one_file ) {
+	temp_dir_t dir;
+	auto vm = make_vm( { 21, 21, 0 } );
+	vm->save_state( dir.file( "base.bin" ) );
+	for( uint16_t n = 0; n < 3; ++n ) {
+		vm->set_memory( static_cast<uint16_t>(1000 + n * 1000), n );
+		vm->registers[n] = static_cast<uint16_t>(n + 1);
+		vm->save_delta( dir.file( "checkpoint.bin" ) );
+
+		virtual_machine_t loaded;
+		loaded.load_state( dir.file( "checkpoint.bin" ) );
+		check_same_state( *vm, loaded );
+	}
+}
@@ -0,0 +1,101 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+#include "../engine.h"
+#include "../vm.h"
+
+namespace test {
+	uint16_t const R0 = virtual_machine_t::REGISTER0;
+	uint16_t const R1 = virtual_machine_t::REGISTER0 + 1;
+	uint16_t const R2 = virtual_machine_t::REGISTER0 + 2;
+	uint16_t const R3 = virtual_machine_t::REGISTER0 + 3;
+	uint16_t const R4 = virtual_machine_t::REGISTER0 + 4;
+	uint16_t const R5 = virtual_machine_t::REGISTER0 + 5;
+	uint16_t const R6 = virtual_machine_t::REGISTER0 + 6;
+	uint16_t const R7 = virtual_machine_t::REGISTER0 + 7;
+
+	engine_t const ENGINES[] = { engine_t::tick, engine_t::threaded, engine_t::jit };
+
+	// A directory removed with everything in it at the end of the test
+	struct temp_dir_t {
+		boost::filesystem::path path;
+		temp_dir_t( ): path( boost::filesystem::temp_directory_path( ) / boost::filesystem::unique_path( "synacor_test_%%%%%%%%" ) ) {
+			boost::filesystem::create_directories( path );
+		}
+		~temp_dir_t( ) {
+			boost::system::error_code ec;
+			boost::filesystem::remove_all( path, ec );
+		}
+		std::string file( std::string const & name ) const {
+			return (path / name).string( );
+		}
+	};	// struct temp_dir_t
+
+	// Write image as a vm file, the way images are stored
+	inline void write_image( std::string const & filename, std::vector<uint16_t> const & image ) {
+		std::ofstream out( filename, std::ios::binary );
+		out.write( reinterpret_cast<char const *>(image.data( )), static_cast<std::streamsize>(image.size( ) * sizeof( uint16_t )) );
+	}
+
+	// A vm with image at address 0 and no input
+	inline std::unique_ptr<virtual_machine_t> make_vm( std::vector<uint16_t> const & image ) {
+		std::unique_ptr<virtual_machine_t> vm( new virtual_machine_t( ) );
+		std::copy( image.begin( ), image.end( ), vm->memory.begin( ) );
+		vm->input.set_exhausted_policy( exhausted_policy_t::halt );
+		return vm;
+	}
+
+	// Memory, registers, ip and program stack are the same
+	inline void check_same_state( virtual_machine_t & expected, virtual_machine_t & actual ) {
+		BOOST_CHECK( std::equal( expected.memory.begin( ), expected.memory.end( ), actual.memory.begin( ) ) );
+		BOOST_CHECK( std::equal( expected.registers.begin( ), expected.registers.end( ), actual.registers.begin( ) ) );
+		BOOST_CHECK_EQUAL( expected.instruction_ptr, actual.instruction_ptr );
+		BOOST_REQUIRE_EQUAL( expected.program_stack.size( ), actual.program_stack.size( ) );
+		BOOST_CHECK( std::equal( expected.program_stack.data( ), expected.program_stack.data( ) + expected.program_stack.size( ), actual.program_stack.data( ) ) );
+	}
+
+	// Everything the program writes until it halts, fails or has run max_instructions
+	inline std::string run( virtual_machine_t & vm, engine_t engine, uint64_t max_instructions = 1u << 24 ) {
+		std::string output;
+		vm.output.set_sink( memory_sink( output ) );
+		try {
+			uint64_t count = 0;
+			while( count < max_instructions ) {
+				count += run_engine( vm, engine, max_instructions - count );
+			}
+		} catch( vm_exit_t const & ) { }
+		vm.output.flush( );
+		vm.output.set_sink( null_sink( ) );
+		return output;
+	}
+}	// namespace test
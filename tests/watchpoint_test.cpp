@@ -0,0 +1,85 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include <boost/test/unit_test.hpp>
+#include "../vm_control.h"
+#include "test_helpers.h"
+
+using namespace test;
+
+// Watchpoints are only checked by debug builds
+#ifdef DEBUG
+namespace {
+	// Runs one instruction and whether a watchpoint broke after it, without going into
+	// the console
+	bool tick_breaks( virtual_machine_t & vm ) {
+		vm.tick( );
+		auto const result = vm.debugging.should_break;
+		vm.debugging.should_break = false;
+		return result;
+	}
+}
+
+BOOST_AUTO_TEST_CASE( watchpoints_on_reads_and_writes ) {
+	auto vm = make_vm( {
+		1, R0, 500,		// 0: SET R0 500
+		16, R0, 7,		// 3: WMEM R0 7
+		15, R1, 600,		// 6: RMEM R1 600
+		16, 700, 0,		// 9: WMEM 700 0
+		16, 700, 5,		// 12: WMEM 700 5
+		1, R2, 3,		// 15: SET R2 3
+		21,			// 18: NOOP
+		0			// 19: HALT
+	} );
+	vm->memory[600] = 9;
+	auto const start = vm->snapshot( );
+	vm_control::set_watch( *vm, 500, "w" );
+	vm_control::set_watch( *vm, 600, "r" );
+	vm_control::set_watch( *vm, 700, "c" );
+	vm_control::set_watch( *vm, R2, "w" );
+
+	BOOST_CHECK( !tick_breaks( *vm ) );	// SET R0 500
+	BOOST_CHECK( tick_breaks( *vm ) );	// WMEM through R0
+	BOOST_CHECK( tick_breaks( *vm ) );	// RMEM
+	BOOST_CHECK( !tick_breaks( *vm ) );	// WMEM of the value already there
+	BOOST_CHECK( tick_breaks( *vm ) );	// WMEM of a new value
+	BOOST_CHECK( tick_breaks( *vm ) );	// SET R2
+	BOOST_CHECK_EQUAL( vm->memory[500], 7 );
+	BOOST_CHECK_EQUAL( vm->memory[700], 5 );
+
+	// Writes by a restore or the console are not the program's.  The console passes the
+	// arguments of a command without its name
+	vm->restore( *start );
+	BOOST_CHECK_EQUAL( vm->memory[500], 0 );
+	BOOST_CHECK( !tick_breaks( *vm ) );	// SET R0 500
+	vm_control::set_mem( *vm, std::vector<std::string>{ "500", "3" } );
+	vm_control::set_mem( *vm, std::vector<std::string>{ "700", "4" } );
+	BOOST_CHECK_EQUAL( vm->memory[500], 3 );
+	BOOST_CHECK_EQUAL( vm->memory[700], 4 );
+	BOOST_CHECK( tick_breaks( *vm ) );	// WMEM through R0
+	vm->set_register( R2, 8 );
+	vm->read_memory( 600 );
+	vm->instruction_ptr = 18;
+	BOOST_CHECK( !tick_breaks( *vm ) );	// NOOP
+}
+#endif
@@ -0,0 +1,378 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include "threaded_engine.h"
+
+#if defined( __GNUC__ ) || defined( __clang__ )
+#define SC_HAS_COMPUTED_GOTO
+#endif
+
+namespace {
+	uint16_t const REGISTER0 = virtual_machine_t::REGISTER0;
+	uint16_t const REGISTER_END = virtual_machine_t::REGISTER0 + 8;
+	uint16_t const NOT_MASK = 0b1000000000000000;
+	uint16_t const OPCODE_COUNT = 22;
+}
+
+uint64_t run_threaded( virtual_machine_t & vm, uint64_t max_instructions ) {
+	if( vm.is_instrumented( ) ) {
+		return 0;
+	}
+	uint16_t * const mem = &vm.memory[0];
+	uint16_t * const regs = &vm.registers[0];
+	auto & program_stack = vm.program_stack;
+	auto & output = vm.output;
+	// Calls to native overrides are left to the reference implementation
+	uint8_t const * const overridden = vm.overrides.flags( );
+	auto & cache = vm.decode_cache;
+	decode_cache_t::entry_t const * const entries = cache.data( );
+	decode_cache_t::entry_t const * e = nullptr;
+	uint16_t ip = vm.instruction_ptr;
+	uint64_t count = 0;
+
+	// Operands in the cache are already validated as either a literal or a register
+	auto const value = [regs]( uint16_t raw ) -> uint16_t {
+		return raw < REGISTER0 ? raw : regs[raw - REGISTER0];
+	};
+
+	auto const store = [mem, regs, &cache]( uint16_t raw, uint16_t val ) {
+		if( raw < REGISTER0 ) {
+			cache.invalidate( raw );
+			mem[raw] = val;
+		} else {
+			regs[raw - REGISTER0] = val;
+		}
+	};
+
+	auto const arg = [&e, &value]( size_t n ) -> uint16_t {
+		return value( e->args[n] );
+	};
+
+	// Values popped off the program stack have not been validated
+	auto const invalid = []( uint16_t raw ) {
+		return raw >= REGISTER_END;
+	};
+	uint16_t popped = 0;
+
+	uint8_t const * const dispatch_ops = cache.dispatch_ops( );
+
+#ifdef SC_HAS_COMPUTED_GOTO
+	// Every op_code that is not an instruction, including decode_cache_t::EMPTY, goes to 
+	// op_decode so that a dispatch needs no extra test for a cache miss
+	void * dispatch_table[std::numeric_limits<uint8_t>::max( ) + 1];
+	std::fill( std::begin( dispatch_table ), std::end( dispatch_table ), &&op_decode );
+	{
+		void * const handlers[OPCODE_COUNT] = {
+			&&op_halt, &&op_set, &&op_push, &&op_pop, &&op_eq, &&op_gt, &&op_jmp, &&op_jt, 
+			&&op_jf, &&op_add, &&op_mult, &&op_mod, &&op_and, &&op_or, &&op_not, &&op_rmem, 
+			&&op_wmem, &&op_call, &&op_ret, &&op_out, &&op_in, &&op_noop
+		};
+		std::copy( std::begin( handlers ), std::end( handlers ), std::begin( dispatch_table ) );
+		dispatch_table[decode_cache_t::super_out_run] = &&op_out_run;
+#define SC_FUSED_TABLE( a, b ) dispatch_table[decode_cache_t::super_##a##_##b] = &&op_##a##_##b;
+		SC_FUSED_PAIRS( SC_FUSED_TABLE )
+#undef SC_FUSED_TABLE
+	}
+
+	// Each handler carries its own copy of the dispatch so the branch predictor sees
+	// per-opcode history
+#define SC_DISPATCH( ) \
+	if( count >= max_instructions ) { goto done; } \
+	e = &entries[ip]; \
+	goto *dispatch_table[dispatch_ops[ip]]
+#else
+#define SC_DISPATCH( ) goto dispatch
+#endif
+// Instruction lengths are fixed per opcode, using a constant keeps the entry load off
+// the critical path of the next dispatch
+#define SC_NEXT( length ) ip = static_cast<uint16_t>(ip + length); ++count; SC_DISPATCH( )
+
+#ifndef SC_HAS_COMPUTED_GOTO
+dispatch:
+	if( count >= max_instructions ) {
+		goto done;
+	}
+	e = &entries[ip];
+	switch( dispatch_ops[ip] ) {
+	case 0: goto op_halt;
+	case 1: goto op_set;
+	case 2: goto op_push;
+	case 3: goto op_pop;
+	case 4: goto op_eq;
+	case 5: goto op_gt;
+	case 6: goto op_jmp;
+	case 7: goto op_jt;
+	case 8: goto op_jf;
+	case 9: goto op_add;
+	case 10: goto op_mult;
+	case 11: goto op_mod;
+	case 12: goto op_and;
+	case 13: goto op_or;
+	case 14: goto op_not;
+	case 15: goto op_rmem;
+	case 16: goto op_wmem;
+	case 17: goto op_call;
+	case 18: goto op_ret;
+	case 19: goto op_out;
+	case 20: goto op_in;
+	case 21: goto op_noop;
+	case decode_cache_t::super_out_run: goto op_out_run;
+#define SC_FUSED_CASE( a, b ) case decode_cache_t::super_##a##_##b: goto op_##a##_##b;
+	SC_FUSED_PAIRS( SC_FUSED_CASE )
+#undef SC_FUSED_CASE
+	default: goto op_decode;
+	}
+#endif
+	SC_DISPATCH( );
+
+op_decode:
+	e = cache.fetch( vm.memory, ip );
+	if( e == nullptr ) {
+		goto slow_path;
+	}
+#ifdef SC_HAS_COMPUTED_GOTO
+	goto *dispatch_table[dispatch_ops[ip]];
+#else
+	goto dispatch;
+#endif
+
+	// Bodies of the instructions that can start a superinstruction.  ip and e are those of
+	// the instruction being run, a taken jump dispatches from inside the body
+#define SC_BODY_set( ) \
+	if( e->args[0] < REGISTER0 ) { \
+		goto slow_path; \
+	} \
+	regs[e->args[0] - REGISTER0] = arg( 1 )
+#define SC_BODY_push( ) \
+	program_stack.push_back( arg( 0 ) )
+#define SC_BODY_pop( ) \
+	if( program_stack.empty( ) || invalid( program_stack.back( ) ) ) { \
+		goto slow_path; \
+	} \
+	popped = program_stack.back( ); \
+	program_stack.pop_back( ); \
+	store( e->args[0], value( popped ) )
+#define SC_BODY_eq( ) \
+	store( e->args[0], arg( 1 ) == arg( 2 ) ? 1 : 0 )
+#define SC_BODY_gt( ) \
+	store( e->args[0], arg( 1 ) > arg( 2 ) ? 1 : 0 )
+#define SC_BODY_jt( ) \
+	if( arg( 0 ) != 0 ) { \
+		ip = arg( 1 ); \
+		++count; \
+		SC_DISPATCH( ); \
+	}
+#define SC_BODY_jf( ) \
+	if( arg( 0 ) == 0 ) { \
+		ip = arg( 1 ); \
+		++count; \
+		SC_DISPATCH( ); \
+	}
+#define SC_BODY_add( ) \
+	store( e->args[0], static_cast<uint16_t>((arg( 1 ) + arg( 2 )) % virtual_machine_t::MODULO) )
+#define SC_BODY_mult( ) \
+	store( e->args[0], static_cast<uint16_t>((static_cast<uint32_t>(arg( 1 )) * static_cast<uint32_t>(arg( 2 ))) % virtual_machine_t::MODULO) )
+#define SC_BODY_and( ) \
+	store( e->args[0], arg( 1 ) & arg( 2 ) )
+#define SC_BODY_or( ) \
+	store( e->args[0], arg( 1 ) | arg( 2 ) )
+#define SC_BODY_not( ) \
+	store( e->args[0], static_cast<uint16_t>((arg( 1 ) & NOT_MASK) | (~arg( 1 ) & ~NOT_MASK)) )
+#define SC_BODY_rmem( ) \
+	if( arg( 1 ) >= virtual_machine_t::MODULO ) { \
+		goto slow_path; \
+	} \
+	store( e->args[0], mem[arg( 1 )] )
+#define SC_BODY_wmem( ) \
+	if( arg( 0 ) >= virtual_machine_t::MODULO || arg( 1 ) >= virtual_machine_t::MODULO ) { \
+		goto slow_path; \
+	} \
+	store( arg( 0 ), arg( 1 ) )
+
+op_set:
+	SC_BODY_set( );
+	SC_NEXT( 3 );
+
+op_push:
+	SC_BODY_push( );
+	SC_NEXT( 2 );
+
+op_pop:
+	SC_BODY_pop( );
+	SC_NEXT( 2 );
+
+op_eq:
+	SC_BODY_eq( );
+	SC_NEXT( 4 );
+
+op_gt:
+	SC_BODY_gt( );
+	SC_NEXT( 4 );
+
+op_jmp:
+	ip = arg( 0 );
+	++count;
+	SC_DISPATCH( );
+
+op_jt:
+	SC_BODY_jt( );
+	SC_NEXT( 3 );
+
+op_jf:
+	SC_BODY_jf( );
+	SC_NEXT( 3 );
+
+op_add:
+	SC_BODY_add( );
+	SC_NEXT( 4 );
+
+op_mult:
+	SC_BODY_mult( );
+	SC_NEXT( 4 );
+
+op_mod:
+	store( e->args[0], static_cast<uint16_t>(arg( 1 ) % arg( 2 )) );
+	SC_NEXT( 4 );
+
+op_and:
+	SC_BODY_and( );
+	SC_NEXT( 4 );
+
+op_or:
+	SC_BODY_or( );
+	SC_NEXT( 4 );
+
+op_not:
+	SC_BODY_not( );
+	SC_NEXT( 3 );
+
+op_rmem:
+	SC_BODY_rmem( );
+	SC_NEXT( 3 );
+
+op_wmem:
+	SC_BODY_wmem( );
+	SC_NEXT( 3 );
+
+op_call:
+	if( overridden[arg( 0 )] ) {
+		goto slow_path;
+	}
+	program_stack.push_back( static_cast<uint16_t>(ip + 2) );
+	ip = arg( 0 );
+	++count;
+	SC_DISPATCH( );
+
+op_ret:
+	if( program_stack.empty( ) ) {
+		goto slow_path;
+	}
+	ip = program_stack.back( );
+	program_stack.pop_back( );
+	++count;
+	SC_DISPATCH( );
+
+op_out:
+	output.put( static_cast<char>(arg( 0 )) );
+	SC_NEXT( 2 );
+
+op_noop:
+	SC_NEXT( 1 );
+
+op_out_run: {
+	// Literal OUTs, their characters are every other word of the run
+	size_t const run_count = cache.fused_length( ip ) / 2u;
+	if( count + run_count > max_instructions ) {
+		goto op_out;
+	}
+	char text[decode_cache_t::MAX_OUT_RUN];
+	for( size_t n = 0; n < run_count; ++n ) {
+		text[n] = static_cast<char>(mem[ip + 1 + 2 * n]);
+	}
+	output.write( text, run_count );
+	ip = static_cast<uint16_t>(ip + 2 * run_count);
+	count += run_count;
+	SC_DISPATCH( );
+}
+
+	// A pair runs the first body and then goes straight to the handler of the second 
+	// instruction, saving the indirect dispatch between them.  The first may have written
+	// over the second, in which case its entry was emptied
+#define SC_FUSED_HANDLER( a, b ) \
+op_##a##_##b: \
+	if( count + 1 >= max_instructions ) { \
+		goto op_##a; \
+	} \
+	SC_BODY_##a( ); \
+	ip = static_cast<uint16_t>(ip + decode_cache_t::length( decode_cache_t::op_##a )); \
+	e += decode_cache_t::length( decode_cache_t::op_##a ); \
+	++count; \
+	if( e->op_code == decode_cache_t::EMPTY ) { \
+		goto op_decode; \
+	} \
+	goto op_##b;
+	SC_FUSED_PAIRS( SC_FUSED_HANDLER )
+#undef SC_FUSED_HANDLER
+
+op_in:
+	// Input may drop into the console, which can arm the debugger or replace the state
+	vm.instruction_ptr = ip;
+	vm.tick( );
+	return count + 1;
+
+op_halt:
+slow_path:
+	// Let the reference implementation execute, or report the error for, this instruction
+	vm.instruction_ptr = ip;
+	vm.tick( );
+	ip = vm.instruction_ptr;
+	++count;
+	if( vm.is_instrumented( ) ) {
+		goto done;
+	}
+	SC_DISPATCH( );
+
+done:
+	vm.instruction_ptr = ip;
+	return count;
+#undef SC_BODY_wmem
+#undef SC_BODY_rmem
+#undef SC_BODY_not
+#undef SC_BODY_or
+#undef SC_BODY_and
+#undef SC_BODY_mult
+#undef SC_BODY_add
+#undef SC_BODY_jf
+#undef SC_BODY_jt
+#undef SC_BODY_gt
+#undef SC_BODY_eq
+#undef SC_BODY_pop
+#undef SC_BODY_push
+#undef SC_BODY_set
+#undef SC_NEXT
+#undef SC_DISPATCH
+}
@@ -32,7 +32,7 @@
 #include "vm.h"
 #include "file_helper.h"
 
-int main( int argc, char** argv ) {
+int main( int argc, char** argv ) try {
 	if( argc <= 1 ) {
 		std::cerr << "Must supply a vm file" << std::endl;
 		exit( EXIT_FAILURE );
@@ -41,5 +41,7 @@ int main( int argc, char** argv ) {
 	std::cout << dump_memory( vm ) << std::endl;
 
 	return EXIT_SUCCESS;
+} catch( vm_exit_t const & e ) {
+	return e.report( );
 }
 
@@ -0,0 +1,509 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "decode_cache.h"
+#include "vm.h"
+
+// Ahead of time recompiler.  Translates every instruction reachable from the image's
+// instruction ptr into straight-line C++ that is built against aot_runtime.cpp.  Targets of
+// indirect jumps that were not found statically and code that is overwritten at run time
+// are handled by the runtime's interpreter fallback
+namespace {
+	enum op_code_t : uint8_t { HALT = 0, SET, PUSH, POP, EQ, GT, JMP, JT, JF, ADD, MULT, MOD, AND, OR, NOT, RMEM, WMEM, CALL, RET, OUT, IN, NOOP };
+
+	uint16_t const MODULO = virtual_machine_t::MODULO;
+
+	using entry_t = decode_cache_t::entry_t;
+
+	bool is_register( uint16_t raw ) {
+		return virtual_machine_t::is_register( raw );
+	}
+
+	// Left to the interpreter, either because the console may intercept it or because it is
+	// an error the interpreter reports
+	bool is_interpreted( entry_t const & e ) {
+		switch( e.op_code ) {
+		case HALT:
+		case IN:
+			return true;
+		case SET:
+			return !is_register( e.args[0] );
+		case MOD:
+			return !is_register( e.args[2] ) && e.args[2] == 0;
+		default:
+			return false;
+		}
+	}
+
+	bool falls_through( entry_t const & e ) {
+		switch( e.op_code ) {
+		case JMP:
+		case JT:
+		case JF:
+		case CALL:
+		case RET:
+			return false;
+		default:
+			return !is_interpreted( e );
+		}
+	}
+
+	std::string value( uint16_t raw ) {
+		if( is_register( raw ) ) {
+			return "r" + std::to_string( raw - virtual_machine_t::REGISTER0 );
+		}
+		return std::to_string( raw );
+	}
+
+	std::string disassemble( uint16_t address, entry_t const & e ) {
+		auto const & decoded = instructions::decoder( )[e.op_code];
+		std::string result = std::to_string( address ) + ": " + decoded.name;
+		for( size_t n = 0; n < decoded.arg_count; ++n ) {
+			result += " " + value( e.args[n] );
+		}
+		return result;
+	}
+
+	// Could value be the address of a function reached through an indirect call.  Taken to be
+	// any instruction other than HALT that directly follows a RET or a JMP
+	bool is_function_entry( virtual_machine_t & vm, uint16_t value ) {
+		if( value < 2 || value >= MODULO ) {
+			return false;
+		}
+		auto const * entry = vm.decode_cache.fetch( vm.memory, value );
+		if( entry == nullptr || entry->op_code == HALT ) {
+			return false;
+		}
+		return vm.memory[value - 1u] == RET || vm.memory[value - 2u] == JMP;
+	}
+
+	struct block_t {
+		uint16_t start;
+		uint16_t end;
+		std::vector<std::pair<uint16_t, entry_t>> instructions;
+		std::vector<uint16_t> words;	// memory [start, end) the block was translated from
+	};	// struct block_t
+
+	// Straight-line blocks reachable from the instruction ptr and return addresses of vm in its
+	// current memory
+	std::vector<block_t> find_blocks( virtual_machine_t & vm ) {
+		std::vector<bool> is_reachable( MODULO, false );
+		std::vector<bool> is_start( MODULO, false );
+		std::vector<uint16_t> pending;
+		auto const add_start = [&]( uint32_t address ) {
+			if( address < MODULO ) {
+				is_start[address] = true;
+				pending.push_back( static_cast<uint16_t>(address) );
+			}
+		};
+		auto const add_next = [&]( uint32_t address ) {
+			if( address < MODULO ) {
+				pending.push_back( static_cast<uint16_t>(address) );
+			}
+		};
+		add_start( vm.instruction_ptr );
+		for( auto const return_address : vm.program_stack ) {
+			add_start( return_address );
+		}
+		// Function pointers kept in data tables
+		for( auto const word : vm.memory ) {
+			if( is_function_entry( vm, word ) ) {
+				add_start( word );
+			}
+		}
+		while( !pending.empty( ) ) {
+			auto const address = pending.back( );
+			pending.pop_back( );
+			if( is_reachable[address] ) {
+				continue;
+			}
+			auto const * entry = vm.decode_cache.fetch( vm.memory, address );
+			if( entry == nullptr ) {
+				// Only an error if it is ever run, leave that to the interpreter
+				continue;
+			}
+			is_reachable[address] = true;
+			auto const & e = *entry;
+			uint32_t const next = address + e.length;
+			switch( e.op_code ) {
+			case JMP:
+				if( !is_register( e.args[0] ) ) {
+					add_start( e.args[0] );
+				}
+				break;
+			case JT:
+			case JF:
+				if( !is_register( e.args[1] ) ) {
+					add_start( e.args[1] );
+				}
+				add_start( next );
+				break;
+			case CALL:
+				if( !is_register( e.args[0] ) ) {
+					add_start( e.args[0] );
+				}
+				add_start( next );
+				break;
+			case SET:
+			case PUSH: {
+				// Code addresses passed around as values are likely targets of indirect calls
+				auto const operand = e.args[e.op_code == SET ? 1 : 0];
+				if( is_function_entry( vm, operand ) ) {
+					add_start( operand );
+				}
+				add_next( next );
+				break;
+			}
+			case RET:
+			case HALT:
+				break;
+			default:
+				if( is_interpreted( e ) ) {
+					add_start( next );
+				} else {
+					add_next( next );
+				}
+				break;
+			}
+		}
+
+		std::vector<block_t> blocks;
+		for( uint32_t start = 0; start < MODULO; ++start ) {
+			if( !is_start[start] || !is_reachable[start] ) {
+				continue;
+			}
+			block_t block { static_cast<uint16_t>(start), 0, { }, { } };
+			uint32_t address = start;
+			while( true ) {
+				auto const & e = *vm.decode_cache.fetch( vm.memory, static_cast<uint16_t>(address) );
+				block.instructions.emplace_back( static_cast<uint16_t>(address), e );
+				address += e.length;
+				if( !falls_through( e ) || address >= MODULO || is_start[address] || !is_reachable[address] ) {
+					break;
+				}
+			}
+			block.end = static_cast<uint16_t>(address);
+			block.words.assign( vm.memory.begin( ) + block.start, vm.memory.begin( ) + block.end );
+			blocks.push_back( std::move( block ) );
+		}
+		return blocks;
+	}
+
+	// Run the image until it first asks for input so that code it decrypts or builds at
+	// start up can be translated too.  Output is discarded, the generated program repeats it
+	void warm_up( virtual_machine_t & vm, uint64_t max_instructions ) {
+		vm.output.set_sink( null_sink( ) );
+		for( uint64_t n = 0; n < max_instructions; ++n ) {
+			auto const * entry = vm.decode_cache.fetch( vm.memory, vm.instruction_ptr );
+			if( entry == nullptr || entry->op_code == IN || entry->op_code == HALT ) {
+				break;
+			}
+			vm.tick( );
+		}
+		vm.output.set_sink( stream_sink( std::cout ) );
+	}
+
+	struct translator_t {
+		std::vector<block_t> blocks;
+		std::vector<bool> has_block;
+		std::set<uint16_t> used_labels;
+
+		// Blocks from later passes are only used where no earlier block starts
+		explicit translator_t( std::vector<std::vector<block_t>> passes ):
+			blocks( ),
+			has_block( MODULO, false ),
+			used_labels( ) {
+
+			for( auto & pass : passes ) {
+				for( auto & block : pass ) {
+					if( !has_block[block.start] ) {
+						has_block[block.start] = true;
+						blocks.push_back( std::move( block ) );
+					}
+				}
+			}
+			std::sort( blocks.begin( ), blocks.end( ), []( block_t const & lhs, block_t const & rhs ) {
+				return lhs.start < rhs.start;
+			} );
+		}
+
+		// Transfer to a known address, straight to its block unless something has changed
+		std::string jump( uint32_t target ) {
+			if( target < MODULO && has_block[target] ) {
+				used_labels.insert( static_cast<uint16_t>(target) );
+				return "SC_JUMP( " + std::to_string( target ) + " );";
+			}
+			return "{ ip = " + std::to_string( target ) + "; goto dispatch; }";
+		}
+
+		static std::string store( uint16_t dest, std::string const & expression, uint32_t next ) {
+			if( is_register( dest ) ) {
+				return value( dest ) + " = static_cast<uint16_t>( " + expression + " );";
+			}
+			return "if( rt.write( " + value( dest ) + ", static_cast<uint16_t>( " + expression + " ) ) ) { ip = " + std::to_string( next ) + "; goto dispatch; }";
+		}
+
+		static std::string to_interpreter( uint16_t address ) {
+			return "{ ip = " + std::to_string( address ) + "; goto interpret; }";
+		}
+
+		static std::string check_value( uint16_t raw, uint16_t address ) {
+			if( !is_register( raw ) ) {
+				return "";
+			}
+			return "if( " + value( raw ) + " >= 32768 ) " + to_interpreter( address ) + "\n";
+		}
+
+		std::string translate( uint16_t address, entry_t const & e ) {
+			auto const a = e.args[0];
+			auto const b = e.args[1];
+			auto const c = e.args[2];
+			uint32_t const next = address + e.length;
+			if( is_interpreted( e ) ) {
+				return to_interpreter( address );
+			}
+			switch( e.op_code ) {
+			case SET:
+				return value( a ) + " = " + value( b ) + ";";
+			case PUSH:
+				return "stack.push_back( " + value( a ) + " );";
+			case POP:
+				// Popped values are operands to the interpreter, only plain values are handled here
+				return "if( stack.empty( ) || stack.back( ) >= 32768 ) " + to_interpreter( address ) + "\n"
+					"{ uint16_t const top = stack.back( ); stack.pop_back( ); " + store( a, "top", next ) + " }";
+			case EQ:
+				return store( a, value( b ) + " == " + value( c ) + " ? 1 : 0", next );
+			case GT:
+				return store( a, value( b ) + " > " + value( c ) + " ? 1 : 0", next );
+			case JMP:
+				if( is_register( a ) ) {
+					return "ip = " + value( a ) + "; goto dispatch;";
+				}
+				return jump( a );
+			case JT:
+			case JF: {
+				std::string const condition = value( a ) + (e.op_code == JT ? " != 0" : " == 0");
+				std::string const taken = is_register( b ) ? "{ ip = " + value( b ) + "; goto dispatch; }" : jump( b );
+				return "if( " + condition + " ) " + taken + "\n" + jump( next );
+			}
+			case ADD:
+				return store( a, "(" + value( b ) + " + " + value( c ) + ") & 32767", next );
+			case MULT:
+				return store( a, "(static_cast<uint32_t>( " + value( b ) + " ) * " + value( c ) + ") & 32767", next );
+			case MOD:
+				return "if( " + value( c ) + " == 0 ) " + to_interpreter( address ) + "\n" + store( a, value( b ) + " % " + value( c ), next );
+			case AND:
+				return store( a, value( b ) + " & " + value( c ), next );
+			case OR:
+				return store( a, value( b ) + " | " + value( c ), next );
+			case NOT:
+				return store( a, value( b ) + " ^ 32767", next );
+			case RMEM:
+				return check_value( b, address ) + store( a, "mem[" + value( b ) + "]", next );
+			case WMEM:
+				return check_value( a, address ) + check_value( b, address )
+					+ "if( rt.write( " + value( a ) + ", " + value( b ) + " ) ) { ip = " + std::to_string( next ) + "; goto dispatch; }";
+			case CALL:
+				// Native overrides are looked up by the interpreter
+				return "if( rt.vm.overrides.is_overridden( " + value( a ) + " ) ) " + to_interpreter( address ) + "\n"
+					+ "stack.push_back( " + std::to_string( next ) + " );\n"
+					+ (is_register( a ) ? "ip = " + value( a ) + "; goto dispatch;" : jump( a ));
+			case RET:
+				return "if( stack.empty( ) ) " + to_interpreter( address ) + "\n"
+					"ip = stack.back( ); stack.pop_back( ); goto dispatch;";
+			case OUT:
+				return "rt.vm.output.put( static_cast<char>( " + value( a ) + " ) );";
+			case NOOP:
+				return "";
+			default:
+				std::cerr << "FATAL ERROR: Unexpected opcode " << static_cast<int>(e.op_code) << " @ location " << address << std::endl;
+				exit( EXIT_FAILURE );
+			}
+		}
+
+		std::string translate( block_t const & block, uint32_t next_block_start ) {
+			std::stringstream ss;
+			for( auto const & instruction : block.instructions ) {
+				ss << "\t\t// " << disassemble( instruction.first, instruction.second ) << "\n";
+				std::stringstream code( translate( instruction.first, instruction.second ) );
+				std::string line;
+				while( std::getline( code, line ) ) {
+					ss << "\t\t" << line << "\n";
+				}
+			}
+			if( falls_through( block.instructions.back( ).second ) ) {
+				if( block.end == next_block_start ) {
+					ss << "\t\tif( !rt.is_ready( " << block.end << " ) ) { ip = " << block.end << "; goto dispatch; }\n";
+				} else {
+					ss << "\t\t" << jump( block.end ) << "\n";
+				}
+			}
+			return ss.str( );
+		}
+	};	// struct translator_t
+
+	template<typename Iterator>
+	void write_words( std::ostream & os, Iterator first, Iterator last ) {
+		size_t count = 0;
+		for( auto it = first; it != last; ++it, ++count ) {
+			os << (count % 16 == 0 ? "\n\t\t" : " ") << *it << ",";
+		}
+		os << "\n";
+	}
+
+	void write_program( std::ostream & os, virtual_machine_t & vm, translator_t & program, std::string const & source_name ) {
+		std::vector<std::string> bodies;
+		for( size_t n = 0; n < program.blocks.size( ); ++n ) {
+			auto const next_block_start = n + 1 < program.blocks.size( ) ? program.blocks[n + 1].start : MODULO;
+			bodies.push_back( program.translate( program.blocks[n], next_block_start ) );
+		}
+
+		os << "// Generated by to_cpp from " << source_name << ".  Build with aot_runtime.cpp and the vm sources\n\n";
+		os << "#include <cstdint>\n#include <iostream>\n#include \"aot_runtime.h\"\n\n";
+		os << "namespace {\n";
+		os << "\tuint16_t const image_memory[" << vm.memory.size( ) << "] = {";
+		write_words( os, vm.memory.begin( ), vm.memory.end( ) );
+		os << "\t};\n\n";
+		os << "\tuint16_t const image_registers[" << vm.registers.size( ) << "] = {";
+		write_words( os, vm.registers.begin( ), vm.registers.end( ) );
+		os << "\t};\n\n";
+		os << "\tuint16_t const image_program_stack[" << vm.program_stack.size( ) + 1 << "] = {";
+		write_words( os, vm.program_stack.begin( ), vm.program_stack.end( ) );
+		os << "\t\t0\n\t};\n\n";
+		os << "\taot_block_t const image_blocks[" << program.blocks.size( ) << "] = {\n";
+		std::vector<uint16_t> code;
+		for( auto const & block : program.blocks ) {
+			os << "\t\t{ " << block.start << ", " << block.end << ", " << code.size( ) << " },\n";
+			code.insert( code.end( ), block.words.begin( ), block.words.end( ) );
+		}
+		os << "\t};\n\n";
+		os << "\tuint16_t const image_code[" << code.size( ) + 1 << "] = {";
+		write_words( os, code.begin( ), code.end( ) );
+		os << "\t\t0\n\t};\n\n";
+
+		os << "#define SC_SAVE( ) ";
+		for( int n = 0; n < 8; ++n ) {
+			os << "vm.registers[" << n << "] = r" << n << "; ";
+		}
+		os << "vm.instruction_ptr = ip\n";
+		os << "#define SC_LOAD( ) ";
+		for( int n = 0; n < 8; ++n ) {
+			os << "r" << n << " = vm.registers[" << n << "]; ";
+		}
+		os << "ip = vm.instruction_ptr\n";
+		os << "#define SC_JUMP( address ) do { if( !rt.is_ready( address ) ) { ip = address; goto dispatch; } goto L_##address; } while( false )\n\n";
+
+		os << "\tvoid aot_run( aot_runtime_t & rt ) {\n";
+		os << "\t\tauto & vm = rt.vm;\n";
+		os << "\t\tauto & stack = vm.program_stack;\n";
+		os << "\t\tuint16_t const * const mem = &vm.memory[0];\n";
+		os << "\t\tuint16_t r0, r1, r2, r3, r4, r5, r6, r7, ip;\n";
+		os << "\t\tSC_LOAD( );\n";
+		os << "\t\tgoto dispatch;\n";
+		os << "\tinterpret:\n";
+		os << "\t\tSC_SAVE( );\n";
+		os << "\t\trt.interpret( );\n";
+		os << "\t\tSC_LOAD( );\n";
+		os << "\tdispatch:\n";
+		os << "\t\tif( !rt.enter( ip ) ) {\n\t\t\tgoto interpret;\n\t\t}\n";
+		os << "\t\tswitch( ip ) {\n";
+		for( size_t n = 0; n < program.blocks.size( ); ++n ) {
+			auto const start = program.blocks[n].start;
+			os << "\tcase " << start << ":\n";
+			if( program.used_labels.count( start ) > 0 ) {
+				os << "\tL_" << start << ":\n";
+			}
+			os << bodies[n];
+		}
+		os << "\tdefault:\n\t\tgoto interpret;\n";
+		os << "\t\t}\n";
+		os << "\t}\n";
+		os << "\n#undef SC_JUMP\n#undef SC_LOAD\n#undef SC_SAVE\n";
+		os << "}\t// namespace\n\n";
+
+		os << "int main( ) {\n";
+		os << "\taot_image_t const image { image_memory, image_registers, " << vm.instruction_ptr << ", image_program_stack, "
+			<< vm.program_stack.size( ) << ", image_blocks, " << program.blocks.size( ) << ", image_code };\n";
+		os << "\treturn aot_main( image, aot_run );\n";
+		os << "}\n";
+	}
+}	// namespace
+
+int main( int argc, char** argv ) try {
+	// By default run for up to 100M instructions before the first IN
+	uint64_t warm_up_instructions = 100000000;
+	std::vector<std::string> files;
+	for( int n = 1; n < argc; ++n ) {
+		std::string const arg = argv[n];
+		if( arg.compare( 0, 9, "--warmup=" ) == 0 ) {
+			warm_up_instructions = std::stoull( arg.substr( 9 ) );
+		} else {
+			files.push_back( arg );
+		}
+	}
+	if( files.empty( ) || files.size( ) > 2 ) {
+		std::cerr << "Must supply a vm file" << std::endl;
+		std::cerr << "Usage: " << argv[0] << " [--warmup=<instructions>] <vm file> [<output.cpp>]" << std::endl;
+		exit( EXIT_FAILURE );
+	}
+	virtual_machine_t vm( files[0] );
+	std::vector<std::vector<block_t>> passes;
+	if( warm_up_instructions > 0 ) {
+		std::unique_ptr<virtual_machine_t> warm( new virtual_machine_t( files[0] ) );
+		warm_up( *warm, warm_up_instructions );
+		passes.push_back( find_blocks( *warm ) );
+	}
+	passes.push_back( find_blocks( vm ) );
+	translator_t program( std::move( passes ) );
+
+	size_t instruction_count = 0;
+	for( auto const & block : program.blocks ) {
+		instruction_count += block.instructions.size( );
+	}
+	std::cerr << "Translated " << instruction_count << " instructions in " << program.blocks.size( ) << " blocks" << std::endl;
+
+	if( files.size( ) > 1 ) {
+		std::ofstream output( files[1] );
+		if( !output ) {
+			std::cerr << "Error opening file: " << files[1] << std::endl;
+			exit( EXIT_FAILURE );
+		}
+		write_program( output, vm, program, files[0] );
+	} else {
+		write_program( std::cout, vm, program, files[0] );
+	}
+	return EXIT_SUCCESS;
+} catch( vm_exit_t const & e ) {
+	return e.report( );
+}
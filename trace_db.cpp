@@ -0,0 +1,321 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+
+#include <algorithm>
+#include <cstdlib>
+#include <iterator>
+#include <limits>
+#include <numeric>
+#include <sstream>
+#include <boost/filesystem.hpp>
+#include "trace_db.h"
+#include "vm.h"
+
+namespace {
+	template<typename... Args>
+	[[noreturn]] void trace_error( Args const & ... args ) {
+		std::stringstream ss;
+		using expander = int[];
+		(void)expander { 0, ((ss << args), 0)... };
+		throw vm_exit_t( EXIT_FAILURE, ss.str( ) );
+	}
+
+	long const HEADER_BYTES = 2 * sizeof( uint32_t );
+	size_t const HEADER_ITEMS = 4;
+	size_t const BATCH = 4096;
+
+	// Opens a trace file and returns how many records it holds
+	std::FILE * open_trace( std::string const & filename, uint64_t & count ) {
+		std::FILE * result = std::fopen( filename.c_str( ), "rb" );
+		if( result == nullptr ) {
+			trace_error( "Error opening file: ", filename );
+		}
+		uint32_t header[2];
+		if( std::fread( header, sizeof( header ), 1, result ) != 1 || header[0] != trace_writer_t::TRACE_MAGIC || header[1] != trace_writer_t::TRACE_VERSION ) {
+			std::fclose( result );
+			trace_error( "Not a trace file: ", filename );
+		}
+		std::fseek( result, 0, SEEK_END );
+		count = static_cast<uint64_t>(std::ftell( result ) - HEADER_BYTES) / sizeof( trace_record_t );
+		std::fseek( result, HEADER_BYTES, SEEK_SET );
+		return result;
+	}
+
+	// Mapping a missing file throws from inside the mapping, say which file instead
+	std::string const & existing_index( std::string const & filename ) {
+		if( !boost::filesystem::exists( filename ) ) {
+			trace_error( "Error opening file: ", filename );
+		}
+		return filename;
+	}
+
+	// Calls f( step, record ) for each record from step first on, stopping at last
+	template<typename Function>
+	void for_each_record( std::FILE * trace, uint64_t first, uint64_t last, Function f ) {
+		std::fseek( trace, static_cast<long>(HEADER_BYTES + first * sizeof( trace_record_t )), SEEK_SET );
+		std::vector<trace_record_t> batch( BATCH );
+		auto step = first;
+		while( step < last ) {
+			auto const wanted = static_cast<size_t>(std::min<uint64_t>( BATCH, last - step ));
+			auto const count = std::fread( batch.data( ), sizeof( trace_record_t ), wanted, trace );
+			if( count == 0 ) {
+				trace_error( "Trace ended early at step ", step );
+			}
+			for( size_t n = 0; n < count; ++n, ++step ) {
+				f( step, batch[n] );
+			}
+		}
+	}
+
+	// The same layout as save_state
+	std::vector<uint16_t> full_state( virtual_machine_t & vm ) {
+		std::vector<uint16_t> result( vm.memory.begin( ), vm.memory.end( ) );
+		result.insert( result.end( ), vm.registers.begin( ), vm.registers.end( ) );
+		result.push_back( vm.instruction_ptr );
+		result.push_back( static_cast<uint16_t>(vm.program_stack.size( )) );
+		result.insert( result.end( ), vm.program_stack.begin( ), vm.program_stack.end( ) );
+		result.push_back( 0 );
+		return result;
+	}
+}	// namespace anonymous
+
+uint16_t executed_address( trace_record_t const & record ) {
+	auto const length = 1 + instructions::decoder( )[record.op_code].arg_count;
+	return static_cast<uint16_t>((record.instruction_ptr - length) % trace_db_t::MEMORY_SIZE);
+}
+
+void apply_trace_record( virtual_machine_t & vm, trace_record_t const & record ) {
+	switch( record.op_code ) {
+	case 2:	// PUSH
+		vm.program_stack.push_back( vm.is_register( record.args[0] ) ? vm.get_register( record.args[0] ) : record.args[0] );
+		break;
+	case 17:	// CALL, the record's ip is the return address
+		vm.program_stack.push_back( record.instruction_ptr );
+		break;
+	case 3:	// POP
+	case 18:	// RET
+		if( !vm.program_stack.empty( ) ) {
+			vm.program_stack.pop_back( );
+		}
+		break;
+	default:
+		break;
+	}
+	if( (record.flags & trace_record_t::HAS_CHANGE) != 0 ) {
+		if( record.address < trace_db_t::MEMORY_SIZE ) {
+			vm.set_memory( record.address, record.new_value );
+		} else if( record.address < trace_db_t::ADDRESS_COUNT ) {
+			vm.get_register( record.address ) = record.new_value;
+		}
+	}
+}
+
+void trace_db_t::build( std::string const & trace_file, std::string const & state_file, std::string const & index_file ) {
+	uint64_t record_count = 0;
+	std::unique_ptr<std::FILE, int( * )( std::FILE * )> trace( open_trace( trace_file, record_count ), &std::fclose );
+	if( record_count >= std::numeric_limits<uint32_t>::max( ) ) {
+		trace_error( "Trace too long to index: ", trace_file );
+	}
+	// First pass counts entries for each table and takes the checkpoints
+	virtual_machine_t vm;
+	vm.load_state( state_file );
+	std::vector<uint32_t> write_offsets( ADDRESS_COUNT + 1, 0 );
+	std::vector<uint32_t> execution_offsets( MEMORY_SIZE + 1, 0 );
+	std::vector<std::vector<uint16_t>> checkpoints;
+	for_each_record( trace.get( ), 0, record_count, [&]( uint64_t step, trace_record_t const & record ) {
+		if( step % CHECKPOINT_INTERVAL == 0 ) {
+			vm.instruction_ptr = executed_address( record );
+			checkpoints.push_back( full_state( vm ) );
+		}
+		if( (record.flags & trace_record_t::HAS_CHANGE) != 0 && record.address < ADDRESS_COUNT ) {
+			++write_offsets[record.address + 1];
+		}
+		++execution_offsets[executed_address( record ) + 1];
+		apply_trace_record( vm, record );
+	} );
+	std::partial_sum( write_offsets.begin( ), write_offsets.end( ), write_offsets.begin( ) );
+	std::partial_sum( execution_offsets.begin( ), execution_offsets.end( ), execution_offsets.begin( ) );
+	std::vector<uint32_t> checkpoint_offsets( 1, 0 );
+	for( auto const & checkpoint : checkpoints ) {
+		checkpoint_offsets.push_back( checkpoint_offsets.back( ) + static_cast<uint32_t>((checkpoint.size( ) + 1) / 2) );
+	}
+
+	auto const write_table = HEADER_ITEMS;
+	auto const execution_table = write_table + write_offsets.size( ) + write_offsets.back( );
+	auto const checkpoint_table = execution_table + execution_offsets.size( ) + execution_offsets.back( );
+	auto const total_items = checkpoint_table + checkpoint_offsets.size( ) + checkpoint_offsets.back( );
+	FileAsContainer<uint32_t> f( index_file, total_items, 0, true );
+	if( !f ) {
+		trace_error( "Error opening file: ", index_file );
+	}
+	auto const index = f.begin( );
+	index[0] = INDEX_MAGIC;
+	index[1] = INDEX_VERSION;
+	index[2] = static_cast<uint32_t>(record_count);
+	index[3] = static_cast<uint32_t>(checkpoints.size( ));
+	std::copy( write_offsets.begin( ), write_offsets.end( ), index + write_table );
+	std::copy( execution_offsets.begin( ), execution_offsets.end( ), index + execution_table );
+	std::copy( checkpoint_offsets.begin( ), checkpoint_offsets.end( ), index + checkpoint_table );
+
+	// Second pass fills in the steps, in order so each list can be binary searched
+	auto const writes = index + write_table + write_offsets.size( );
+	auto const executions = index + execution_table + execution_offsets.size( );
+	for_each_record( trace.get( ), 0, record_count, [&]( uint64_t step, trace_record_t const & record ) {
+		if( (record.flags & trace_record_t::HAS_CHANGE) != 0 && record.address < ADDRESS_COUNT ) {
+			writes[write_offsets[record.address]++] = static_cast<uint32_t>(step);
+		}
+		executions[execution_offsets[executed_address( record )]++] = static_cast<uint32_t>(step);
+	} );
+
+	auto const checkpoint_data = index + checkpoint_table + checkpoint_offsets.size( );
+	for( size_t n = 0; n < checkpoints.size( ); ++n ) {
+		auto const & checkpoint = checkpoints[n];
+		for( size_t pos = 0; pos < checkpoint.size( ); pos += 2 ) {
+			auto const high = pos + 1 < checkpoint.size( ) ? checkpoint[pos + 1] : 0;
+			checkpoint_data[checkpoint_offsets[n] + pos / 2] = checkpoint[pos] | static_cast<uint32_t>(high) << 16;
+		}
+	}
+	f.close( );
+}
+
+trace_db_t::trace_db_t( std::string const & trace_file, std::string const & index_file ):
+	m_trace( nullptr ),
+	m_index( existing_index( index_file ) ),
+	m_tables { } {
+
+	if( !m_index || m_index.size( ) < HEADER_ITEMS || m_index[0] != INDEX_MAGIC || m_index[1] != INDEX_VERSION ) {
+		trace_error( "Not a trace index: ", index_file );
+	}
+	uint64_t record_count = 0;
+	m_trace = open_trace( trace_file, record_count );
+	if( record_count != m_index[2] ) {
+		std::fclose( m_trace );
+		trace_error( "Trace index ", index_file, " does not belong to ", trace_file );
+	}
+	// Each table is its offsets, the last being the number of items, then its items
+	size_t const entries[] = { ADDRESS_COUNT, MEMORY_SIZE, m_index[3] };
+	size_t position = HEADER_ITEMS;
+	for( size_t table = 0; table < 3; ++table ) {
+		m_tables[table] = position;
+		if( m_index.size( ) < position + entries[table] + 1 ) {
+			std::fclose( m_trace );
+			trace_error( "Truncated trace index: ", index_file );
+		}
+		position += entries[table] + 1 + m_index[position + entries[table]];
+	}
+	if( m_index.size( ) < position ) {
+		std::fclose( m_trace );
+		trace_error( "Truncated trace index: ", index_file );
+	}
+}
+
+trace_db_t::~trace_db_t( ) {
+	std::fclose( m_trace );
+}
+
+uint64_t trace_db_t::size( ) const {
+	return m_index[2];
+}
+
+trace_record_t trace_db_t::record( uint64_t step ) const {
+	if( step >= size( ) ) {
+		trace_error( "Step ", step, " is past the end of the trace" );
+	}
+	trace_record_t result;
+	for_each_record( m_trace, step, step + 1, [&result]( uint64_t, trace_record_t const & record ) { result = record; } );
+	return result;
+}
+
+uint32_t const * trace_db_t::steps( size_t table, size_t entry, size_t & count ) const {
+	size_t const entries[] = { ADDRESS_COUNT, MEMORY_SIZE, m_index[3] };
+	auto const offsets = m_index.begin( ) + m_tables[table];
+	count = offsets[entry + 1] - offsets[entry];
+	return offsets + entries[table] + 1 + offsets[entry];
+}
+
+bool trace_db_t::last_write( uint16_t address, uint64_t step, uint64_t & result ) const {
+	if( address >= ADDRESS_COUNT ) {
+		return false;
+	}
+	size_t count = 0;
+	auto const first = steps( 0, address, count );
+	auto const it = std::lower_bound( first, first + count, step );
+	if( it == first ) {
+		return false;
+	}
+	result = *(it - 1);
+	return true;
+}
+
+std::vector<uint64_t> trace_db_t::executions( uint16_t ip, uint64_t step, size_t count ) const {
+	std::vector<uint64_t> result;
+	if( ip >= MEMORY_SIZE ) {
+		return result;
+	}
+	size_t total = 0;
+	auto const first = steps( 1, ip, total );
+	for( auto it = std::lower_bound( first, first + total, step ); it != first + total && result.size( ) < count; ++it ) {
+		result.push_back( *it );
+	}
+	return result;
+}
+
+size_t trace_db_t::execution_count( uint16_t ip ) const {
+	size_t result = 0;
+	if( ip < MEMORY_SIZE ) {
+		steps( 1, ip, result );
+	}
+	return result;
+}
+
+std::unique_ptr<virtual_machine_t> trace_db_t::state_at( uint64_t step ) const {
+	if( step >= size( ) ) {
+		trace_error( "Step ", step, " is past the end of the trace" );
+	}
+	auto const checkpoint = step / CHECKPOINT_INTERVAL;
+	size_t count = 0;
+	auto const packed = steps( 2, static_cast<size_t>(checkpoint), count );
+	std::vector<uint16_t> state( 2 * count );
+	for( size_t n = 0; n < count; ++n ) {
+		state[2 * n] = static_cast<uint16_t>(packed[n]);
+		state[2 * n + 1] = static_cast<uint16_t>(packed[n] >> 16);
+	}
+
+	std::unique_ptr<virtual_machine_t> result( new virtual_machine_t( ) );
+	auto & vm = *result;
+	auto it = state.begin( );
+	std::copy( it, it + MEMORY_SIZE, vm.memory.begin( ) );
+	it += MEMORY_SIZE;
+	std::copy( it, it + vm.registers.size( ), vm.registers.begin( ) );
+	it += vm.registers.size( );
+	vm.instruction_ptr = *it++;
+	size_t const stack_size = *it++;
+	std::copy( it, it + stack_size, std::back_inserter( vm.program_stack ) );
+
+	for_each_record( m_trace, checkpoint * CHECKPOINT_INTERVAL, step, [&vm]( uint64_t, trace_record_t const & record ) {
+		apply_trace_record( vm, record );
+	} );
+	vm.instruction_ptr = executed_address( record( step ) );
+	return result;
+}
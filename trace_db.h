@@ -0,0 +1,87 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+#include "file_helper.h"
+#include "trace_writer.h"
+
+struct virtual_machine_t;
+
+// Index over a trace written by trace_writer_t and the state it started in, answering
+// queries in O(log n) instead of scanning the trace.  Step n is the n'th record of the
+// trace and the state at step n is the state before it executes.
+// Format of index file in uint32_t's
+// 0 -> INDEX_MAGIC
+// 1 -> INDEX_VERSION
+// 2 -> number of records
+// 3 -> number of checkpoints, one every CHECKPOINT_INTERVAL steps starting at 0
+// next -> ADDRESS_COUNT + 1 offsets into the write steps, then the steps writing each 
+//	memory address and register in order
+// next -> MEMORY_SIZE + 1 offsets into the execution steps, then the steps executing 
+//	each address in order
+// next -> checkpoints + 1 offsets into the checkpoints, then each checkpoint as the 
+//	uint16_t's of a full state saved by save_state, two to an item
+struct trace_db_t final {
+	static uint32_t const INDEX_MAGIC = 0x58444353;	// "SCDX"
+	static uint32_t const INDEX_VERSION = 1;
+	static uint64_t const CHECKPOINT_INTERVAL = 1u << 20;
+	static size_t const MEMORY_SIZE = 32768;
+	static size_t const ADDRESS_COUNT = MEMORY_SIZE + 8;
+
+	// Errors are thrown as vm_exit_t
+	static void build( std::string const & trace_file, std::string const & state_file, std::string const & index_file );
+
+	trace_db_t( std::string const & trace_file, std::string const & index_file );
+	trace_db_t( trace_db_t const & ) = delete;
+	trace_db_t & operator=( trace_db_t const & ) = delete;
+	~trace_db_t( );
+
+	uint64_t size( ) const;
+	trace_record_t record( uint64_t step ) const;
+	// Last step before step writing to address, false if there is none
+	bool last_write( uint16_t address, uint64_t step, uint64_t & result ) const;
+	// Up to count steps from step on that execute the instruction at ip
+	std::vector<uint64_t> executions( uint16_t ip, uint64_t step, size_t count ) const;
+	size_t execution_count( uint16_t ip ) const;
+	// Memory, registers, ip and program stack at step, rebuilt from the checkpoint before it
+	std::unique_ptr<virtual_machine_t> state_at( uint64_t step ) const;
+private:
+	uint32_t const * steps( size_t table, size_t entry, size_t & count ) const;
+
+	std::FILE * m_trace;
+	ReadOnlyFileAsContainer<uint32_t> m_index;
+	size_t m_tables[3];	// offsets of the write, execution and checkpoint tables
+};	// struct trace_db_t
+
+// Address of the instruction a record executed, records hold the ip after it
+uint16_t executed_address( trace_record_t const & record );
+
+// Redo the effects of a record on memory, registers and the program stack.  Effects of
+// native overrides are not traced and so not redone
+void apply_trace_record( virtual_machine_t & vm, trace_record_t const & record );
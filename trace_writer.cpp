@@ -0,0 +1,124 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+
+#include <array>
+#include <chrono>
+#include <fstream>
+#include <vector>
+#include "trace_writer.h"
+#include "vm.h"
+
+trace_writer_t::trace_writer_t( ):
+	m_ring( ),
+	m_file( nullptr ),
+	m_thread( ),
+	m_stopping( false ),
+	m_count( 0 ) { }
+
+trace_writer_t::~trace_writer_t( ) {
+	stop( );
+}
+
+bool trace_writer_t::start( std::string const & filename ) {
+	stop( );
+	m_file = std::fopen( filename.c_str( ), "wb" );
+	if( m_file == nullptr ) {
+		return false;
+	}
+	uint32_t const header[] = { TRACE_MAGIC, TRACE_VERSION };
+	std::fwrite( header, sizeof( header ), 1, m_file );
+	if( !m_ring ) {
+		m_ring.reset( new spsc_ring_t<trace_record_t, RING_SIZE>( ) );
+	}
+	m_count = 0;
+	m_stopping = false;
+	m_thread = std::thread( [this]( ) { drain( ); } );
+	return true;
+}
+
+void trace_writer_t::stop( ) {
+	if( m_file == nullptr ) {
+		return;
+	}
+	m_stopping = true;
+	m_thread.join( );
+	std::fclose( m_file );
+	m_file = nullptr;
+}
+
+void trace_writer_t::drain( ) {
+	std::vector<trace_record_t> batch( 4096 );
+	while( true ) {
+		// Read the flag first so that nothing pushed before stop( ) is missed
+		bool const is_stopping = m_stopping;
+		auto const count = m_ring->try_pop( batch.data( ), batch.size( ) );
+		if( count > 0 ) {
+			std::fwrite( batch.data( ), sizeof( trace_record_t ), count, m_file );
+		} else if( is_stopping ) {
+			return;
+		} else {
+			std::this_thread::sleep_for( std::chrono::microseconds( 200 ) );
+		}
+	}
+}
+
+bool trace_to_json( std::string const & trace_file, std::string const & json_file ) {
+	std::FILE * in = std::fopen( trace_file.c_str( ), "rb" );
+	if( in == nullptr ) {
+		return false;
+	}
+	std::unique_ptr<std::FILE, int( * )( std::FILE * )> closer( in, &std::fclose );
+	uint32_t header[2];
+	if( std::fread( header, sizeof( header ), 1, in ) != 1 || header[0] != trace_writer_t::TRACE_MAGIC || header[1] != trace_writer_t::TRACE_VERSION ) {
+		return false;
+	}
+	std::ofstream out( json_file, std::ios::binary );
+	if( !out ) {
+		return false;
+	}
+	out << "{ \"trace\": [";
+	std::vector<trace_record_t> batch( 4096 );
+	bool is_first = true;
+	size_t count;
+	while( (count = std::fread( batch.data( ), sizeof( trace_record_t ), batch.size( ), in )) > 0 ) {
+		for( size_t n = 0; n < count; ++n ) {
+			auto const & record = batch[n];
+			memory_change_t change;
+			if( (record.flags & trace_record_t::HAS_CHANGE) != 0 ) {
+				change = memory_change_t( record.address, record.old_value );
+				change.new_value = record.new_value;
+			}
+			op_t const op( record.op_code, std::vector<uint16_t>( record.args, record.args + record.arg_count ) );
+			if( !is_first ) {
+				out << ",";
+			}
+			is_first = false;
+			out << "\n{\n\"instruction_ptr\": " << record.instruction_ptr << ",\n";
+			out << "\"op_code\": " << op.to_json( ) << ",\n";
+			out << "\"memory_change\": " << change.to_json( ) << " }";
+		}
+	}
+	out << "\n] }";
+	return static_cast<bool>(out);
+}
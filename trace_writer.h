@@ -0,0 +1,94 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+#include "spsc_ring.h"
+
+// One executed instruction.  A trace file is TRACE_MAGIC, TRACE_VERSION and then these
+// records back to back in native byte order
+struct trace_record_t {
+	static uint8_t const HAS_CHANGE = 1;	// address, old_value and new_value are set
+
+	uint16_t instruction_ptr;
+	uint16_t op_code;
+	uint16_t args[3];
+	uint8_t arg_count;
+	uint8_t flags;
+	uint16_t address;	// memory address or REGISTER0 + register written
+	uint16_t old_value;
+	uint16_t new_value;
+	uint16_t reserved;
+};	// struct trace_record_t
+
+static_assert( sizeof( trace_record_t ) == 20, "trace records are written as is" );
+
+// Streams trace records to a file from a writer thread so that a trace of any length uses a
+// fixed amount of memory.  When the writer falls behind push waits for room
+struct trace_writer_t final {
+	static uint32_t const TRACE_MAGIC = 0x52544353;	// "SCTR"
+	static uint32_t const TRACE_VERSION = 1;
+	static size_t const RING_SIZE = 1u << 16;
+
+	trace_writer_t( );
+	trace_writer_t( trace_writer_t const & ) = delete;
+	trace_writer_t & operator=( trace_writer_t const & ) = delete;
+	~trace_writer_t( );
+
+	// Stops any trace in progress.  false if filename cannot be created
+	bool start( std::string const & filename );
+	// Writes out what is queued and closes the file
+	void stop( );
+	bool is_running( ) const {
+		return m_file != nullptr;
+	}
+	uint64_t count( ) const {
+		return m_count;
+	}
+
+	// Only while running
+	void push( trace_record_t const & record ) {
+		while( !m_ring->try_push( record ) ) {
+			std::this_thread::yield( );
+		}
+		++m_count;
+	}
+private:
+	void drain( );
+
+	std::unique_ptr<spsc_ring_t<trace_record_t, RING_SIZE>> m_ring;	// created by the first start
+	std::FILE * m_file;
+	std::thread m_thread;
+	std::atomic<bool> m_stopping;
+	uint64_t m_count;
+};	// struct trace_writer_t
+
+// Write a trace file out in the JSON layout of the console's savetrace.  false if the trace
+// cannot be read or the JSON cannot be written
+bool trace_to_json( std::string const & trace_file, std::string const & json_file );
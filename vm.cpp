@@ -20,15 +20,51 @@
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 // SOFTWARE.
 
+#include <algorithm>
 #include <cstdint>
 #include <cstdlib>
 #include <iostream>
+#include <iterator>
+#include <limits>
 #include <cstdio>
+#include <sstream>
+#include <string>
 
 #include <vector>
+#include <boost/filesystem.hpp>
+#ifndef _WIN32
+#include <dlfcn.h>
+#endif
 #include "vm.h"
 #include "console.h"
 #include "file_helper.h"
+#include "state_container.h"
+
+namespace {
+	// Stop the vm with an error for its host to report, see vm_exit_t
+	template<typename... Args>
+	[[noreturn]] void fatal_error( Args const & ... args ) {
+		std::stringstream ss;
+		using expander = int[];
+		(void)expander { 0, ((ss << args), 0)... };
+		throw vm_exit_t( EXIT_FAILURE, ss.str( ) );
+	}
+}
+
+void out_of_range_memory( size_t pos ) {
+	fatal_error( "OUT OF RANGE MEMORY ATTEMP: ", pos );
+}
+
+vm_exit_t::vm_exit_t( int ExitCode, std::string Message ):
+	exit_code( ExitCode ),
+	message( std::move( Message ) ) { }
+
+int vm_exit_t::report( ) const {
+	if( !message.empty( ) ) {
+		std::cerr << message << std::endl;
+	}
+	return exit_code;
+}
 
 virtual_machine_t::virtual_machine_t( ):
 	registers( ),
@@ -36,18 +72,39 @@ virtual_machine_t::virtual_machine_t( ):
 	argument_stack( ),
 	program_stack( ),
 	instruction_ptr( 0 ),
+	decode_cache( ),
+	jit_cache( ),
+	overrides( ),
+	memo( ),
+	profiler( ),
+	input( ),
+	output( ),
+	shared_pages( ),
+	snapshots( ),
+	checkpoint( ),
+	image_load( image_load_t::copy ),
 	debugging( ) {
 
 	zero_fill( registers );
-	zero_fill( memory );
 }
 
-virtual_machine_t::virtual_machine_t( boost::string_ref filename ):
+virtual_machine_t::virtual_machine_t( boost::string_ref filename, image_load_t ImageLoad ):
 	registers( ),
 	memory( ),
 	argument_stack( ),
 	program_stack( ),
 	instruction_ptr( 0 ),
+	decode_cache( ),
+	jit_cache( ),
+	overrides( ),
+	memo( ),
+	profiler( ),
+	input( ),
+	output( ),
+	shared_pages( ),
+	snapshots( ),
+	checkpoint( ),
+	image_load( ImageLoad ),
 	debugging( ) {
 
 	load_state( filename );
@@ -55,14 +112,151 @@ virtual_machine_t::virtual_machine_t( boost::string_ref filename ):
 
 void virtual_machine_t::clear( ) {
 	zero_fill( registers );
-	zero_fill( memory );
+	memory.clear( );
 	program_stack.clear( );
 	argument_stack.clear( );
-	debugging.trace.clear( );
+	debugging.trace.stop( );
 	debugging.enable_tracing = false;
+	debugging.history.stop( );
+	debugging.rearm( );
+	decode_cache.clear( );
+	decode_cache.clear_guards( );
+	memo.stop_recording( );
+	std::fill( shared_pages.begin( ), shared_pages.end( ), nullptr );
+	checkpoint.state.reset( );
+	checkpoint.filename.clear( );
+	checkpoint.chain_length = 0;
 	instruction_ptr = 0;
 }
 
+namespace {
+	// Format of a delta file in uint16_t's
+	// 0 -> DELTA_MAGIC, an invalid op code so no runnable image starts with it
+	// 1 -> DELTA_VERSION
+	// 2 -> length in bytes of the base file name, followed by the name two bytes per item.
+	//	A relative name is relative to the directory of the delta
+	// next -> number of pages, followed by each page as its index and PAGE_WORDS of memory
+	// next->end -> registers, instruction ptr and stacks as in the full format
+	uint16_t const DELTA_MAGIC = 0xFFFF;
+	uint16_t const DELTA_VERSION = 1;
+	size_t const MAX_DELTA_CHAIN = 1024;
+
+	bool is_delta( ReadOnlyFileAsContainer<uint16_t> const & f ) {
+		return f.size( ) > 3 && f[0] == DELTA_MAGIC && f[1] == DELTA_VERSION;
+	}
+
+	// Reads items off a mapped file, failing on a truncated one
+	struct state_reader_t {
+		ReadOnlyFileAsContainer<uint16_t> const & f;
+		boost::string_ref filename;
+		size_t offset;
+
+		ReadOnlyFileAsContainer<uint16_t>::const_iterator take( size_t count ) {
+			if( f.size( ) - offset < count ) {
+				fatal_error( "Truncated state file: ", filename );
+			}
+			auto result = f.begin( ) + offset;
+			offset += count;
+			return result;
+		}
+
+		uint16_t next( ) {
+			return *take( 1 );
+		}
+	};	// struct state_reader_t
+
+	std::string read_base_name( state_reader_t & reader ) {
+		size_t const length = reader.next( );
+		auto it = reader.take( (length + 1) / 2 );
+		std::string result( length, '\0' );
+		for( size_t n = 0; n < length; ++n ) {
+			result[n] = static_cast<char>(it[n / 2] >> (8 * (n % 2)));
+		}
+		auto base = boost::filesystem::path( result );
+		if( base.is_relative( ) ) {
+			base = boost::filesystem::path( reader.filename.to_string( ) ).parent_path( ) / base;
+		}
+		return base.string( );
+	}
+
+	void read_stacks( virtual_machine_t & vm, state_reader_t & reader ) {
+		auto it = reader.take( vm.registers.size( ) );
+		std::copy( it, it + vm.registers.size( ), vm.registers.begin( ) );
+		vm.instruction_ptr = reader.next( );
+		size_t program_stack_size = reader.next( );
+		it = reader.take( program_stack_size );
+		vm.program_stack.clear( );
+		vm.program_stack.reserve( program_stack_size );
+		std::copy( it, it + program_stack_size, std::back_inserter( vm.program_stack ) );
+		size_t argument_stack_size = reader.next( );
+		it = reader.take( argument_stack_size );
+		vm.argument_stack.assign( it, it + argument_stack_size );
+	}
+
+	void apply_delta( virtual_machine_t & vm, std::string const & filename ) {
+		ReadOnlyFileAsContainer<uint16_t> f( filename );
+		if( !f ) {
+			fatal_error( "Error opening file: ", filename );
+		}
+		state_reader_t reader{ f, filename, 2 };
+		read_base_name( reader );
+		size_t const page_count = reader.next( );
+		for( size_t n = 0; n < page_count; ++n ) {
+			size_t const page = reader.next( );
+			if( page >= decode_cache_t::PAGE_COUNT ) {
+				fatal_error( "Invalid page ", page, " in state file: ", filename );
+			}
+			auto it = reader.take( decode_cache_t::PAGE_WORDS );
+			std::copy( it, it + decode_cache_t::PAGE_WORDS, vm.memory.begin( ) + page * decode_cache_t::PAGE_WORDS );
+		}
+		read_stacks( vm, reader );
+	}
+
+	// filename followed by each base its deltas build on, the last is a full state
+	std::vector<std::string> delta_chain( boost::string_ref filename ) {
+		std::vector<std::string> chain = { filename.to_string( ) };
+		while( true ) {
+			ReadOnlyFileAsContainer<uint16_t> f( chain.back( ) );
+			if( !f ) {
+				fatal_error( "Error opening file: ", chain.back( ) );
+			}
+			if( !is_delta( f ) ) {
+				return chain;
+			}
+			if( chain.size( ) > MAX_DELTA_CHAIN ) {
+				fatal_error( "Delta chain too long or circular: ", filename );
+			}
+			state_reader_t reader{ f, chain.back( ), 2 };
+			chain.push_back( read_base_name( reader ) );
+		}
+	}
+
+	// Rewriting the file memory is mapped from would change memory along with it
+	void detach_from( virtual_machine_t & vm, boost::string_ref filename ) {
+		boost::system::error_code ec;
+		if( vm.memory.is_mapped( ) && boost::filesystem::equivalent( filename.to_string( ), vm.memory.mapped_filename( ), ec ) ) {
+			vm.memory.detach( );
+		}
+	}
+
+	void load_container( virtual_machine_t & vm, std::string const & filename ) {
+		using state_container::section_id_t;
+		state_container::reader_t reader( filename );
+		auto const memory = reader.read( section_id_t::memory );
+		auto const cpu = reader.read( section_id_t::registers );
+		if( memory.size( ) != vm.memory.size( ) || cpu.size( ) != vm.registers.size( ) + 1 ) {
+			fatal_error( "Invalid state in container file: ", filename );
+		}
+		std::copy( memory.begin( ), memory.end( ), vm.memory.begin( ) );
+		std::copy( cpu.begin( ), cpu.end( ) - 1, vm.registers.begin( ) );
+		vm.instruction_ptr = cpu.back( );
+		auto const program_stack = reader.read( section_id_t::program_stack );
+		vm.program_stack.reserve( program_stack.size( ) );
+		std::copy( program_stack.begin( ), program_stack.end( ), std::back_inserter( vm.program_stack ) );
+		vm.argument_stack = reader.read( section_id_t::argument_stack );
+	}
+}	// namespace anonymous
+
 void virtual_machine_t::save_state( boost::string_ref filename ) {
 	// Format of file in uint16_t's.  So 2bytes per 
 	// 0->32767 -> memory from 0->32767t
@@ -76,13 +270,20 @@ void virtual_machine_t::save_state( boost::string_ref filename ) {
 	// Should be compatible with contest file format as it just extends it.  Anything less than
 	// or equal to 32767 items is only representing the memory and assumes zeros for unused 
 	// space and all registers/stacks.  Otherwise it will be a full state dump as here
+	write_state( filename );
+	checkpoint.state = snapshot( );
+	checkpoint.filename = filename.to_string( );
+	checkpoint.chain_length = 0;
+}
+
+void virtual_machine_t::write_state( boost::string_ref filename ) {
+	detach_from( *this, filename );
 	auto const total_items = memory.size( ) + registers.size( ) + 1/*instruction_ptr*/
 		+ 1/*program stack size*/ + program_stack.size( )
 		+ 1/*argument stack size*/ + argument_stack.size( );
 	FileAsContainer<uint16_t> f( filename, total_items, 0, true );
 	if( !f ) {
-		std::cerr << "Error opening file: " << filename << std::endl;
-		exit( EXIT_FAILURE );
+		fatal_error( "Error opening file: ", filename );
 	}
 	auto output_position = std::copy( memory.begin( ), memory.end( ), f.begin( ) );
 	output_position = std::copy( registers.begin( ), registers.end( ), output_position );
@@ -98,6 +299,100 @@ void virtual_machine_t::save_state( boost::string_ref filename ) {
 	f.close( );
 }
 
+void virtual_machine_t::save_compressed_state( boost::string_ref filename ) {
+	using state_container::section_id_t;
+	detach_from( *this, filename );
+	std::vector<uint16_t> cpu( registers.begin( ), registers.end( ) );
+	cpu.push_back( instruction_ptr );
+	state_container::write( filename, {
+		{ section_id_t::memory, std::vector<uint16_t>( memory.begin( ), memory.end( ) ) },
+		{ section_id_t::registers, std::move( cpu ) },
+		{ section_id_t::program_stack, std::vector<uint16_t>( program_stack.begin( ), program_stack.end( ) ) },
+		{ section_id_t::argument_stack, argument_stack } } );
+
+	checkpoint.state = snapshot( );
+	checkpoint.filename = filename.to_string( );
+	checkpoint.chain_length = 0;
+}
+
+void virtual_machine_t::save_delta( boost::string_ref filename ) {
+	if( checkpoint.filename.empty( ) || checkpoint.chain_length >= checkpoint.max_chain_length || !boost::filesystem::exists( checkpoint.filename ) ) {
+		save_state( filename );
+		return;
+	}
+	// A delta written over a file it builds on would lose that base
+	for( auto const & base : delta_chain( checkpoint.filename ) ) {
+		boost::system::error_code ec;
+		if( boost::filesystem::equivalent( filename.to_string( ), base, ec ) ) {
+			save_state( filename );
+			return;
+		}
+	}
+	detach_from( *this, filename );
+	if( !checkpoint.state ) {
+		virtual_machine_t base;
+		base.load_state( checkpoint.filename );
+		checkpoint.state = base.snapshot( );
+	}
+	// Pages written since the checkpoint no longer share its copy, see snapshot( )
+	auto const current = snapshot( );
+	std::vector<uint16_t> changed_pages;
+	for( uint16_t n = 0; n < current->pages.size( ); ++n ) {
+		auto const & page = current->pages[n];
+		if( page != checkpoint.state->pages[n] && *page != *checkpoint.state->pages[n] ) {
+			changed_pages.push_back( n );
+		}
+	}
+
+	auto const delta_path = boost::filesystem::path( filename.to_string( ) );
+	auto base_path = boost::filesystem::path( checkpoint.filename );
+	if( base_path.parent_path( ) == delta_path.parent_path( ) ) {
+		base_path = base_path.filename( );
+	} else {
+		base_path = boost::filesystem::absolute( base_path );
+	}
+	auto const base_name = base_path.string( );
+	if( base_name.size( ) > std::numeric_limits<uint16_t>::max( ) ) {
+		fatal_error( "Base file name too long: ", base_name );
+	}
+
+	auto const total_items = 2/*magic and version*/ + 1/*name length*/ + (base_name.size( ) + 1) / 2
+		+ 1/*page count*/ + changed_pages.size( ) * (1 + decode_cache_t::PAGE_WORDS)
+		+ registers.size( ) + 1/*instruction_ptr*/
+		+ 1/*program stack size*/ + program_stack.size( )
+		+ 1/*argument stack size*/ + argument_stack.size( );
+	FileAsContainer<uint16_t> f( filename, total_items, 0, true );
+	if( !f ) {
+		fatal_error( "Error opening file: ", filename );
+	}
+	auto output_position = f.begin( );
+	*output_position++ = DELTA_MAGIC;
+	*output_position++ = DELTA_VERSION;
+	*output_position++ = static_cast<uint16_t>(base_name.size( ));
+	for( size_t n = 0; n < base_name.size( ); n += 2 ) {
+		uint16_t value = static_cast<unsigned char>(base_name[n]);
+		if( n + 1 < base_name.size( ) ) {
+			value |= static_cast<uint16_t>(static_cast<unsigned char>(base_name[n + 1]) << 8);
+		}
+		*output_position++ = value;
+	}
+	*output_position++ = static_cast<uint16_t>(changed_pages.size( ));
+	for( auto const n : changed_pages ) {
+		*output_position++ = n;
+		output_position = std::copy( current->pages[n]->begin( ), current->pages[n]->end( ), output_position );
+	}
+	output_position = std::copy( registers.begin( ), registers.end( ), output_position );
+	*output_position++ = instruction_ptr;
+	*output_position++ = static_cast<uint16_t>(program_stack.size( ));
+	output_position = std::copy( program_stack.begin( ), program_stack.end( ), output_position );
+	*output_position++ = static_cast<uint16_t>(argument_stack.size( ));
+	std::copy( argument_stack.begin( ), argument_stack.end( ), output_position );
+	f.close( );
+
+	checkpoint.state = current;
+	checkpoint.filename = filename.to_string( );
+	++checkpoint.chain_length;
+}
 
 void virtual_machine_t::load_state( boost::string_ref filename ) {
 	// Format of file in uint16_t's.  So 2bytes per 
@@ -112,118 +407,303 @@ void virtual_machine_t::load_state( boost::string_ref filename ) {
 	// Should be compatible with contest file format as it just extends it.  Anything less than
 	// or equal to 32767 items is only representing the memory and assumes zeros for unused 
 	// space and all registers/stacks.  Otherwise it will be a full state dump as here
+
+	// The full state may also be a compressed container, see state_container.h.  A delta file
+	// is loaded by loading the full state at the end of its chain and applying each delta
+	// back up to filename
+	auto const chain = delta_chain( filename );
+
 	clear( );
-	ReadOnlyFileAsContainer<uint16_t> f( filename );
+	ReadOnlyFileAsContainer<uint16_t> f( chain.back( ) );
 	if( !f ) {
-		std::cerr << "Error opening file: " << filename << std::endl;
-		exit( EXIT_FAILURE );
+		fatal_error( "Error opening file: ", chain.back( ) );
 	}
+	if( state_container::is_container( f ) ) {
+		f.close( );
+		load_container( *this, chain.back( ) );
+	} else {
+		size_t offset = 0;
 
-	size_t offset = 0;
-
-	auto get_it = [&f, &offset]( ) {
-		return f.begin( ) + offset;
-	};
+		auto get_it = [&f, &offset]( ) {
+			return f.begin( ) + offset;
+		};
 
-	{
-		auto memory_size = f.size( ) > 32768 ? 32768 : f.size( );
-		std::copy( f.begin( ), f.begin( ) + memory_size, memory.begin( ) );
-		offset += memory.size( );
-	}
-	if( f.size( ) > 32768 ) {	// Has more than memory
-		{
-			auto it = get_it( );
-			std::copy( it, it + registers.size( ), registers.begin( ) );
-			offset += registers.size( );
-		}
-		instruction_ptr = *get_it( );
-		++offset;
 		{
-			size_t program_stack_size = *get_it( );
-			++offset;
-			auto it = get_it( );
-			program_stack.reserve( program_stack_size );
-			std::copy( it, it + program_stack_size, std::back_inserter( program_stack ) );
-			offset += program_stack.size( );
+			auto memory_size = f.size( ) > 32768 ? 32768 : f.size( );
+			if( image_load != image_load_t::map || !memory.map_file( chain.back( ) ) ) {
+				std::copy( f.begin( ), f.begin( ) + memory_size, memory.begin( ) );
+			}
+			offset += memory.size( );
 		}
-		{
-			size_t argument_stack_size = *get_it( );
+		if( f.size( ) > 32768 ) {	// Has more than memory
+			{
+				auto it = get_it( );
+				std::copy( it, it + registers.size( ), registers.begin( ) );
+				offset += registers.size( );
+			}
+			instruction_ptr = *get_it( );
 			++offset;
-			auto it = get_it( );
-			argument_stack.reserve( argument_stack_size );
-			std::copy( it, it + argument_stack_size, std::back_inserter( argument_stack ) );
+			{
+				size_t program_stack_size = *get_it( );
+				++offset;
+				auto it = get_it( );
+				program_stack.reserve( program_stack_size );
+				std::copy( it, it + program_stack_size, std::back_inserter( program_stack ) );
+				offset += program_stack.size( );
+			}
+			{
+				size_t argument_stack_size = *get_it( );
+				++offset;
+				auto it = get_it( );
+				argument_stack.reserve( argument_stack_size );
+				std::copy( it, it + argument_stack_size, std::back_inserter( argument_stack ) );
+			}
 		}
+		f.close( );
 	}
-	f.close( );
+
+	for( auto it = chain.rbegin( ) + 1; it != chain.rend( ); ++it ) {
+		apply_delta( *this, *it );
+	}
+	// Copying mapped memory would read in every page, save_delta reads the file back instead
+	checkpoint.state = memory.is_mapped( ) ? nullptr : snapshot( );
+	checkpoint.filename = filename.to_string( );
+	checkpoint.chain_length = chain.size( ) - 1;
 }
 
 namespace {
-	template<typename Container1, typename Container2>
-	bool does_intersect( Container1 const & c1, Container2 const & c2 ) {
-		for( auto const & v1 : c1 ) {
-			if( std::count( std::begin( c2 ), std::end( c2 ), v1 ) > 0 ) {
-				return true;
-			}
+#ifdef DEBUG
+	char const * watch_kind_name( uint8_t kind ) {
+		switch( kind ) {
+		case watchpoints_t::READ:
+			return "read";
+		case watchpoints_t::WRITE:
+			return "write";
+		default:
+			return "change";
 		}
-		return false;
 	}
 
-}
+	// Conditions are only evaluated, and their hits counted, where there is a breakpoint
+	bool is_breakpoint_hit( virtual_machine_t & vm ) {
+		if( vm.debugging.breakpoints.count( vm.instruction_ptr ) == 0 ) {
+			return false;
+		}
+		auto const it = vm.debugging.conditions.find( vm.instruction_ptr );
+		if( vm.debugging.conditions.end( ) == it ) {
+			return true;
+		}
+		++it->second.hits;
+		return it->second.condition.evaluate( vm, it->second.hits ) != 0;
+	}
 
-namespace {
-	void start_trace( virtual_machine_t & vm, instructions::decoded_inst_t const & decoded ) {
-		vm.debugging.trace.instruction_ptrs.push_back( vm.instruction_ptr );
-		vm.debugging.trace.op_codes.emplace_back( decoded.op_code, vm.argument_stack );
+	// Instructions that write memory are pushed by finish_trace once the new value is known
+	trace_record_t start_trace( virtual_machine_t & vm, instructions::decoded_inst_t const & decoded ) {
+		trace_record_t record{ };
+		record.instruction_ptr = vm.instruction_ptr;
+		record.op_code = decoded.op_code;
+		record.arg_count = static_cast<uint8_t>(std::min( vm.argument_stack.size( ), static_cast<size_t>(3) ));
+		std::copy( vm.argument_stack.begin( ), vm.argument_stack.begin( ) + record.arg_count, record.args );
 		if( decoded.do_memory_trace ) {
-			vm.debugging.trace.memory_changes.emplace_back( vm.argument_stack[0], vm.get_reg_or_mem( vm.argument_stack[0] ) );
-		} else {
-			vm.debugging.trace.memory_changes.emplace_back( );
+			// WMEM writes to the address its first argument holds
+			record.address = vm.argument_stack[0];
+			if( decoded.op_code == 16 && vm.is_register( record.address ) ) {
+				record.address = vm.get_register( record.address );
+			}
+			record.old_value = vm.get_reg_or_mem( record.address );
+		} else if( vm.debugging.enable_tracing ) {
+			vm.debugging.trace.push( record );
 		}
+		return record;
 	}
 
-	void finish_trace( virtual_machine_t & vm, instructions::decoded_inst_t const & decoded ) {
-		if( !decoded.do_memory_trace ) {
-			return;
+	void finish_trace( virtual_machine_t & vm, instructions::decoded_inst_t const & decoded, trace_record_t & record ) {
+		if( decoded.do_memory_trace ) {
+			record.new_value = vm.get_reg_or_mem( record.address );
+			if( record.old_value != record.new_value ) {
+				record.flags |= trace_record_t::HAS_CHANGE;
+			}
+			if( vm.debugging.enable_tracing ) {
+				vm.debugging.trace.push( record );
+			}
 		}
-		assert( vm.debugging.trace.memory_changes.rbegin( )->address >= 0 );
-		auto new_value = vm.get_reg_or_mem( static_cast<uint16_t>(vm.debugging.trace.memory_changes.rbegin( )->address) );
-		if( vm.debugging.trace.memory_changes.rbegin( )->old_value != new_value ) {
-			vm.debugging.trace.memory_changes.rbegin( )->new_value = new_value;
-		} else {
-			vm.debugging.trace.memory_changes.rbegin( )->clear( );
+		if( vm.debugging.history.is_recording( ) ) {
+			vm.debugging.history.push( vm, record );
 		}
 	}
-
+#endif
 }
 
 void virtual_machine_t::tick( bool is_debugger ) {
-	auto const & decoded = instructions::decoder( )[fetch_opcode( true )];
-	for( size_t n = 0; n < decoded.arg_count; ++n ) {
-		argument_stack.push_back( fetch_opcode( ) );
+	auto const * cached = decode_cache.fetch( memory, instruction_ptr );
+#ifdef DEBUG
+	if( debugging.is_armed( ) ) {
+		// Break between instructions so that the console sees, and may replace, a whole state
+		auto const is_trapped = cached != nullptr && debugging.memory_traps.intersects( cached->args, cached->args + cached->length - 1 );
+		if( !is_debugger && (debugging.should_break || is_trapped || is_breakpoint_hit( *this )) ) {
+			output.flush( );
+			std::cout << "Breaking at address " << instruction_ptr << "\n";
+			console( *this );
+			cached = decode_cache.fetch( memory, instruction_ptr );
+		}
+		debugging.should_break = false;
+		// Accesses made outside of an instruction, by the console or a restore, do not count,
+		// nor does a move in history made before this instruction started
+		debugging.watchpoints.forget_hit( );
+		debugging.history.take_travelled( );
 	}
+#endif
+	if( cached == nullptr ) {
+		// Not a valid instruction, let fetch_opcode report why.  It moves instruction_ptr on
+		auto const location = instruction_ptr;
+		auto const & decoded = instructions::decoder( )[fetch_opcode( true )];
+		for( size_t n = 0; n < decoded.arg_count; ++n ) {
+			fetch_opcode( );
+		}
+		fatal_error( "FATAL ERROR: COULD NOT DECODE INSTRUCTION @ location ", location );
+	}
+	if( profiler.is_running( ) ) {
+		profiler.count( instruction_ptr, cached->op_code );
+	}
+	auto const & decoded = instructions::decoder( )[cached->op_code];
+	argument_stack.insert( argument_stack.end( ), cached->args, cached->args + decoded.arg_count );
+	instruction_ptr = static_cast<uint16_t>(instruction_ptr + cached->length);
 
 #ifdef DEBUG
-	if( !is_debugger && (debugging.should_break || debugging.breakpoints.count( instruction_ptr ) > 0 || does_intersect( debugging.memory_traps, argument_stack )) ) {
-		std::cout << "Breaking at address " << instruction_ptr << "\n";
-		console( *this );
-	}
-	debugging.should_break = false;
-	if( debugging.enable_tracing ) {
-		start_trace( *this, decoded );
+	auto const executed_ip = static_cast<uint16_t>(instruction_ptr - cached->length);
+	bool const is_recording = debugging.armed && (debugging.enable_tracing || debugging.history.is_recording( ));
+	trace_record_t record{ };
+	if( is_recording ) {
+		record = start_trace( *this, decoded );
 	}
 #endif
 	decoded.instruction( *this );
+	if( profiler.is_running( ) ) {
+		profiler.on_executed( *this );
+	}
+#ifdef DEBUG
+	if( debugging.armed ) {
+		// An instruction that broke into the console and was moved back in time never finished
+		auto const is_travelled = debugging.history.take_travelled( );
+		if( is_recording && !is_travelled ) {
+			finish_trace( *this, decoded, record );
+		}
+		watchpoints_t::hit_t hit;
+		if( debugging.watchpoints.take_hit( hit ) && !is_travelled ) {
+			output.flush( );
+			std::cout << "Watchpoint on " << hit.address << ": " << watch_kind_name( hit.kind ) << " of " << hit.new_value;
+			if( hit.kind != watchpoints_t::READ ) {
+				std::cout << " over " << hit.old_value;
+			}
+			std::cout << " by instruction at " << executed_ip << "\n";
+			debugging.should_break = true;
+		}
+	}
+#endif
+}
+
+bool virtual_machine_t::is_instrumented( ) const {
 #ifdef DEBUG
-	if( decoded.do_memory_trace && debugging.enable_tracing ) {
-		finish_trace( *this, decoded );
+	return memo.is_recording( ) || profiler.is_running( ) || debugging.is_armed( );
+#else
+	return memo.is_recording( ) || profiler.is_running( );
+#endif
+}
+
+std::shared_ptr<vm_snapshot_t const> virtual_machine_t::snapshot( ) {
+	auto const dirty = decode_cache.take_dirty_pages( );
+	auto result = std::make_shared<vm_snapshot_t>( );
+	for( size_t n = 0; n < shared_pages.size( ); ++n ) {
+		if( !shared_pages[n] || (dirty & (uint64_t( 1 ) << n)) != 0 ) {
+			auto page = std::make_shared<memory_page_t>( );
+			auto const first = memory.begin( ) + n * decode_cache_t::PAGE_WORDS;
+			std::copy( first, first + decode_cache_t::PAGE_WORDS, page->begin( ) );
+			shared_pages[n] = std::move( page );
+		}
+		result->pages[n] = shared_pages[n];
+	}
+	std::copy( registers.begin( ), registers.end( ), result->registers.begin( ) );
+	result->instruction_ptr = instruction_ptr;
+	result->program_stack.assign( program_stack.begin( ), program_stack.end( ) );
+	result->argument_stack = argument_stack;
+	return result;
+}
+
+void virtual_machine_t::restore( vm_snapshot_t const & state ) {
+	auto const dirty = decode_cache.take_dirty_pages( );
+	for( size_t n = 0; n < shared_pages.size( ); ++n ) {
+		if( shared_pages[n] == state.pages[n] && (dirty & (uint64_t( 1 ) << n)) == 0 ) {
+			continue;
+		}
+		// Only the words that differ go through set_memory so decoded code elsewhere survives
+		auto const & page = *state.pages[n];
+		auto const first = static_cast<uint16_t>(n * decode_cache_t::PAGE_WORDS);
+		for( uint16_t offset = 0; offset < page.size( ); ++offset ) {
+			if( memory[first + offset] != page[offset] ) {
+				set_memory( static_cast<uint16_t>(first + offset), page[offset] );
+			}
+		}
+		shared_pages[n] = state.pages[n];
+	}
+	decode_cache.take_dirty_pages( );
+	std::copy( state.registers.begin( ), state.registers.end( ), registers.begin( ) );
+	instruction_ptr = state.instruction_ptr;
+	program_stack.clear( );
+	program_stack.reserve( state.program_stack.size( ) );
+	std::copy( state.program_stack.begin( ), state.program_stack.end( ), std::back_inserter( program_stack ) );
+	argument_stack = state.argument_stack;
+	memo.stop_recording( );
+}
+
+std::unique_ptr<virtual_machine_t> virtual_machine_t::fork( ) {
+	auto const state = snapshot( );
+	std::unique_ptr<virtual_machine_t> result( new virtual_machine_t( ) );
+	// Nothing is decoded in a new vm yet, so its memory is filled a page at a time without
+	// set_memory and then shares every page with ours, restore only copies the rest
+	for( size_t n = 0; n < state->pages.size( ); ++n ) {
+		auto const & page = *state->pages[n];
+		std::copy( page.begin( ), page.end( ), result->memory.begin( ) + n * decode_cache_t::PAGE_WORDS );
+	}
+	result->shared_pages = state->pages;
+	result->restore( *state );
+	return result;
+}
+
+void virtual_machine_t::add_override( uint16_t address, native_override_t function ) {
+	overrides.add( address, std::move( function ) );
+	// Engines may have compiled calls to address already
+	decode_cache.clear( );
+}
+
+void virtual_machine_t::remove_override( uint16_t address ) {
+	overrides.remove( address );
+	decode_cache.clear( );
+}
+
+void virtual_machine_t::load_plugin( std::string const & filename ) {
+#ifdef _WIN32
+	fatal_error( "Plugins are not supported on this platform: ", filename );
+#else
+	std::shared_ptr<void> plugin( dlopen( filename.c_str( ), RTLD_NOW | RTLD_LOCAL ), []( void * handle ) {
+		if( handle != nullptr ) {
+			dlclose( handle );
+		}
+	} );
+	if( !plugin ) {
+		fatal_error( "Error loading plugin ", filename, ": ", dlerror( ) );
+	}
+	auto const register_overrides = reinterpret_cast<register_overrides_t>(dlsym( plugin.get( ), SC_REGISTER_OVERRIDES_SYMBOL ));
+	if( register_overrides == nullptr ) {
+		fatal_error( "Plugin ", filename, " does not export ", SC_REGISTER_OVERRIDES_SYMBOL );
 	}
+	overrides.retain( std::move( plugin ) );
+	register_overrides( *this );
 #endif
 }
 
 uint16_t & virtual_machine_t::get_register( uint16_t i ) {
 	if( !is_register( i ) ) {
-		std::cerr << "FATAL ERROR: get_register called with invalid value " << i << std::endl;
-		exit( EXIT_FAILURE );
+		fatal_error( "FATAL ERROR: get_register called with invalid value ", i );
 	}
 	return registers[i - REGISTER0];
 }
@@ -240,16 +720,21 @@ void virtual_machine_t::validate( uint16_t i ) {
 	if( i < (REGISTER0 + 8) ) {
 		return;
 	}
-	std::cerr << "Invalid instruction in memory " << i << std::endl;
-	exit( EXIT_FAILURE );
+	fatal_error( "Invalid instruction in memory ", i );
 }
 
 uint16_t & virtual_machine_t::get_value( uint16_t & i ) {
 	validate( i );
-	if( is_register( i ) ) {
-		return get_register( i );
+	if( !is_register( i ) ) {
+		return i;
 	}
-	return i;
+	auto & result = registers[i - REGISTER0];
+#ifdef DEBUG
+	if( debugging.armed ) {
+		debugging.watchpoints.on_read( i, result );
+	}
+#endif
+	return result;
 }
 
 uint16_t & virtual_machine_t::get_reg_or_mem( uint16_t i ) {
@@ -260,10 +745,48 @@ uint16_t & virtual_machine_t::get_reg_or_mem( uint16_t i ) {
 	return memory[i];
 }
 
+void virtual_machine_t::set_reg_or_mem( uint16_t i, uint16_t value ) {
+	validate( i );
+	if( is_register( i ) ) {
+		set_register( i, value );
+	} else {
+		set_memory( i, value );
+	}
+}
+
+void virtual_machine_t::set_register( uint16_t i, uint16_t value ) {
+	auto & reg = get_register( i );
+#ifdef DEBUG
+	if( debugging.armed ) {
+		debugging.watchpoints.on_write( i, reg, value );
+	}
+#endif
+	reg = value;
+}
+
+void virtual_machine_t::set_memory( uint16_t address, uint16_t value ) {
+#ifdef DEBUG
+	if( debugging.armed ) {
+		debugging.watchpoints.on_write( address, memory[address], value );
+	}
+#endif
+	decode_cache.invalidate( address );
+	memory[address] = value;
+}
+
+uint16_t virtual_machine_t::read_memory( uint16_t address ) {
+	auto const result = memory[address];
+#ifdef DEBUG
+	if( debugging.armed ) {
+		debugging.watchpoints.on_read( address, result );
+	}
+#endif
+	return result;
+}
+
 uint16_t virtual_machine_t::pop_argument_stack( ) {
 	if( argument_stack.empty( ) ) {
-		std::cerr << "INSTRUCTION STACK UNDERFLOW" << std::endl;
-		exit( EXIT_FAILURE );
+		fatal_error( "INSTRUCTION STACK UNDERFLOW" );
 	}
 	auto result = *argument_stack.rbegin( );
 	argument_stack.pop_back( );
@@ -272,10 +795,9 @@ uint16_t virtual_machine_t::pop_argument_stack( ) {
 
 uint16_t virtual_machine_t::pop_program_stack( ) {
 	if( program_stack.empty( ) ) {
-		std::cerr << "STACK UNDERFLOW" << std::endl;
-		exit( EXIT_FAILURE );
+		fatal_error( "STACK UNDERFLOW" );
 	}
-	auto result = *program_stack.rbegin( );
+	auto result = program_stack.back( );
 	program_stack.pop_back( );
 	return result;
 }
@@ -284,8 +806,7 @@ uint16_t virtual_machine_t::fetch_opcode( bool is_instruction ) {
 	auto current_instruction = memory[instruction_ptr];
 	if( is_instruction ) {
 		if( current_instruction >= instructions::decoder( ).size( ) ) {
-			std::cerr << "FATAL ERROR: INVALID INSTRUCTION " << current_instruction << " @ location " << instruction_ptr << std::endl;
-			exit( EXIT_FAILURE );
+			fatal_error( "FATAL ERROR: INVALID INSTRUCTION ", current_instruction, " @ location ", instruction_ptr );
 		}
 	} else {
 		validate( current_instruction );
@@ -447,22 +968,6 @@ std::string memory_change_t::to_json( ) const {
 	return ss.str( );
 }
 
-std::string vm_trace::to_json( ) const {
-	assert( instruction_ptrs.size( ) == op_codes.size( ) && op_codes.size( ) == memory_changes.size( ) );
-	std::stringstream ss;
-	ss << "{ \"trace\": [";
-	for( size_t n = 0; n < instruction_ptrs.size( ); ++n ) {
-		if( n > 0 ) {
-			ss << ",";
-		}
-		ss << "\n{\n\"instruction_ptr\": " << instruction_ptrs[n] << ",\n";
-		ss << "\"op_code\": " << op_codes[n].to_json( ) << ",\n";
-		ss << "\"memory_change\": " << memory_changes[n].to_json( ) << " }";
-	}
-	ss << "\n] }";
-	return ss.str( );
-}
-
 std::string full_dump_string( virtual_machine_t & vm, uint16_t from_address, uint16_t to_address ) {
 	std::stringstream ss;
 	ss << dump_memory( vm, from_address, to_address );
@@ -479,14 +984,15 @@ void full_dump( virtual_machine_t & vm, uint16_t from_address, uint16_t to_addre
 }
 
 namespace instructions {
-	void inst_halt( virtual_machine_t & ) {
-		exit( EXIT_SUCCESS );
+	void inst_halt( virtual_machine_t & vm ) {
+		vm.output.flush( );
+		throw vm_exit_t( EXIT_SUCCESS );
 	}
 
 	void inst_set( virtual_machine_t & vm ) {
 		auto b = vm.pop_argument_stack( );
 		auto a = vm.pop_argument_stack( );
-		vm.get_register( a ) = vm.get_value( b );
+		vm.set_register( a, vm.get_value( b ) );
 	}
 
 	void inst_push( virtual_machine_t & vm ) {
@@ -497,22 +1003,25 @@ namespace instructions {
 	void inst_pop( virtual_machine_t & vm ) {
 		auto a = vm.pop_argument_stack( );
 
+		if( vm.memo.is_recording( ) ) {
+			vm.memo.on_pop( vm );
+		}
 		auto s = vm.pop_program_stack( );
-		vm.get_reg_or_mem( a ) = vm.get_value( s );
+		vm.set_reg_or_mem( a, vm.get_value( s ) );
 	}
 
 	void inst_eq( virtual_machine_t & vm ) {
 		auto c = vm.pop_argument_stack( );
 		auto b = vm.pop_argument_stack( );
 		auto a = vm.pop_argument_stack( );
-		vm.get_reg_or_mem( a ) = vm.get_value( b ) == vm.get_value( c ) ? 1 : 0;
+		vm.set_reg_or_mem( a, vm.get_value( b ) == vm.get_value( c ) ? 1 : 0 );
 	}
 
 	void inst_gt( virtual_machine_t & vm ) {
 		auto c = vm.pop_argument_stack( );
 		auto b = vm.pop_argument_stack( );
 		auto a = vm.pop_argument_stack( );
-		vm.get_reg_or_mem( a ) = vm.get_value( b ) > vm.get_value( c ) ? 1 : 0;
+		vm.set_reg_or_mem( a, vm.get_value( b ) > vm.get_value( c ) ? 1 : 0 );
 	}
 
 	void inst_jmp( virtual_machine_t & vm ) {
@@ -541,7 +1050,7 @@ namespace instructions {
 		auto b = vm.pop_argument_stack( );
 		auto a = vm.pop_argument_stack( );
 
-		vm.get_reg_or_mem( a ) = (vm.get_value( b ) + vm.get_value( c )) % vm.MODULO;
+		vm.set_reg_or_mem( a, (vm.get_value( b ) + vm.get_value( c )) % vm.MODULO );
 	}
 
 	void inst_mult( virtual_machine_t & vm ) {
@@ -549,28 +1058,28 @@ namespace instructions {
 		auto b = vm.pop_argument_stack( );
 		auto a = vm.pop_argument_stack( );
 		auto tmp = (static_cast<uint32_t>(vm.get_value( b )) * static_cast<uint32_t>(vm.get_value( c ))) % vm.MODULO;
-		vm.get_reg_or_mem( a ) = static_cast<uint16_t>(tmp);
+		vm.set_reg_or_mem( a, static_cast<uint16_t>(tmp) );
 	}
 
 	void inst_mod( virtual_machine_t & vm ) {
 		auto c = vm.pop_argument_stack( );
 		auto b = vm.pop_argument_stack( );
 		auto a = vm.pop_argument_stack( );
-		vm.get_reg_or_mem( a ) = vm.get_value( b ) % vm.get_value( c );
+		vm.set_reg_or_mem( a, vm.get_value( b ) % vm.get_value( c ) );
 	}
 
 	void inst_and( virtual_machine_t & vm ) {
 		auto c = vm.pop_argument_stack( );
 		auto b = vm.pop_argument_stack( );
 		auto a = vm.pop_argument_stack( );
-		vm.get_reg_or_mem( a ) = vm.get_value( b ) & vm.get_value( c );
+		vm.set_reg_or_mem( a, vm.get_value( b ) & vm.get_value( c ) );
 	}
 
 	void inst_or( virtual_machine_t & vm ) {
 		auto c = vm.pop_argument_stack( );
 		auto b = vm.pop_argument_stack( );
 		auto a = vm.pop_argument_stack( );
-		vm.get_reg_or_mem( a ) = vm.get_value( b ) | vm.get_value( c );
+		vm.set_reg_or_mem( a, vm.get_value( b ) | vm.get_value( c ) );
 	}
 
 	void inst_not( virtual_machine_t & vm ) {
@@ -580,13 +1089,13 @@ namespace instructions {
 		uint16_t val = vm.get_value( b );
 		uint16_t tmp = val & MASK;
 		uint16_t tmp2 = ~val & ~MASK;
-		vm.get_reg_or_mem( a ) = tmp | tmp2;
+		vm.set_reg_or_mem( a, tmp | tmp2 );
 	}
 
 	void inst_rmem( virtual_machine_t & vm ) {
 		auto b = vm.pop_argument_stack( );
 		auto a = vm.pop_argument_stack( );
-		vm.get_reg_or_mem( a ) = vm.memory[vm.get_value( b )];
+		vm.set_reg_or_mem( a, vm.read_memory( vm.get_value( b ) ) );
 	}
 
 	void inst_wmem( virtual_machine_t & vm ) {
@@ -595,46 +1104,60 @@ namespace instructions {
 		auto val_a = vm.get_value( a );
 		auto val_b = vm.get_value( b );
 		if( !vm.is_value( val_b ) ) {
-			std::cerr << "INVALID VALUE " << val_b << std::endl;
-			exit( EXIT_FAILURE );
+			fatal_error( "INVALID VALUE ", val_b );
 		} else if( !vm.is_value( val_a ) ) {
-			std::cerr << "INVALID VALUE " << val_a << std::endl;
-			exit( EXIT_FAILURE );
+			fatal_error( "INVALID VALUE ", val_a );
 		}
-		vm.memory[val_a] = val_b;
+		vm.set_memory( val_a, val_b );
 	}
 
 	void inst_call( virtual_machine_t & vm ) {
 		auto a = vm.pop_argument_stack( );
+		auto const target = vm.get_value( a );
+		if( vm.overrides.is_overridden( target ) ) {
+			vm.overrides.call( target, vm );
+			return;
+		}
 		vm.program_stack.push_back( vm.instruction_ptr );
-		vm.instruction_ptr = vm.get_value( a );
+		vm.instruction_ptr = target;
 	}
 
 	void inst_ret( virtual_machine_t & vm ) {
 		auto a = vm.pop_program_stack( );
 		vm.instruction_ptr = a;
+		if( vm.memo.is_recording( ) ) {
+			vm.memo.on_return( vm );
+		}
 	}
 
 	void inst_out( virtual_machine_t & vm ) {
 		auto a = vm.pop_argument_stack( );
-		std::cout << static_cast<char>(vm.get_value( a ));
+		vm.output.put( static_cast<char>(vm.get_value( a )) );
 	}
 
 	void inst_in( virtual_machine_t & vm ) {
 		auto a = vm.pop_argument_stack( );
 
-		auto tmp = getchar( );
+		vm.memo.on_input( vm );
+		vm.output.flush( );
+		auto tmp = vm.input.get( );
 		if( tmp < 0 ) {
+			if( vm.input.exhausted_policy( ) == exhausted_policy_t::halt ) {
+				throw vm_exit_t( EXIT_SUCCESS );
+			}
 			vm.debugging.should_break = true;
 		}
 		if( vm.debugging.should_break ) {
 			console( vm );
 			vm.debugging.should_break = false;
+			if( vm.debugging.history.travelled( ) ) {
+				return;
+			}
 		}
 		if( tmp < 0 ) {
 			tmp = '\n';
 		}
-		vm.get_reg_or_mem( a ) = static_cast<uint16_t>(tmp);
+		vm.set_reg_or_mem( a, static_cast<uint16_t>(tmp) );
 	}
 
 	void inst_noop( virtual_machine_t & ) {
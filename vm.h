@@ -25,10 +25,25 @@
 #include <cstdlib>
 #include <iostream>
 #include <cstring>
+#include <memory>
 #include <vector>
-#include <set>
+#include <map>
+#include <string>
+#include "address_set.h"
+#include "condition.h"
+#include "decode_cache.h"
 #include "helpers.h"
+#include "input_channel.h"
+#include "memoizer.h"
 #include "memory_helper.h"
+#include "native_override.h"
+#include "output_channel.h"
+#include "profiler.h"
+#include "trace_db.h"
+#include "trace_writer.h"
+#include "vm_history.h"
+#include "vm_snapshot.h"
+#include "watchpoints.h"
 
 struct op_t final {
 	uint16_t op_code;
@@ -50,53 +65,125 @@ struct memory_change_t final {
 	std::string to_json( ) const;
 };	// struct memory_change
 
-struct vm_trace final {
-	std::vector<uint16_t> instruction_ptrs;
-	std::vector<op_t> op_codes;
-	std::vector<memory_change_t> memory_changes;
+// Thrown in place of calling exit( ) when the program halts or the vm hits a fatal error,
+// so that a host running several vms can carry on with the others.  message is empty on 
+// a HALT
+struct vm_exit_t final {
+	int exit_code;
+	std::string message;
 
-	void clear( ) {
-		instruction_ptrs.clear( );
-		op_codes.clear( );
-		memory_changes.clear( );
-	}
+	vm_exit_t( int ExitCode, std::string Message = std::string( ) );
 
-	std::string to_json( ) const;
-};	// struct vm_trace
+	// Print message, if any, to std::cerr and return exit_code
+	int report( ) const;
+};	// struct vm_exit_t
+
+// Native code generated for a vm by run_jit( ).  Defined in jit_engine.cpp
+struct jit_cache_t;
+struct jit_cache_deleter_t {
+	void operator( )( jit_cache_t * cache ) const;
+};
+
+// How load_state brings the memory of an image or full state in.  map leaves memory a
+// private mapping of the file, see mapped_memory_t, the file must then not be changed by
+// anything but this vm while it is loaded
+enum class image_load_t { copy, map };
 
 struct virtual_machine_t {
 	virtual_memory_t<8> registers;
-	virtual_memory_t<32768u> memory;
+	mapped_memory_t memory;
 	std::vector<uint16_t> argument_stack;
-	std::vector<uint16_t> program_stack;
+	vm_stack_t<uint16_t> program_stack;
 	uint16_t instruction_ptr;
+	decode_cache_t decode_cache;
+	std::unique_ptr<jit_cache_t, jit_cache_deleter_t> jit_cache;
+	override_table_t overrides;
+	memoizer_t memo;
+	profiler_t profiler;
+	input_channel_t input;
+	output_channel_t output;
+	shared_pages_t shared_pages;	// the page each page of memory is equal to, unless dirty
+	std::map<std::string, std::shared_ptr<vm_snapshot_t const>> snapshots;	// named slots of the console
+	struct checkpoint_t {
+		std::shared_ptr<vm_snapshot_t const> state;	// as last saved to or loaded from filename
+		std::string filename;
+		size_t chain_length;	// deltas between filename and the full state it builds on
+		size_t max_chain_length;
+		checkpoint_t( ): state( ), filename( ), chain_length( 0 ), max_chain_length( 16 ) { }
+	} checkpoint;
+	image_load_t image_load;
 	struct debugging_t {
 		bool should_break;
-		std::set<uint16_t> breakpoints;
-		std::set<uint16_t> memory_traps;
-		vm_trace trace;	
+		bool armed;	// kept by rearm
+		address_set_t breakpoints;
+		struct conditional_t {
+			condition_t condition;
+			uint64_t hits;
+		};	// struct conditional_t
+		std::map<uint16_t, conditional_t> conditions;	// breakpoints that only break when theirs holds
+		address_set_t memory_traps;	// instructions using one of these as an argument break
+		watchpoints_t watchpoints;	// reads and writes that break after the instruction
+		trace_writer_t trace;	// records are only pushed while enable_tracing
 		bool enable_tracing;
-		debugging_t( ): should_break( false ), breakpoints( ), memory_traps( ), trace( ), enable_tracing( ) { }
+		std::string trace_records_file;	// where the trace in progress is written, savetrace moves them
+		std::string trace_state_file;
+		std::unique_ptr<trace_db_t> trace_db;	// opened by the console for queries
+		vm_history_t history;	// steps the console can move back through
+		debugging_t( ): should_break( false ), armed( false ), breakpoints( ), conditions( ), memory_traps( ), watchpoints( ), trace( ), enable_tracing( ), trace_records_file( ), trace_state_file( ), trace_db( ), history( ) { }
+
+		// Whether tick has anything to check or record, so that when nothing is set it
+		// costs one branch.  Call rearm after changing breakpoints, traps, watchpoints, tracing
+		// or history
+		bool is_armed( ) const {
+			return should_break | armed;
+		}
+		void rearm( ) {
+			armed = !breakpoints.empty( ) || !memory_traps.empty( ) || !watchpoints.empty( ) || enable_tracing || history.is_recording( );
+		}
 	} debugging;
 
 	static uint16_t const MODULO = 32768;
 	static uint16_t const REGISTER0 = 32768;
 
 	virtual_machine_t( );
-	virtual_machine_t( boost::string_ref filename );
+	virtual_machine_t( boost::string_ref filename, image_load_t ImageLoad = image_load_t::copy );
 
 	void tick( bool is_debugger = false );
+	bool is_instrumented( ) const;
 	uint16_t & get_register( uint16_t i );
 	static bool is_value( uint16_t i );
 	static bool is_register( uint16_t i );
 	static void validate( uint16_t i ); 
 	uint16_t & get_value( uint16_t & i );
 	uint16_t & get_reg_or_mem( uint16_t i );
+	void set_reg_or_mem( uint16_t i, uint16_t value );
+	void set_register( uint16_t i, uint16_t value );
+	void set_memory( uint16_t address, uint16_t value );
+	// Data reads of memory, as opposed to fetching instructions
+	uint16_t read_memory( uint16_t address );
 	uint16_t pop_argument_stack( );	
 	uint16_t pop_program_stack( );
 	uint16_t fetch_opcode( bool is_instruction = false );
 	void save_state( boost::string_ref filename );
+	// The file save_state writes, without making it the checkpoint deltas build on
+	void write_state( boost::string_ref filename );
+	// Same state as save_state in a block compressed container, see state_container.h
+	void save_compressed_state( boost::string_ref filename );
 	void load_state( boost::string_ref filename );
+	// Write only the pages that differ from the checkpoint, with a link to its file.  Falls
+	// back to save_state when there is no checkpoint, the chain reaches max_chain_length or
+	// filename is one of the files the checkpoint builds on
+	void save_delta( boost::string_ref filename );
+	// Snapshots copy only the pages written since the last snapshot or restore and share
+	// the rest.  A fork is a new vm restored from a snapshot, with default input and output
+	// and no overrides.  It starts out sharing all of our pages, so its own snapshots copy
+	// a page only once it has written to it
+	std::shared_ptr<vm_snapshot_t const> snapshot( );
+	void restore( vm_snapshot_t const & state );
+	std::unique_ptr<virtual_machine_t> fork( );
+	void add_override( uint16_t address, native_override_t function );
+	void remove_override( uint16_t address );
+	void load_plugin( std::string const & filename );
 	void clear( );
 
 };	// struct virtual_machine_t
@@ -105,7 +192,7 @@ std::string full_dump_string( virtual_machine_t & vm, uint16_t from_address = 0,
 void full_dump( virtual_machine_t & vm, uint16_t from_address = 0, uint16_t to_address = std::numeric_limits<uint16_t>::max( ) );
 
 namespace instructions {
-	void inst_halt( virtual_machine_t & );
+	void inst_halt( virtual_machine_t & vm );
 	void inst_set( virtual_machine_t & vm );
 	void inst_push( virtual_machine_t & vm );
 	void inst_pop( virtual_machine_t & vm );
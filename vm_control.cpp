@@ -20,11 +20,14 @@
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 // SOFTWARE.
 
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 #include <boost/algorithm/string.hpp>
 #include <boost/filesystem.hpp>
+#include "file_helper.h"
 #include "vm.h"
+#include "trace_db.h"
 #include "vm_control.h"
 #include "helpers.h"
 
@@ -91,13 +94,20 @@ void vm_control::get_regs( virtual_machine_t & vm ) {
 void vm_control::get_bps( virtual_machine_t & vm ) {
 	std::cout << "Current breakpoints(" << vm.debugging.breakpoints.size( ) << ")\n";
 	for( auto const & bp : vm.debugging.breakpoints ) {
-		std::cout << bp << "\n";
+		std::cout << bp;
+		auto const it = vm.debugging.conditions.find( bp );
+		if( vm.debugging.conditions.end( ) != it ) {
+			std::cout << " if " << it->second.condition.text( ) << " (" << it->second.hits << " hits)";
+		}
+		std::cout << "\n";
 	}
 }
 
 void vm_control::clear_bps( virtual_machine_t & vm ) {
 	std::cout << "Clearing " << vm.debugging.breakpoints.size( ) << " breakpoints\n";
 	vm.debugging.breakpoints.clear( );
+	vm.debugging.conditions.clear( );
+	vm.debugging.rearm( );
 }
 
 void vm_control::get_memory_traps(virtual_machine_t& vm) {
@@ -110,6 +120,7 @@ void vm_control::get_memory_traps(virtual_machine_t& vm) {
 void vm_control::clear_memory_traps( virtual_machine_t& vm ) {
 	std::cout << "Clearing " << vm.debugging.memory_traps.size( ) << " memory traps\n";
 	vm.debugging.memory_traps.clear( );
+	vm.debugging.rearm( );
 }
 
 void vm_control::save_state( virtual_machine_t & vm, boost::string_ref fname ) {
@@ -122,6 +133,46 @@ void vm_control::load_state( virtual_machine_t & vm, boost::string_ref fname ) {
 	std::cout << "Loaded state from file '" << fname << "'\n";
 }
 
+void vm_control::save_compressed_state( virtual_machine_t & vm, boost::string_ref fname ) {
+	vm.save_compressed_state( fname );
+	std::cout << "Compressed state saved to file '" << fname << "'\n";
+}
+
+void vm_control::save_delta( virtual_machine_t & vm, boost::string_ref fname ) {
+	try {
+		vm.save_delta( fname );
+	} catch( vm_exit_t const & ex ) {
+		std::cout << ex.message << "\n";
+		return;
+	} catch( std::exception const & ex ) {
+		std::cout << "Error saving delta to '" << fname << "': " << ex.what( ) << "\n";
+		return;
+	}
+	std::cout << "Delta saved to file '" << fname << "' (chain of " << vm.checkpoint.chain_length << ")\n";
+}
+
+void vm_control::compact_state( boost::string_ref from, boost::string_ref to ) {
+	try {
+		virtual_machine_t vm;
+		vm.load_state( from );
+		vm.save_state( to );
+	} catch( vm_exit_t const & ex ) {
+		std::cout << ex.message << "\n";
+		return;
+	} catch( std::exception const & ex ) {
+		std::cout << "Error compacting '" << from << "' into '" << to << "': " << ex.what( ) << "\n";
+		return;
+	}
+	std::cout << "Compacted '" << from << "' into full state '" << to << "'\n";
+}
+
+void vm_control::show_snapshots( virtual_machine_t & vm ) {
+	std::cout << "Kept states(" << vm.snapshots.size( ) << ")\n";
+	for( auto const & item : vm.snapshots ) {
+		std::cout << item.first << ": ip " << item.second->instruction_ptr << "\n";
+	}
+}
+
 void vm_control::show_argument_stack( virtual_machine_t & vm ) {
 	std::cout << "Current argument stack(" << vm.argument_stack.size( ) << ")\n";
 	for( size_t n = 0; n < vm.argument_stack.size( ); ++n ) {
@@ -137,15 +188,298 @@ void vm_control::show_program_stack( virtual_machine_t & vm ) {
 }
 
 void vm_control::save_trace(virtual_machine_t& vm, boost::string_ref fname) {
-	save_to_text_file( fname, vm.debugging.trace.to_json( ) );
-	boost::filesystem::rename( "trace_state.bin", fname.to_string( ) + ".state" );
+	stop_tracing( vm );
+	auto & records_file = vm.debugging.trace_records_file;
+	auto & state_file = vm.debugging.trace_state_file;
+	if( records_file.empty( ) ) {
+		std::cout << "No trace to save\n";
+		return;
+	}
+	if( !trace_to_json( records_file, fname.to_string( ) ) ) {
+		std::cout << "Error converting trace to '" << fname << "'\n";
+		return;
+	}
+	auto const move_file = []( std::string const & from, std::string const & to ) {
+		boost::system::error_code ec;
+		boost::filesystem::rename( from, to, ec );
+		if( ec ) {
+			std::cout << "Error moving '" << from << "' to '" << to << "': " << ec.message( ) << "\n";
+		}
+	};
+	move_file( state_file, fname.to_string( ) + ".state" );
+	move_file( records_file, fname.to_string( ) + ".trace" );
+	records_file.clear( );
+	state_file.clear( );
 }
 
+// Records stream to a temporary file as the program runs, savetrace converts them.  The
+// starting state is written beside it without becoming the checkpoint for savedelta
 void vm_control::start_tracing( virtual_machine_t & vm ) {
-	save_state( vm, "trace_state.bin" );
+	auto & records_file = vm.debugging.trace_records_file;
+	auto & state_file = vm.debugging.trace_state_file;
+	records_file = generate_unique_file_name( "sc_", "_trace_records", "bin" );
+	state_file = generate_unique_file_name( "sc_", "_trace_state", "bin" );
+	if( !vm.debugging.trace.start( records_file ) ) {
+		std::cout << "Error opening file: " << records_file << "\n";
+		records_file.clear( );
+		return;
+	}
+	vm.write_state( state_file );
 	vm.debugging.enable_tracing = true;
+	vm.debugging.rearm( );
 }
 
 void vm_control::stop_tracing( virtual_machine_t & vm ) {
 	vm.debugging.enable_tracing = false;
+	vm.debugging.trace.stop( );
+	vm.debugging.rearm( );
+}
+
+// A trace saved as fname has its records in fname.trace and its starting state in fname.state
+void vm_control::index_trace( boost::string_ref fname ) {
+	auto const name = fname.to_string( );
+	try {
+		trace_db_t::build( name + ".trace", name + ".state", name + ".idx" );
+	} catch( vm_exit_t const & ex ) {
+		std::cout << ex.message << "\n";
+		return;
+	} catch( std::exception const & ex ) {
+		std::cout << "Error indexing trace '" << fname << "': " << ex.what( ) << "\n";
+		return;
+	}
+	std::cout << "Indexed trace '" << fname << "' into '" << name << ".idx'\n";
+}
+
+void vm_control::open_trace( virtual_machine_t & vm, boost::string_ref fname ) {
+	auto const name = fname.to_string( );
+	try {
+		vm.debugging.trace_db = std::make_unique<trace_db_t>( name + ".trace", name + ".idx" );
+	} catch( vm_exit_t const & ex ) {
+		std::cout << ex.message << "\n";
+		return;
+	} catch( std::exception const & ex ) {
+		std::cout << "Error opening trace '" << fname << "': " << ex.what( ) << "\n";
+		return;
+	}
+	std::cout << "Opened trace '" << fname << "' of " << vm.debugging.trace_db->size( ) << " steps\n";
+}
+
+void vm_control::last_write( virtual_machine_t & vm, uint16_t address, uint64_t step ) {
+	if( !vm.debugging.trace_db ) {
+		std::cout << "No trace open\n";
+		return;
+	}
+	uint64_t writer = 0;
+	if( !vm.debugging.trace_db->last_write( address, step, writer ) ) {
+		std::cout << "Address " << address << " is not written before step " << step << "\n";
+		return;
+	}
+	auto const record = vm.debugging.trace_db->record( writer );
+	std::cout << "Address " << address << " last written at step " << writer << " by ip " << executed_address( record );
+	std::cout << " from " << record.old_value << " to " << record.new_value << "\n";
+}
+
+void vm_control::show_executions( virtual_machine_t & vm, uint16_t ip, uint64_t step ) {
+	if( !vm.debugging.trace_db ) {
+		std::cout << "No trace open\n";
+		return;
+	}
+	size_t const max_shown = 32;
+	auto const steps = vm.debugging.trace_db->executions( ip, step, max_shown );
+	std::cout << "ip " << ip << " executed " << vm.debugging.trace_db->execution_count( ip ) << " times";
+	std::cout << ", from step " << step << " (" << steps.size( ) << " shown)\n";
+	for( auto const & s : steps ) {
+		std::cout << s << "\n";
+	}
+}
+
+// Without fname the current state is replaced with the one at step
+void vm_control::state_at( virtual_machine_t & vm, uint64_t step, boost::string_ref fname ) {
+	if( !vm.debugging.trace_db ) {
+		std::cout << "No trace open\n";
+		return;
+	}
+	std::unique_ptr<virtual_machine_t> state;
+	try {
+		state = vm.debugging.trace_db->state_at( step );
+	} catch( vm_exit_t const & ex ) {
+		std::cout << ex.message << "\n";
+		return;
+	} catch( std::exception const & ex ) {
+		std::cout << "Error rebuilding state at step " << step << ": " << ex.what( ) << "\n";
+		return;
+	}
+	if( fname.empty( ) ) {
+		vm.restore( *state->snapshot( ) );
+		std::cout << "Restored state at step " << step << ", ip " << vm.instruction_ptr << "\n";
+		return;
+	}
+	state->save_state( fname );
+	std::cout << "State at step " << step << " saved to file '" << fname << "'\n";
+}
+
+void vm_control::start_history( virtual_machine_t & vm ) {
+	vm.debugging.history.start( vm );
+	vm.debugging.rearm( );
+	std::cout << "Recording history from ip " << vm.instruction_ptr << "\n";
+}
+
+void vm_control::stop_history( virtual_machine_t & vm ) {
+	vm.debugging.history.stop( );
+	vm.debugging.rearm( );
+	std::cout << "Stopped recording history\n";
+}
+
+void vm_control::show_history( virtual_machine_t & vm ) {
+	auto const & history = vm.debugging.history;
+	if( !history.is_recording( ) ) {
+		std::cout << "History is not being recorded\n";
+		return;
+	}
+	std::cout << "At step " << history.position( ) << " of " << history.first( ) << "-" << history.last( );
+	std::cout << ", ip " << vm.instruction_ptr << "\n";
+}
+
+void vm_control::step_back( virtual_machine_t & vm, uint64_t count ) {
+	auto & history = vm.debugging.history;
+	if( !history.is_recording( ) ) {
+		std::cout << "History is not being recorded\n";
+		return;
+	}
+	history.go_to( vm, history.position( ) - std::min( count, history.position( ) - history.first( ) ) );
+	show_history( vm );
+}
+
+// Steps back until about to execute a breakpoint, an instruction using a memory trap or one
+// writing to a write or change watchpoint.  Reads are not kept so read watchpoints do not stop
+void vm_control::reverse_continue( virtual_machine_t & vm ) {
+	auto & history = vm.debugging.history;
+	if( !history.is_recording( ) ) {
+		std::cout << "History is not being recorded\n";
+		return;
+	}
+	auto const & traps = vm.debugging.memory_traps;
+	auto const & watches = vm.debugging.watchpoints;
+	while( history.position( ) > history.first( ) ) {
+		auto const & record = history.step( history.position( ) - 1 ).record;
+		history.go_to( vm, history.position( ) - 1 );
+		auto const watched = instructions::decoder( )[record.op_code].do_memory_trace ? watches.kinds( record.address ) : 0;
+		auto const is_changed = (record.flags & trace_record_t::HAS_CHANGE) != 0;
+		auto const is_watched = (watched & watchpoints_t::WRITE) != 0 || ((watched & watchpoints_t::CHANGE) != 0 && is_changed);
+		if( is_watched || traps.intersects( record.args, record.args + record.arg_count ) || vm.debugging.breakpoints.count( vm.instruction_ptr ) != 0 ) {
+			break;
+		}
+	}
+	show_history( vm );
+}
+
+void vm_control::go_to( virtual_machine_t & vm, uint64_t position ) {
+	auto & history = vm.debugging.history;
+	if( !history.is_recording( ) ) {
+		std::cout << "History is not being recorded\n";
+		return;
+	}
+	if( position < history.first( ) || position > history.last( ) ) {
+		std::cout << "Step " << position << " is not in history " << history.first( ) << "-" << history.last( ) << "\n";
+		return;
+	}
+	history.go_to( vm, position );
+	show_history( vm );
+}
+
+void vm_control::set_watch( virtual_machine_t & vm, uint16_t address, boost::string_ref kinds ) {
+	uint8_t mask = 0;
+	for( auto c : kinds ) {
+		switch( c ) {
+		case 'r':
+			mask |= watchpoints_t::READ;
+			break;
+		case 'w':
+			mask |= watchpoints_t::WRITE;
+			break;
+		case 'c':
+			mask |= watchpoints_t::CHANGE;
+			break;
+		default:
+			std::cout << "Unknown watch kind '" << c << "', expected r, w or c\n";
+			return;
+		}
+	}
+	if( mask == 0 ) {
+		std::cout << "No watch kinds given, expected any of r, w and c\n";
+		return;
+	}
+	if( address >= address_set_t::SIZE ) {
+		std::cout << "Cannot watch " << address << ", memory is 0-32767 and registers 32768-32775\n";
+		return;
+	}
+	vm.debugging.watchpoints.set( address, mask );
+	vm.debugging.rearm( );
+	std::cout << "Watching " << address << " for " << kinds << "\n";
+}
+
+void vm_control::clear_watch( virtual_machine_t & vm, uint16_t address ) {
+	vm.debugging.watchpoints.set( address, 0 );
+	vm.debugging.rearm( );
+	std::cout << "Clear watchpoint on " << address << "\n";
+}
+
+void vm_control::get_watches( virtual_machine_t & vm ) {
+	std::cout << "Current watchpoints(" << vm.debugging.watchpoints.size( ) << ")\n";
+	vm.debugging.watchpoints.for_each( []( uint16_t address, uint8_t kinds ) {
+		std::cout << address << " ";
+		std::cout << ((kinds & watchpoints_t::READ) != 0 ? "r" : "");
+		std::cout << ((kinds & watchpoints_t::WRITE) != 0 ? "w" : "");
+		std::cout << ((kinds & watchpoints_t::CHANGE) != 0 ? "c" : "") << "\n";
+	} );
+}
+
+void vm_control::clear_watches( virtual_machine_t & vm ) {
+	std::cout << "Clearing " << vm.debugging.watchpoints.size( ) << " watchpoints\n";
+	vm.debugging.watchpoints.clear( );
+	vm.debugging.rearm( );
+}
+
+void vm_control::profile( virtual_machine_t & vm, boost::string_ref command, boost::string_ref argument ) {
+	if( command == "start" ) {
+		vm.profiler.start( );
+		std::cout << "Profiling from ip " << vm.instruction_ptr << "\n";
+	} else if( command == "stop" ) {
+		vm.profiler.stop( );
+		std::cout << "Stopped profiling after " << vm.profiler.total( ) << " instructions\n";
+	} else if( command == "report" ) {
+		vm.profiler.report( std::cout, vm, argument.empty( ) ? 20 : convert<size_t>( argument ) );
+	} else if( command == "flame" && !argument.empty( ) ) {
+		std::ofstream out( argument.to_string( ) );
+		vm.profiler.calls( ).write_collapsed( out );
+		if( !out ) {
+			std::cout << "Could not write '" << argument << "'\n";
+			return;
+		}
+		std::cout << "Collapsed stacks written to '" << argument << "'\n";
+	} else {
+		std::cout << "Unknown profile command '" << command << "', expected start, stop, report or flame <filename>\n";
+	}
+}
+
+void vm_control::backtrace( virtual_machine_t & vm, size_t count ) {
+	if( !vm.profiler.is_running( ) ) {
+		std::cout << "Calls are only followed while profiling\n";
+		return;
+	}
+	auto const & frames = vm.profiler.calls( ).frames( );
+	std::cout << "#0 " << vm.instruction_ptr << " in " << (frames.empty( ) ? std::string( "entry" ) : std::to_string( frames.back( ).function )) << "\n";
+	auto const shown = std::min( count, frames.size( ) );
+	for( size_t n = 1; n <= shown; ++n ) {
+		auto const & frame = frames[frames.size( ) - n];
+		std::cout << "#" << n << " " << frame.call_address << " in ";
+		if( n == frames.size( ) ) {
+			std::cout << "entry\n";
+		} else {
+			std::cout << frames[frames.size( ) - n - 1].function << "\n";
+		}
+	}
+	if( shown < frames.size( ) ) {
+		std::cout << "(" << (frames.size( ) - shown) << " more frames)\n";
+	}
 }
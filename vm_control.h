@@ -22,6 +22,7 @@
 
 #pragma once
 
+#include <boost/algorithm/string/join.hpp>
 #include <boost/utility/string_ref.hpp>
 #include <limits>
 #include <cstdint>
@@ -48,125 +49,305 @@ struct vm_control final {
 		std::cout << "\n\n";
 	}
 
+	// The console passes the arguments without the command name, see parse_action_t
 	template<typename Tokens>
 	static void set_ip( virtual_machine_t & vm, Tokens const & tokens ) {
-		if( tokens.size( ) != 2 ) {
-			std::cout << "Error\n";
+		if( tokens.size( ) != 1 ) {
+			std::cout << "Usage: setip <address>\n";
+			return;
+		}
+		auto new_ip = convert<uint16_t>( tokens[0] );
+		if( new_ip >= vm.memory.size( ) ) {
+			std::cout << "Address " << new_ip << " is outside of memory (0-" << vm.memory.size( ) - 1 << ")\n";
 			return;
 		}
-		auto new_ip = convert<uint16_t>( tokens[1] );
-		assert( new_ip < vm.memory.size( ) );
 		std::cout << "Setting instruction ptr to " << new_ip << "\n";
 		vm.instruction_ptr = new_ip;
 	}
 
 	template<typename Tokens>
 	static void get_mem( virtual_machine_t & vm, Tokens const & tokens ) {
-		if( tokens.size( ) != 2 ) {
-			std::cout << "Error\n";
+		if( tokens.size( ) != 1 ) {
+			std::cout << "Usage: get_mem <address>\n";
+			return;
+		}
+		auto addr = convert<uint16_t>( tokens[0] );
+		if( addr >= vm.memory.size( ) ) {
+			std::cout << "Address " << addr << " is outside of memory (0-" << vm.memory.size( ) - 1 << ")\n";
 			return;
 		}
-		auto addr = convert<uint16_t>( tokens[1] );
-		assert( addr < vm.memory.size( ) );
 		std::cout << "Memory at address " << addr << " has a value of " << vm.memory[addr] << "\n";
 	}
 
 	template<typename Tokens>
 	static void set_mem( virtual_machine_t & vm, Tokens const & tokens ) {
-		if( tokens.size( ) != 3 ) {
-			std::cout << "Error\n";
+		if( tokens.size( ) != 2 ) {
+			std::cout << "Usage: set_mem <address> <value>\n";
+			return;
 		}
-		auto addr = convert<uint16_t>( tokens[1] );
-		auto value = convert<uint16_t>( tokens[2] );
-		assert( addr < vm.memory.size( ) );
-		std::cout << "Setting memory at address " << addr << " has with a value of " << value << "\n";
-		vm.memory[addr] = value;
-
+		auto addr = convert<uint16_t>( tokens[0] );
+		auto value = convert<uint16_t>( tokens[1] );
+		if( addr >= vm.memory.size( ) ) {
+			std::cout << "Address " << addr << " is outside of memory (0-" << vm.memory.size( ) - 1 << ")\n";
+			return;
+		}
+		std::cout << "Setting memory at address " << addr << " with a value of " << value << "\n";
+		vm.set_memory( addr, value );
 	}
 
 	template<typename Tokens>
 	static void get_reg( virtual_machine_t & vm, Tokens const & tokens ) {
-		if( tokens.size( ) != 2 ) {
-			std::cout << "Error\n";
+		if( tokens.size( ) != 1 ) {
+			std::cout << "Usage: getreg <0-7>\n";
+			return;
+		}
+		auto addr = convert<uint16_t>( tokens[0] );
+		if( addr >= vm.registers.size( ) ) {
+			std::cout << "There is no register " << addr << ", registers are 0-7\n";
 			return;
 		}
-		auto addr = convert<uint16_t>( tokens[1] );
-		assert( addr < vm.registers.size( ) );
 		std::cout << "Register " << addr << " has a value of " << vm.registers[addr] << "\n";
-
 	}
 
 	template<typename Tokens>
 	static void set_reg( virtual_machine_t & vm, Tokens const & tokens ) {
-		if( tokens.size( ) != 3 ) {
-			std::cout << "Error\n";
+		if( tokens.size( ) != 2 ) {
+			std::cout << "Usage: setreg <0-7> <value>\n";
+			return;
+		}
+		auto addr = convert<uint16_t>( tokens[0] );
+		auto value = convert<uint16_t>( tokens[1] );
+		if( addr >= vm.registers.size( ) ) {
+			std::cout << "There is no register " << addr << ", registers are 0-7\n";
 			return;
 		}
-		auto addr = convert<uint16_t>( tokens[1] );
-		auto value = convert<uint16_t>( tokens[2] );
-		assert( addr < vm.registers.size( ) );
 		std::cout << "Setting register " << addr << " with a value of " << value << "\n";
 		vm.registers[addr] = value;
 	}
 
+	// <address> [if <condition>], see condition.h
 	template<typename Tokens>
 	static void set_bp( virtual_machine_t & vm, Tokens const & tokens ) {
-		if( tokens.size( ) != 2 ) {
+		if( tokens.empty( ) || (tokens.size( ) > 1 && (tokens.size( ) < 3 || tokens[1] != "if")) ) {
 			std::cout << "Error\n";
 			return;
 		}
-		auto addr = convert<uint16_t>( tokens[1] );
-		std::cout << "Setting breakpoint at " << addr << "\n";
+		auto addr = convert<uint16_t>( tokens[0] );
 		assert( addr < vm.memory.size( ) );
+		if( tokens.size( ) == 1 ) {
+			std::cout << "Setting breakpoint at " << addr << "\n";
+			vm.debugging.conditions.erase( addr );
+		} else {
+			auto const text = boost::algorithm::join( std::vector<std::string>( tokens.begin( ) + 2, tokens.end( ) ), " " );
+			condition_t condition;
+			std::string error;
+			if( !condition_t::compile( text, condition, error ) ) {
+				std::cout << "Error in condition: " << error << "\n";
+				return;
+			}
+			std::cout << "Setting breakpoint at " << addr << " if " << text << "\n";
+			vm.debugging.conditions[addr] = virtual_machine_t::debugging_t::conditional_t{ std::move( condition ), 0 };
+		}
 		vm.debugging.breakpoints.insert( addr );
+		vm.debugging.rearm( );
 	}
 
 	template<typename Tokens>
 	static void clear_bp( virtual_machine_t & vm, Tokens const & tokens ) {
-		if( tokens.size( ) != 2 ) {
+		if( tokens.size( ) != 1 ) {
 			std::cout << "Error\n";
 			return;
 		}
-		auto addr = convert<uint16_t>( tokens[1] );
+		auto addr = convert<uint16_t>( tokens[0] );
 		std::cout << "Clear breakpoint at " << addr << "\n";
 		assert( addr < vm.memory.size( ) );
 		vm.debugging.breakpoints.erase( addr );
+		vm.debugging.conditions.erase( addr );
+		vm.debugging.rearm( );
 	}
 
 	template<typename Tokens>
 	static void set_memory_trap( virtual_machine_t & vm, Tokens const & tokens ) {
-		if( tokens.size( ) != 2 ) {
+		if( tokens.size( ) != 1 ) {
 			std::cout << "Error\n";
 			return;
 		}
-		auto addr = convert<uint16_t>( tokens[1] );
+		auto addr = convert<uint16_t>( tokens[0] );
 		std::cout << "Setting memory trap at " << addr << "\n";
-		assert( addr < vm.memory.size( ) + 8 );
+		assert( addr < address_set_t::SIZE );
 		vm.debugging.memory_traps.insert( addr );
+		vm.debugging.rearm( );
 	}
 
 	template<typename Tokens>
 	static void set_instruction_trap( virtual_machine_t & vm, Tokens const & tokens ) {
-		if( tokens.size( ) != 2 ) {
+		if( tokens.size( ) != 1 ) {
 			std::cout << "Error\n";
 			return;
 		}
-		auto addr = convert<uint16_t>( tokens[1] );
+		auto addr = convert<uint16_t>( tokens[0] );
 		std::cout << "Setting memory trap at " << addr << "\n";
-		assert( addr < vm.memory.size( ) + 8 );
+		assert( addr < address_set_t::SIZE );
 		vm.debugging.memory_traps.insert( addr );
+		vm.debugging.rearm( );
 	}
 
 	template<typename Tokens>
 	static void clear_memory_trap( virtual_machine_t & vm, Tokens const & tokens ) {
-		if( tokens.size( ) != 2 ) {
+		if( tokens.size( ) != 1 ) {
 			std::cout << "Error\n";
 			return;
 		}
-		auto addr = convert<uint16_t>( tokens[1] );
+		auto addr = convert<uint16_t>( tokens[0] );
 		std::cout << "Clear memory trap at " << addr << "\n";
-		assert( addr < vm.memory.size( ) );
 		vm.debugging.memory_traps.erase( addr );
+		vm.debugging.rearm( );
+	}
+
+	template<typename Tokens>
+	static void set_watch( virtual_machine_t & vm, Tokens const & tokens ) {
+		if( tokens.empty( ) || tokens.size( ) > 2 ) {
+			std::cout << "Usage: setwatch <address> [kinds], with address 0-32775 and kinds any of r, w and c\n";
+			return;
+		}
+		set_watch( vm, convert<uint16_t>( tokens[0] ), tokens.size( ) > 1 ? tokens[1] : std::string( "w" ) );
+	}
+
+	template<typename Tokens>
+	static void clear_watch( virtual_machine_t & vm, Tokens const & tokens ) {
+		if( tokens.size( ) != 1 ) {
+			std::cout << "Usage: clearwatch <address>\n";
+			return;
+		}
+		clear_watch( vm, convert<uint16_t>( tokens[0] ) );
+	}
+
+	template<typename Tokens>
+	static void take_snapshot( virtual_machine_t & vm, Tokens const & tokens ) {
+		if( tokens.size( ) != 1 ) {
+			std::cout << "Error\n";
+			return;
+		}
+		vm.snapshots[tokens[0]] = vm.snapshot( );
+		std::cout << "State kept as '" << tokens[0] << "'\n";
+	}
+
+	template<typename Tokens>
+	static void restore_snapshot( virtual_machine_t & vm, Tokens const & tokens ) {
+		if( tokens.size( ) != 1 ) {
+			std::cout << "Error\n";
+			return;
+		}
+		auto it = vm.snapshots.find( tokens[0] );
+		if( vm.snapshots.end( ) == it ) {
+			std::cout << "No state kept as '" << tokens[0] << "'\n";
+			return;
+		}
+		vm.restore( *it->second );
+		std::cout << "Restored state '" << tokens[0] << "'\n";
+	}
+
+	template<typename Tokens>
+	static void drop_snapshot( virtual_machine_t & vm, Tokens const & tokens ) {
+		if( tokens.size( ) != 1 || vm.snapshots.erase( tokens[0] ) == 0 ) {
+			std::cout << "Error\n";
+			return;
+		}
+		std::cout << "Forgot state '" << tokens[0] << "'\n";
+	}
+
+	template<typename Tokens>
+	static void compact_state( Tokens const & tokens ) {
+		if( tokens.size( ) != 2 ) {
+			std::cout << "Usage: compactstate <from> <to>\n";
+			return;
+		}
+		compact_state( tokens[0], tokens[1] );
+	}
+
+	template<typename Tokens>
+	static void index_trace( Tokens const & tokens ) {
+		if( tokens.size( ) != 1 ) {
+			std::cout << "Error\n";
+			return;
+		}
+		index_trace( boost::string_ref( tokens[0] ) );
+	}
+
+	template<typename Tokens>
+	static void open_trace( virtual_machine_t & vm, Tokens const & tokens ) {
+		if( tokens.size( ) != 1 ) {
+			std::cout << "Error\n";
+			return;
+		}
+		open_trace( vm, boost::string_ref( tokens[0] ) );
+	}
+
+	template<typename Tokens>
+	static void last_write( virtual_machine_t & vm, Tokens const & tokens ) {
+		if( tokens.size( ) != 2 ) {
+			std::cout << "Error\n";
+			return;
+		}
+		last_write( vm, convert<uint16_t>( tokens[0] ), convert<uint64_t>( tokens[1] ) );
+	}
+
+	template<typename Tokens>
+	static void show_executions( virtual_machine_t & vm, Tokens const & tokens ) {
+		if( tokens.empty( ) || tokens.size( ) > 2 ) {
+			std::cout << "Error\n";
+			return;
+		}
+		uint64_t step = 0;
+		if( tokens.size( ) > 1 ) {
+			step = convert<uint64_t>( tokens[1] );
+		}
+		show_executions( vm, convert<uint16_t>( tokens[0] ), step );
+	}
+
+	template<typename Tokens>
+	static void state_at( virtual_machine_t & vm, Tokens const & tokens ) {
+		if( tokens.empty( ) || tokens.size( ) > 2 ) {
+			std::cout << "Error\n";
+			return;
+		}
+		state_at( vm, convert<uint64_t>( tokens[0] ), tokens.size( ) > 1 ? tokens[1] : std::string( ) );
+	}
+
+	template<typename Tokens>
+	static void step_back( virtual_machine_t & vm, Tokens const & tokens ) {
+		uint64_t count = 1;
+		if( !tokens.empty( ) && !tokens[0].empty( ) ) {
+			count = convert<uint64_t>( tokens[0] );
+		}
+		step_back( vm, count );
+	}
+
+	template<typename Tokens>
+	static void go_to( virtual_machine_t & vm, Tokens const & tokens ) {
+		if( tokens.size( ) != 1 ) {
+			std::cout << "Error\n";
+			return;
+		}
+		go_to( vm, convert<uint64_t>( tokens[0] ) );
+	}
+
+	template<typename Tokens>
+	static void profile( virtual_machine_t & vm, Tokens const & tokens ) {
+		if( tokens.empty( ) || tokens.size( ) > 2 ) {
+			std::cout << "Error\n";
+			return;
+		}
+		profile( vm, tokens[0], tokens.size( ) > 1 ? tokens[1] : std::string( ) );
+	}
+
+	template<typename Tokens>
+	static void backtrace( virtual_machine_t & vm, Tokens const & tokens ) {
+		size_t count = 20;
+		if( !tokens.empty( ) && !tokens[0].empty( ) ) {
+			count = convert<size_t>( tokens[0] );
+		}
+		backtrace( vm, count );
 	}
 
 	static void save_asm( virtual_machine_t & vm, boost::string_ref fname );
@@ -177,11 +358,32 @@ struct vm_control final {
 	static void clear_bps( virtual_machine_t & vm );
 	static void get_memory_traps( virtual_machine_t & vm );
 	static void clear_memory_traps( virtual_machine_t & vm );
+	static void set_watch( virtual_machine_t & vm, uint16_t address, boost::string_ref kinds );
+	static void clear_watch( virtual_machine_t & vm, uint16_t address );
+	static void get_watches( virtual_machine_t & vm );
+	static void clear_watches( virtual_machine_t & vm );
 	static void save_state( virtual_machine_t & vm, boost::string_ref fname );
 	static void load_state( virtual_machine_t & vm, boost::string_ref fname );
+	static void save_compressed_state( virtual_machine_t & vm, boost::string_ref fname );
+	static void save_delta( virtual_machine_t & vm, boost::string_ref fname );
+	static void compact_state( boost::string_ref from, boost::string_ref to );
+	static void show_snapshots( virtual_machine_t & vm );
 	static void show_argument_stack( virtual_machine_t & vm );
 	static void show_program_stack( virtual_machine_t & vm );
 	static void save_trace( virtual_machine_t & vm, boost::string_ref fname );
 	static void start_tracing( virtual_machine_t & vm );
 	static void stop_tracing( virtual_machine_t & vm );
+	static void index_trace( boost::string_ref fname );
+	static void open_trace( virtual_machine_t & vm, boost::string_ref fname );
+	static void last_write( virtual_machine_t & vm, uint16_t address, uint64_t step );
+	static void show_executions( virtual_machine_t & vm, uint16_t ip, uint64_t step );
+	static void state_at( virtual_machine_t & vm, uint64_t step, boost::string_ref fname );
+	static void start_history( virtual_machine_t & vm );
+	static void stop_history( virtual_machine_t & vm );
+	static void show_history( virtual_machine_t & vm );
+	static void step_back( virtual_machine_t & vm, uint64_t count );
+	static void reverse_continue( virtual_machine_t & vm );
+	static void go_to( virtual_machine_t & vm, uint64_t position );
+	static void profile( virtual_machine_t & vm, boost::string_ref command, boost::string_ref argument );
+	static void backtrace( virtual_machine_t & vm, size_t count );
 };	//struct vm_control
@@ -0,0 +1,134 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+
+#include <algorithm>
+#include "trace_db.h"
+#include "vm.h"
+#include "vm_history.h"
+
+vm_history_t::vm_history_t( ):
+	max_steps( DEFAULT_MAX_STEPS ),
+	m_steps( ),
+	m_checkpoints( ),
+	m_first( 0 ),
+	m_position( 0 ),
+	m_recording( false ),
+	m_travelled( false ) { }
+
+void vm_history_t::start( virtual_machine_t & vm ) {
+	m_steps.clear( );
+	m_checkpoints.clear( );
+	m_checkpoints.push_back( vm.snapshot( ) );
+	m_first = 0;
+	m_position = 0;
+	m_recording = true;
+	m_travelled = false;
+}
+
+void vm_history_t::stop( ) {
+	m_steps.clear( );
+	m_checkpoints.clear( );
+	m_first = 0;
+	m_position = 0;
+	m_recording = false;
+	m_travelled = false;
+}
+
+void vm_history_t::push( virtual_machine_t & vm, trace_record_t const & record ) {
+	if( m_position != last( ) ) {
+		// Executing from an earlier position starts a new future
+		auto const kept = static_cast<size_t>(m_position - m_first);
+		m_steps.resize( kept );
+		m_checkpoints.resize( kept / CHECKPOINT_INTERVAL + 1 );
+	}
+	m_steps.push_back( step_t{ record, vm.instruction_ptr } );
+	++m_position;
+	if( m_position % CHECKPOINT_INTERVAL == 0 ) {
+		m_checkpoints.push_back( vm.snapshot( ) );
+	}
+	if( m_steps.size( ) > max_steps && m_checkpoints.size( ) > 1 ) {
+		m_steps.erase( m_steps.begin( ), m_steps.begin( ) + CHECKPOINT_INTERVAL );
+		m_checkpoints.pop_front( );
+		m_first += CHECKPOINT_INTERVAL;
+	}
+}
+
+void vm_history_t::go_to( virtual_machine_t & vm, uint64_t position ) {
+	if( position < first( ) || position > last( ) ) {
+		throw vm_exit_t( EXIT_FAILURE, "Position outside of history" );
+	}
+	// Start from the nearest checkpoint when it is closer than where vm is now
+	auto const index = std::min( static_cast<size_t>((position - m_first + CHECKPOINT_INTERVAL / 2) / CHECKPOINT_INTERVAL), m_checkpoints.size( ) - 1 );
+	auto const checkpoint = m_first + index * CHECKPOINT_INTERVAL;
+	auto const distance = []( uint64_t a, uint64_t b ) { return a > b ? a - b : b - a; };
+	if( distance( checkpoint, position ) < distance( m_position, position ) ) {
+		vm.restore( *m_checkpoints[index] );
+		m_position = checkpoint;
+	}
+	vm.argument_stack.clear( );
+	while( m_position > position ) {
+		--m_position;
+		undo( vm, step( m_position ) );
+	}
+	while( m_position < position ) {
+		redo( vm, step( m_position ) );
+		++m_position;
+	}
+	m_travelled = true;
+}
+
+bool vm_history_t::take_travelled( ) {
+	auto const result = m_travelled;
+	m_travelled = false;
+	return result;
+}
+
+void vm_history_t::undo( virtual_machine_t & vm, step_t const & s ) {
+	auto const & record = s.record;
+	if( (record.flags & trace_record_t::HAS_CHANGE) != 0 ) {
+		vm.set_reg_or_mem( record.address, record.old_value );
+	}
+	switch( record.op_code ) {
+	case 2:	// PUSH
+	case 17:	// CALL
+		if( !vm.program_stack.empty( ) ) {
+			vm.program_stack.pop_back( );
+		}
+		break;
+	case 3:	// POP, the popped value is what it wrote
+		vm.program_stack.push_back( record.new_value );
+		break;
+	case 18:	// RET, the popped value is where it returned to
+		vm.program_stack.push_back( s.next_ip );
+		break;
+	default:
+		break;
+	}
+	vm.instruction_ptr = executed_address( record );
+}
+
+void vm_history_t::redo( virtual_machine_t & vm, step_t const & s ) {
+	apply_trace_record( vm, s.record );
+	vm.instruction_ptr = s.next_ip;
+}
@@ -0,0 +1,93 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include "trace_writer.h"
+#include "vm_snapshot.h"
+
+struct virtual_machine_t;
+
+// Recent execution of a vm kept so the console can move backwards as well as forwards.
+// Each step keeps the trace record of the instruction it executed, which is enough to undo
+// or redo it, and a snapshot is taken every CHECKPOINT_INTERVAL steps so that moving to any
+// kept step undoes or redoes at most half an interval.  Step n is the n'th instruction
+// executed since start and position n is the state before it.  Redone steps repeat
+// recorded input and do not repeat output; executing from an earlier position drops the
+// steps after it.  Effects of native overrides are not recorded
+struct vm_history_t final {
+	static uint64_t const CHECKPOINT_INTERVAL = 1u << 14;
+	static size_t const DEFAULT_MAX_STEPS = 1u << 22;
+
+	struct step_t {
+		trace_record_t record;
+		uint16_t next_ip;	// instruction_ptr once the instruction executed
+	};	// struct step_t
+
+	vm_history_t( );
+
+	void start( virtual_machine_t & vm );
+	void stop( );
+	bool is_recording( ) const {
+		return m_recording;
+	}
+	// Called by tick once an instruction has executed
+	void push( virtual_machine_t & vm, trace_record_t const & record );
+
+	uint64_t first( ) const {
+		return m_first;
+	}
+	uint64_t last( ) const {
+		return m_first + m_steps.size( );
+	}
+	uint64_t position( ) const {
+		return m_position;
+	}
+	step_t const & step( uint64_t n ) const {
+		return m_steps[static_cast<size_t>(n - m_first)];
+	}
+	// Moves vm to position, first( ) <= position <= last( ).  Any instruction vm is part way
+	// through is abandoned
+	void go_to( virtual_machine_t & vm, uint64_t position );
+	// true once after go_to moved a vm, for instructions that broke into the console
+	bool travelled( ) const {
+		return m_travelled;
+	}
+	bool take_travelled( );
+
+	size_t max_steps;	// older steps are dropped an interval at a time
+private:
+	void undo( virtual_machine_t & vm, step_t const & s );
+	void redo( virtual_machine_t & vm, step_t const & s );
+
+	std::deque<step_t> m_steps;	// m_steps[n] is step m_first + n
+	std::deque<std::shared_ptr<vm_snapshot_t const>> m_checkpoints;	// position m_first + n * CHECKPOINT_INTERVAL
+	uint64_t m_first;
+	uint64_t m_position;
+	bool m_recording;
+	bool m_travelled;
+};	// struct vm_history_t
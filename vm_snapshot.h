@@ -0,0 +1,44 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "decode_cache.h"
+
+using memory_page_t = std::array<uint16_t, decode_cache_t::PAGE_WORDS>;
+using shared_page_t = std::shared_ptr<memory_page_t const>;
+using shared_pages_t = std::array<shared_page_t, decode_cache_t::PAGE_COUNT>;
+
+// State of a vm taken by virtual_machine_t::snapshot( ).  Pages are immutable and shared by
+// every snapshot, and vm restored from one, they are unchanged in
+struct vm_snapshot_t final {
+	shared_pages_t pages;
+	std::array<uint16_t, 8> registers;
+	uint16_t instruction_ptr;
+	std::vector<uint16_t> program_stack;
+	std::vector<uint16_t> argument_stack;
+};	// struct vm_snapshot_t
@@ -0,0 +1,76 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+
+#include <algorithm>
+#include "watchpoints.h"
+
+void watchpoints_t::set( uint16_t address, uint8_t kinds ) {
+	if( address >= address_set_t::SIZE ) {
+		return;
+	}
+	auto const was_watched = this->kinds( address ) != 0;
+	for( size_t n = 0; n < m_sets.size( ); ++n ) {
+		if( (kinds & (1u << n)) != 0 ) {
+			m_sets[n].insert( address );
+		} else {
+			m_sets[n].erase( address );
+		}
+	}
+	m_size = m_size + (kinds != 0) - was_watched;
+	update_page( address >> PAGE_SHIFT );
+}
+
+void watchpoints_t::clear( ) {
+	for( auto & s : m_sets ) {
+		s.clear( );
+	}
+	m_pages.fill( 0 );
+	m_size = 0;
+	m_has_hit = false;
+}
+
+void watchpoints_t::on_read( uint16_t address, uint16_t value ) {
+	if( (m_pages[address >> PAGE_SHIFT] & READ) != 0 && m_sets[0].count( address ) != 0 ) {
+		hit( READ, address, value, value );
+	}
+}
+
+void watchpoints_t::on_write( uint16_t address, uint16_t old_value, uint16_t new_value ) {
+	auto const page = m_pages[address >> PAGE_SHIFT];
+	if( (page & WRITE) != 0 && m_sets[1].count( address ) != 0 ) {
+		hit( WRITE, address, old_value, new_value );
+	} else if( (page & CHANGE) != 0 && old_value != new_value && m_sets[2].count( address ) != 0 ) {
+		hit( CHANGE, address, old_value, new_value );
+	}
+}
+
+void watchpoints_t::update_page( size_t page ) {
+	uint8_t mask = 0;
+	auto const first = page << PAGE_SHIFT;
+	auto const last = std::min( first + (size_t( 1 ) << PAGE_SHIFT), address_set_t::SIZE );
+	for( auto address = first; address < last; ++address ) {
+		mask |= kinds( static_cast<uint16_t>(address) );
+	}
+	m_pages[page] = mask;
+}
@@ -0,0 +1,116 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include "address_set.h"
+
+// Data watchpoints over memory and registers, checked by the vm where it reads and writes
+// them rather than by looking at instruction operands.  Each 512 word page, and the
+// register file as a page of its own, keeps the kinds watched in it so that an access
+// to an unwatched page is one load and a test
+struct watchpoints_t final {
+	static uint8_t const READ = 1;
+	static uint8_t const WRITE = 2;
+	static uint8_t const CHANGE = 4;	// a write of a different value
+	static size_t const PAGE_SHIFT = 9;
+	static size_t const PAGE_COUNT = (address_set_t::SIZE >> PAGE_SHIFT) + 1;
+
+	struct hit_t {
+		uint8_t kind;
+		uint16_t address;
+		uint16_t old_value;
+		uint16_t new_value;	// the value read for READ
+	};	// struct hit_t
+
+	watchpoints_t( ): m_sets( ), m_pages( ), m_size( 0 ), m_has_hit( false ), m_hit( ) { }
+
+	// Replaces the kinds watched at address, none removes it
+	void set( uint16_t address, uint8_t kinds );
+
+	uint8_t kinds( uint16_t address ) const {
+		uint8_t result = 0;
+		for( size_t n = 0; n < m_sets.size( ); ++n ) {
+			result |= static_cast<uint8_t>(m_sets[n].count( address ) << n);
+		}
+		return result;
+	}
+
+	void clear( );
+
+	size_t size( ) const {
+		return m_size;
+	}
+
+	bool empty( ) const {
+		return m_size == 0;
+	}
+
+	// Out of line so that the vm accessors calling them stay small
+	void on_read( uint16_t address, uint16_t value );
+	void on_write( uint16_t address, uint16_t old_value, uint16_t new_value );
+
+	// The first hit since the last call
+	bool take_hit( hit_t & result ) {
+		if( !m_has_hit ) {
+			return false;
+		}
+		result = m_hit;
+		m_has_hit = false;
+		return true;
+	}
+
+	void forget_hit( ) {
+		m_has_hit = false;
+	}
+
+	// Every watched address in order
+	template<typename Function>
+	void for_each( Function f ) const {
+		for( size_t address = 0; address < address_set_t::SIZE; ++address ) {
+			auto const k = kinds( static_cast<uint16_t>(address) );
+			if( k != 0 ) {
+				f( static_cast<uint16_t>(address), k );
+			}
+		}
+	}
+private:
+	void hit( uint8_t kind, uint16_t address, uint16_t old_value, uint16_t new_value ) {
+		if( !m_has_hit ) {
+			m_hit = hit_t{ kind, address, old_value, new_value };
+			m_has_hit = true;
+		}
+	}
+
+	void update_page( size_t page );
+
+	std::array<address_set_t, 3> m_sets;	// READ, WRITE and CHANGE
+	std::array<uint8_t, PAGE_COUNT> m_pages;
+	size_t m_size;
+	bool m_has_hit;
+	hit_t m_hit;
+};	// struct watchpoints_t